@@ -95,6 +95,7 @@
 #include <86box/midi.h>
 #include <86box/snd_speaker.h>
 #include <86box/video.h>
+#include <86box/vid_pacing.h>
 #include <86box/ui.h>
 #include <86box/path.h>
 #include <86box/plat.h>
@@ -181,6 +182,9 @@ int      isamem_type[ISAMEM_MAX]                = { 0, 0, 0, 0 }; /* (C) enable
 int      isartc_type                            = 0;              /* (C) enable ISA RTC card */
 int      gfxcard[GFXCARD_MAX]                   = { 0, 0 };       /* (C) graphics/video card */
 int      show_second_monitors                   = 1;              /* (C) show non-primary monitors */
+int      video_render_worker                    = 0;              /* (C) convert SVGA scanlines on a worker thread */
+int      video_pacing                           = 0;              /* (C) record display frame pacing statistics */
+int      video_pacing_overlay                   = 0;              /* (C) show the frame pacing statistics on screen */
 int      sound_is_float                         = 1;              /* (C) sound uses FP values */
 int      voodoo_enabled                         = 0;              /* (C) video option */
 int      lba_enhancer_enabled                   = 0;              /* (C) enable Vision Systems LBA Enhancer */
@@ -190,6 +194,9 @@ uint32_t mem_size                               = 0;              /* (C) memory
                                                                          system board)*/
 uint32_t isa_mem_size                           = 0;              /* (C) memory size (ISA Memory Cards) */
 int      cpu_use_dynarec                        = 0;              /* (C) cpu uses/needs Dyna */
+int      cpu_dynarec_blocks                     = 0;              /* (C) dynarec block pool size */
+int      cpu_dynarec_async                      = 0;              /* (C) compile dynarec blocks on a worker thread */
+int      cpu_dynarec_ir_disable                 = 0;              /* (C) dynarec IR optimisation passes to skip */
 int      cpu                                    = 0;              /* (C) cpu type */
 int      fpu_type                               = 0;              /* (C) fpu type */
 int      fpu_softfloat                          = 0;              /* (C) fpu uses softfloat */
@@ -1349,6 +1356,11 @@ pc_close(UNUSED(thread_t *ptr))
 
     plat_mouse_capture(0);
 
+#if defined(USE_DYNAREC) && defined(USE_NEW_DYNAREC)
+    /* Stop the background compile thread. */
+    codegen_close();
+#endif
+
     /* Close all the memory mappings. */
     mem_close();
 
@@ -1463,6 +1475,14 @@ pc_onesec(void)
     fps        = framecount;
     framecount = 0;
 
+    mem_tlb_stats_update();
+
+#if defined(USE_DYNAREC) && defined(USE_NEW_DYNAREC)
+    codegen_stats_update();
+#endif
+
+    video_pacing_update();
+
     title_update = 1;
 }
 
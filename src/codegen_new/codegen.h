@@ -30,6 +30,9 @@
   same page).
 */
 
+/*Number of successor links kept for each block*/
+#define CODEBLOCK_NR_LINKS 4
+
 typedef struct codeblock_t {
     uint32_t pc;
     uint32_t _cs;
@@ -57,11 +60,50 @@ typedef struct codeblock_t {
     /*First mem_block_t used by this block. Any subsequent mem_block_ts
       will be in the list starting at head_mem_block->next.*/
     struct mem_block_t *head_mem_block;
+
+    /*Successor links, used to find the next block without going through the
+      hash table when blocks are chained. Static successors (branch taken and
+      not taken) and targets of indirect branches (RET, JMP r/m) share the
+      slots, which are keyed on linear PC and replaced round-robin.*/
+    uint32_t link_pc[CODEBLOCK_NR_LINKS];
+    uint16_t link_nr[CODEBLOCK_NR_LINKS];
+    uint8_t  link_next;
 } codeblock_t;
 
 extern codeblock_t *codeblock;
 
-extern uint16_t *codeblock_hash;
+/*The block hash is set associative, with HASH_SIZE sets of HASH_WAYS
+  entries indexed by the low bits of the physical address. Each entry has a
+  tag made from the remaining address bits, so a lookup only touches the
+  codeblock_t of likely matches. New entries go to the front of their set,
+  pushing the oldest entry out when the set is full.*/
+#define HASH_WAYS   4
+#define HASH_SIZE   0x8000
+#define HASH_MASK   0x7fff
+
+#define HASH(l)     ((l) &HASH_MASK)
+#define HASH_TAG(l) ((uint16_t) ((l) >> 15))
+
+typedef struct codeblock_hash_set_t {
+    uint16_t tag[HASH_WAYS];
+    uint16_t block[HASH_WAYS];
+} codeblock_hash_set_t;
+
+extern codeblock_hash_set_t *codeblock_hash;
+
+/*Number of blocks in the codeblock pool. This is BLOCK_SIZE unless raised
+  by the cpu_dynarec_blocks option, up to the 0x10000 blocks that 16-bit
+  block numbers can address.*/
+extern int codegen_block_nr;
+
+/*Block lookup statistics*/
+extern uint64_t codegen_hash_hits;       /*Block found in its hash set*/
+extern uint64_t codegen_hash_misses;     /*Block not in its hash set*/
+extern uint64_t codegen_hash_collisions; /*Tag matched a block for another CS or CPU mode*/
+extern uint64_t codegen_hash_evictions;  /*Entry pushed out of a full hash set*/
+extern uint64_t codegen_block_evictions; /*Block deleted to free up the pool or code memory*/
+extern uint64_t codegen_evict_recompiles; /*Evicted block that had to be generated again*/
+extern uint64_t codegen_async_failures;   /*Background compile that ran out of code memory*/
 
 extern uint8_t *block_write_data;
 
@@ -81,6 +123,13 @@ extern uint8_t *block_write_data;
 #define CODEBLOCK_IN_DIRTY_LIST 0x40
 /*Code block is not inlining immediate parameters, parameters must be fetched from memory*/
 #define CODEBLOCK_NO_IMMEDIATES 0x80
+/*Code block has been run since the evictor last looked at it*/
+#define CODEBLOCK_REFERENCED 0x100
+/*Code block is being compiled by the background compiler and can not be run yet*/
+#define CODEBLOCK_COMPILING 0x200
+/*Code block ran out of code memory on the background compiler, compile it on
+  the CPU thread instead*/
+#define CODEBLOCK_NO_ASYNC 0x400
 
 #define BLOCK_PC_INVALID        0xffffffff
 
@@ -92,6 +141,73 @@ get_block_nr(codeblock_t *block)
     return ((uintptr_t) block - (uintptr_t) codeblock) / sizeof(codeblock_t);
 }
 
+/*Look up the block for phys and _cs in the block hash. Returns the
+  BLOCK_INVALID block if there is none, the caller must still check the PC.*/
+static inline codeblock_t *
+codeblock_hash_find(uint32_t phys, uint32_t _cs)
+{
+    codeblock_hash_set_t *set = &codeblock_hash[HASH(phys)];
+    uint16_t              tag = HASH_TAG(phys);
+
+    for (int c = 0; c < HASH_WAYS; c++) {
+        if (set->block[c] && (set->tag[c] == tag)) {
+            codeblock_t *block = &codeblock[set->block[c]];
+
+            if ((block->phys == phys) && (block->_cs == _cs) && !((block->status ^ cpu_cur_status) & CPU_STATUS_FLAGS) && ((block->status & cpu_cur_status & CPU_STATUS_MASK) == (cpu_cur_status & CPU_STATUS_MASK))) {
+                codegen_hash_hits++;
+                return block;
+            }
+            codegen_hash_collisions++;
+        }
+    }
+
+    codegen_hash_misses++;
+    return &codeblock[BLOCK_INVALID];
+}
+
+/*Insert block at the front of its hash set, or move it there if it is
+  already present*/
+static inline void
+codeblock_hash_add(codeblock_t *block)
+{
+    codeblock_hash_set_t *set      = &codeblock_hash[HASH(block->phys)];
+    uint16_t              block_nr = get_block_nr(block);
+    int                   c;
+
+    for (c = 0; c < (HASH_WAYS - 1); c++) {
+        if (set->block[c] == block_nr)
+            break;
+    }
+    if ((c == (HASH_WAYS - 1)) && set->block[c] && (set->block[c] != block_nr))
+        codegen_hash_evictions++;
+
+    for (; c > 0; c--) {
+        set->tag[c]   = set->tag[c - 1];
+        set->block[c] = set->block[c - 1];
+    }
+    set->tag[0]   = HASH_TAG(block->phys);
+    set->block[0] = block_nr;
+}
+
+static inline void
+codeblock_hash_remove(codeblock_t *block)
+{
+    codeblock_hash_set_t *set      = &codeblock_hash[HASH(block->phys)];
+    uint16_t              block_nr = get_block_nr(block);
+
+    for (int c = 0; c < HASH_WAYS; c++) {
+        if (set->block[c] == block_nr) {
+            for (; c < (HASH_WAYS - 1); c++) {
+                set->tag[c]   = set->tag[c + 1];
+                set->block[c] = set->block[c + 1];
+            }
+            set->tag[HASH_WAYS - 1]   = 0;
+            set->block[HASH_WAYS - 1] = BLOCK_INVALID;
+            return;
+        }
+    }
+}
+
 static inline codeblock_t *
 codeblock_tree_find(uint32_t phys, uint32_t _cs)
 {
@@ -117,6 +233,43 @@ codeblock_tree_find(uint32_t phys, uint32_t _cs)
     return block;
 }
 
+/*Return the block linked from block for linear PC pc, or NULL if there is
+  none. Links are not removed when their target is deleted, so the target is
+  checked for still being at pc; the caller must still validate it against
+  the current CPU state.*/
+static inline codeblock_t *
+codeblock_link_find(codeblock_t *block, uint32_t pc)
+{
+    for (int c = 0; c < CODEBLOCK_NR_LINKS; c++) {
+        if (block->link_pc[c] == pc) {
+            codeblock_t *next = &codeblock[block->link_nr[c]];
+
+            if (next->pc == pc)
+                return next;
+            block->link_pc[c] = BLOCK_PC_INVALID;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static inline void
+codeblock_link_add(codeblock_t *block, codeblock_t *next)
+{
+    block->link_pc[block->link_next] = next->pc;
+    block->link_nr[block->link_next] = get_block_nr(next);
+    block->link_next                 = (block->link_next + 1) & (CODEBLOCK_NR_LINKS - 1);
+}
+
+static inline void
+codeblock_unlink(codeblock_t *block)
+{
+    for (int c = 0; c < CODEBLOCK_NR_LINKS; c++)
+        block->link_pc[c] = BLOCK_PC_INVALID;
+    block->link_next = 0;
+}
+
 static inline void
 codeblock_tree_add(codeblock_t *new_block)
 {
@@ -308,9 +461,29 @@ extern void codegen_check_seg_read(codeblock_t *block, struct ir_data_t *ir, x86
 extern void codegen_check_seg_write(codeblock_t *block, struct ir_data_t *ir, x86seg *seg);
 
 extern int codegen_purge_purgable_list(void);
-/*Delete a random code block to free memory. This is obviously quite expensive, and
-  will only be called when the allocator is out of memory*/
-extern void codegen_delete_random_block(int required_mem_block);
+/*Delete a code block that has not run recently, picked by a clock sweep over
+  the block pool, to free a block or, if required_mem_block is set, memory.
+  Only called when the block pool or the allocator is out of space*/
+extern void codegen_evict_block(int required_mem_block);
+
+/*Background compilation. When enabled, the IR of a block is still built on the
+  CPU thread while the block is interpreted, but the backend code is generated
+  on a worker thread. One block is compiled at a time; while it is in flight
+  blocks that are due to be recompiled are interpreted instead.*/
+extern int  codegen_async;
+extern void codegen_async_poll(void);
+extern int  codegen_async_busy(void);
+
+#ifdef _MSC_VER
+#    define CODEGEN_THREAD_LOCAL __declspec(thread)
+#else
+#    define CODEGEN_THREAD_LOCAL __thread
+#endif
+/*Set on the background compile thread only*/
+extern CODEGEN_THREAD_LOCAL int codegen_async_worker;
+/*Abandon the compile running on the background compile thread. The CPU thread
+  frees what was generated and compiles the block itself next time round*/
+extern void codegen_async_abort(void);
 
 extern int      cpu_block_end;
 extern uint32_t codegen_endpc;
@@ -320,6 +493,9 @@ extern int cpu_notreps;
 
 extern int codegen_block_cycles;
 
+/*Number of blocks entered through a successor link*/
+extern uint64_t codegen_chain_hits;
+
 extern void (*codegen_timing_start)(void);
 extern void (*codegen_timing_prefix)(uint8_t prefix, uint32_t fetchdat);
 extern void (*codegen_timing_opcode)(uint8_t opcode, uint32_t fetchdat, int op_32, uint32_t op_pc);
@@ -14,6 +14,7 @@
 #include "cpu.h"
 #include <86box/mem.h>
 #include <86box/plat_unused.h>
+#include <86box/thread.h>
 
 #include "codegen.h"
 #include "codegen_allocator.h"
@@ -27,6 +28,9 @@ typedef struct mem_block_t {
 static mem_block_t mem_blocks[MEM_BLOCK_NR];
 static uint32_t    mem_block_free_list;
 static uint8_t    *mem_block_alloc = NULL;
+/*Guards the free list when blocks are compiled on a worker thread. The worker
+  only allocates, and the CPU thread only frees while a compile is in flight*/
+static mutex_t    *mem_block_mutex = NULL;
 
 int codegen_allocator_usage = 0;
 
@@ -52,6 +56,17 @@ codegen_allocator_init(void)
             mem_blocks[c].next = 0;
     }
     mem_block_free_list = 1;
+
+    if (codegen_async)
+        mem_block_mutex = thread_create_mutex();
+}
+
+void
+codegen_allocator_close(void)
+{
+    if (mem_block_mutex)
+        thread_close_mutex(mem_block_mutex);
+    mem_block_mutex = NULL;
 }
 
 mem_block_t *
@@ -60,19 +75,26 @@ codegen_allocator_allocate(mem_block_t *parent, int code_block)
     mem_block_t *block;
     uint32_t     block_nr;
 
+    /*Free up the code memory of the least recently run code block. The
+      evictor never picks block_current, which is the block being compiled*/
     while (!mem_block_free_list) {
-        /*Pick a random memory block and free the owning code block*/
-        block_nr = rand() & MEM_BLOCK_MASK;
-        block    = &mem_blocks[block_nr];
-
-        if (block->code_block && block->code_block != code_block)
-            codegen_delete_block(&codeblock[block->code_block]);
+        /*Evicting changes the block lists and hash, which belong to the CPU
+          thread. If the worker runs past what was reserved for it, the block
+          is handed back to the CPU thread instead*/
+        if (codegen_async_worker)
+            codegen_async_abort();
+        codegen_evict_block(1);
     }
 
     /*Remove from free list*/
+    if (mem_block_mutex)
+        thread_wait_mutex(mem_block_mutex);
     block_nr            = mem_block_free_list;
     block               = &mem_blocks[block_nr - 1];
     mem_block_free_list = block->next;
+    codegen_allocator_usage++;
+    if (mem_block_mutex)
+        thread_release_mutex(mem_block_mutex);
 
     block->code_block = code_block;
     if (parent) {
@@ -82,14 +104,24 @@ codegen_allocator_allocate(mem_block_t *parent, int code_block)
     } else
         block->next = 0;
 
-    codegen_allocator_usage++;
     return block;
 }
+
+/*Make sure at least nr blocks are free, so that a compile running on the worker
+  thread never has to evict*/
+void
+codegen_allocator_reserve(int nr)
+{
+    while ((MEM_BLOCK_NR - codegen_allocator_usage) < nr)
+        codegen_evict_block(1);
+}
 void
 codegen_allocator_free(mem_block_t *block)
 {
     int block_nr = (((uintptr_t) block - (uintptr_t) mem_blocks) / sizeof(mem_block_t)) + 1;
 
+    if (mem_block_mutex)
+        thread_wait_mutex(mem_block_mutex);
     while (1) {
         int next_block_nr = block->next;
         codegen_allocator_usage--;
@@ -104,6 +136,8 @@ codegen_allocator_free(mem_block_t *block)
         else
             break;
     }
+    if (mem_block_mutex)
+        thread_release_mutex(mem_block_mutex);
 }
 
 uint8_t *
@@ -23,10 +23,13 @@
 #define MEM_BLOCK_SIZE 0x3c0
 
 void codegen_allocator_init(void);
+void codegen_allocator_close(void);
 /*Allocate a mem_block_t, and the associated backing memory.
   If parent is non-NULL, then the new block will be added to the list in
   parent->next*/
 struct mem_block_t *codegen_allocator_allocate(struct mem_block_t *parent, int code_block);
+/*Evict code blocks until at least nr mem_block_ts are free*/
+void codegen_allocator_reserve(int nr);
 /*Free a mem_block_t, and any subsequent blocks in the list at block->next*/
 void codegen_allocator_free(struct mem_block_t *block);
 /*Get a pointer to the backing memory associated with block*/
@@ -292,13 +292,13 @@ codegen_backend_init(void)
 {
     codeblock_t *block;
 
-    codeblock      = malloc(BLOCK_SIZE * sizeof(codeblock_t));
-    codeblock_hash = malloc(HASH_SIZE * sizeof(codeblock_t *));
+    codeblock      = malloc(codegen_block_nr * sizeof(codeblock_t));
+    codeblock_hash = malloc(HASH_SIZE * sizeof(codeblock_hash_set_t));
 
-    memset(codeblock, 0, BLOCK_SIZE * sizeof(codeblock_t));
-    memset(codeblock_hash, 0, HASH_SIZE * sizeof(codeblock_t *));
+    memset(codeblock, 0, codegen_block_nr * sizeof(codeblock_t));
+    memset(codeblock_hash, 0, HASH_SIZE * sizeof(codeblock_hash_set_t));
 
-    for (int c = 0; c < BLOCK_SIZE; c++)
+    for (int c = 0; c < codegen_block_nr; c++)
         codeblock[c].pc = BLOCK_PC_INVALID;
 
     block_current         = 0;
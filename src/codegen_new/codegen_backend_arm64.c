@@ -71,38 +71,106 @@ host_reg_def_t codegen_host_fp_reg_list[CODEGEN_HOST_FP_REGS] = {
     { REG_V15, 0}
 };
 
+/*Look up the page of an address in the small TLB.
+  In - W0 = address
+  Out - X<reg> = host address - guest address for the page, X3 = offset of
+        the TLB entry
+  Corrupts X4, X5
+  Returns the branch taken on a TLB miss, *hit is set to the instructions
+  that load the addend.*/
+static uint32_t *
+build_tlb_probe(codeblock_t *block, int reg, mem_tlb_t *tlb, uint32_t **hit)
+{
+    uint32_t *miss_offset;
+
+    /*MOV W3, W0, LSR #8
+      AND W3, W3, #0xff0
+      MOV X4, #&tlb[0].tag
+      LDR W5, [X4, X3]
+      MOV W<reg>, W0, LSR #12
+      CMP W5, W<reg>
+      BNE miss
+    * MOV X4, #&tlb[0].addend
+      LDR X<reg>, [X4, X3]
+    */
+    host_arm64_MOV_REG_LSR(block, REG_W3, REG_W0, 8);
+    host_arm64_AND_IMM(block, REG_W3, REG_W3, (MEM_TLB_SIZE - 1) * sizeof(mem_tlb_t));
+    host_arm64_MOVX_IMM(block, REG_X4, (uint64_t) &tlb[0].tag);
+    host_arm64_LDR_REG(block, REG_W5, REG_X4, REG_X3);
+    host_arm64_MOV_REG_LSR(block, reg, REG_W0, 12);
+    host_arm64_CMP_REG(block, REG_W5, reg);
+    miss_offset = host_arm64_BNE_(block);
+    *hit = (uint32_t *) &block_write_data[block_pos];
+    host_arm64_MOVX_IMM(block, REG_X4, (uint64_t) &tlb[0].addend);
+    host_arm64_LDR_REG_X(block, reg, REG_X4, REG_X3);
+
+    return miss_offset;
+}
+
+/*Refill a TLB entry from lookup2 after a miss in build_tlb_probe(), then
+  retry the access.
+  Returns the branch taken when the page is not mapped.*/
+static uint32_t *
+build_tlb_refill(codeblock_t *block, int reg, mem_tlb_t *tlb, uintptr_t *lookup2, uint32_t *miss_offset, uint32_t *hit)
+{
+    uint32_t *branch_offset;
+
+    /*miss:
+      MOV X4, #lookup2
+      LDR X<reg>, [X4, X<reg>, LSL #3]
+      CMP X<reg>, #-1
+      BEQ slow
+      MOV X4, #&tlb[0].addend
+      STR X<reg>, [X4, X3]
+      MOV W<reg>, W0, LSR #12
+      MOV X4, #&tlb[0].tag
+      STR W<reg>, [X4, X3]
+      B hit
+    */
+    host_arm64_branch_set_offset(miss_offset, &block_write_data[block_pos]);
+    host_arm64_MOVX_IMM(block, REG_X4, (uint64_t) lookup2);
+    host_arm64_LDRX_REG_LSL3(block, reg, REG_X4, reg);
+    host_arm64_CMPX_IMM(block, reg, -1);
+    branch_offset = host_arm64_BEQ_(block);
+    host_arm64_MOVX_IMM(block, REG_X4, (uint64_t) &tlb[0].addend);
+    host_arm64_STR_REG_X(block, reg, REG_X4, REG_X3);
+    host_arm64_MOV_REG_LSR(block, reg, REG_W0, 12);
+    host_arm64_MOVX_IMM(block, REG_X4, (uint64_t) &tlb[0].tag);
+    host_arm64_STR_REG(block, reg, REG_X4, REG_X3);
+    host_arm64_B(block, hit);
+
+    return branch_offset;
+}
+
 static void
 build_load_routine(codeblock_t *block, int size, int is_float)
 {
     uint32_t *branch_offset;
+    uint32_t *miss_offset;
+    uint32_t *hit;
     uint32_t *misaligned_offset;
 
     /*In - W0 = address
       Out - W0 = data, W1 = abrt*/
-    /*MOV W1, W0, LSR #12
-      MOV X2, #readlookup2
-      LDR X1, [X2, X1, LSL #3]
-      CMP X1, #-1
-      BEQ +
+    /*TST W0, #size-1
+      BNE slow
+      <TLB probe, X1 = addend>
       LDRB W0, [X1, X0]
       MOV W1, #0
       RET
+      <TLB refill, BEQ slow if not in readlookup2>
     * STP X29, X30, [SP, #-16]
       BL readmembl
       LDRB R1, cpu_state.abrt
       LDP X29, X30, [SP, #-16]
       RET
     */
-    codegen_alloc(block, 80);
-    host_arm64_MOV_REG_LSR(block, REG_W1, REG_W0, 12);
-    host_arm64_MOVX_IMM(block, REG_X2, (uint64_t) readlookup2);
-    host_arm64_LDRX_REG_LSL3(block, REG_X1, REG_X2, REG_X1);
+    codegen_alloc(block, 320);
     if (size != 1) {
         host_arm64_TST_IMM(block, REG_W0, size - 1);
         misaligned_offset = host_arm64_BNE_(block);
     }
-    host_arm64_CMPX_IMM(block, REG_X1, -1);
-    branch_offset = host_arm64_BEQ_(block);
+    miss_offset = build_tlb_probe(block, REG_X1, read_tlb, &hit);
     if (size == 1 && !is_float)
         host_arm64_LDRB_REG(block, REG_W0, REG_W1, REG_W0);
     else if (size == 2 && !is_float)
@@ -116,6 +184,7 @@ build_load_routine(codeblock_t *block, int size, int is_float)
     host_arm64_MOVZ_IMM(block, REG_W1, 0);
     host_arm64_RET(block, REG_X30);
 
+    branch_offset = build_tlb_refill(block, REG_X1, read_tlb, readlookup2, miss_offset, hit);
     host_arm64_branch_set_offset(branch_offset, &block_write_data[block_pos]);
     if (size != 1)
         host_arm64_branch_set_offset(misaligned_offset, &block_write_data[block_pos]);
@@ -143,34 +212,31 @@ static void
 build_store_routine(codeblock_t *block, int size, int is_float)
 {
     uint32_t *branch_offset;
+    uint32_t *miss_offset;
+    uint32_t *hit;
     uint32_t *misaligned_offset;
 
     /*In - R0 = address, R1 = data
       Out - R1 = abrt*/
-    /*MOV W2, W0, LSR #12
-      MOV X3, #writelookup2
-      LDR X2, [X3, X2, LSL #3]
-      CMP X2, #-1
-      BEQ +
+    /*TST W0, #size-1
+      BNE slow
+      <TLB probe, X2 = addend>
       STRB W1, [X2, X0]
       MOV W1, #0
       RET
+      <TLB refill, BEQ slow if not in writelookup2>
     * STP X29, X30, [SP, #-16]
       BL writemembl
       LDRB R1, cpu_state.abrt
       LDP X29, X30, [SP, #-16]
       RET
     */
-    codegen_alloc(block, 80);
-    host_arm64_MOV_REG_LSR(block, REG_W2, REG_W0, 12);
-    host_arm64_MOVX_IMM(block, REG_X3, (uint64_t) writelookup2);
-    host_arm64_LDRX_REG_LSL3(block, REG_X2, REG_X3, REG_X2);
+    codegen_alloc(block, 320);
     if (size != 1) {
         host_arm64_TST_IMM(block, REG_W0, size - 1);
         misaligned_offset = host_arm64_BNE_(block);
     }
-    host_arm64_CMPX_IMM(block, REG_X2, -1);
-    branch_offset = host_arm64_BEQ_(block);
+    miss_offset = build_tlb_probe(block, REG_X2, write_tlb, &hit);
     if (size == 1 && !is_float)
         host_arm64_STRB_REG(block, REG_X1, REG_X2, REG_X0);
     else if (size == 2 && !is_float)
@@ -184,6 +250,7 @@ build_store_routine(codeblock_t *block, int size, int is_float)
     host_arm64_MOVZ_IMM(block, REG_X1, 0);
     host_arm64_RET(block, REG_X30);
 
+    branch_offset = build_tlb_refill(block, REG_X2, write_tlb, writelookup2, miss_offset, hit);
     host_arm64_branch_set_offset(branch_offset, &block_write_data[block_pos]);
     if (size != 1)
         host_arm64_branch_set_offset(misaligned_offset, &block_write_data[block_pos]);
@@ -285,13 +352,13 @@ codegen_backend_init(void)
 {
     codeblock_t *block;
 
-    codeblock      = malloc(BLOCK_SIZE * sizeof(codeblock_t));
-    codeblock_hash = malloc(HASH_SIZE * sizeof(codeblock_t *));
+    codeblock      = malloc(codegen_block_nr * sizeof(codeblock_t));
+    codeblock_hash = malloc(HASH_SIZE * sizeof(codeblock_hash_set_t));
 
-    memset(codeblock, 0, BLOCK_SIZE * sizeof(codeblock_t));
-    memset(codeblock_hash, 0, HASH_SIZE * sizeof(codeblock_t *));
+    memset(codeblock, 0, codegen_block_nr * sizeof(codeblock_t));
+    memset(codeblock_hash, 0, HASH_SIZE * sizeof(codeblock_hash_set_t));
 
-    for (int c = 0; c < BLOCK_SIZE; c++) {
+    for (int c = 0; c < codegen_block_nr; c++) {
         codeblock[c].pc = BLOCK_PC_INVALID;
     }
 
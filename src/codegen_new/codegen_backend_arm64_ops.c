@@ -188,6 +188,7 @@
 #    define OPCODE_SSHR_VD            (0x0f000400)
 #    define OPCODE_SSHR_VQ            (0x4f000400)
 #    define OPCODE_STR_REG            (0xb8206800)
+#    define OPCODE_STRX_REG           (0xf8206800)
 #    define OPCODE_STRB_REG           (0x38206800)
 #    define OPCODE_STRH_REG           (0x78206800)
 #    define OPCODE_STR_REG_F32        (0xbc206800)
@@ -1296,6 +1297,11 @@ host_arm64_STR_REG(codeblock_t *block, int src_reg, int base_reg, int offset_reg
 {
     codegen_addlong(block, OPCODE_STR_REG | Rn(base_reg) | Rm(offset_reg) | Rt(src_reg));
 }
+void
+host_arm64_STR_REG_X(codeblock_t *block, int src_reg, int base_reg, int offset_reg)
+{
+    codegen_addlong(block, OPCODE_STRX_REG | Rn(base_reg) | Rm(offset_reg) | Rt(src_reg));
+}
 
 void
 host_arm64_STR_REG_F32(codeblock_t *block, int src_reg, int base_reg, int offset_reg)
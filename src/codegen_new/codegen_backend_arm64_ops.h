@@ -203,6 +203,7 @@ void host_arm64_STP_PREIDX_X(codeblock_t *block, int src_reg1, int src_reg2, int
 void host_arm64_STR_IMM_W(codeblock_t *block, int dest_reg, int base_reg, int offset);
 void host_arm64_STR_IMM_Q(codeblock_t *block, int dest_reg, int base_reg, int offset);
 void host_arm64_STR_REG(codeblock_t *block, int src_reg, int base_reg, int offset_reg);
+void host_arm64_STR_REG_X(codeblock_t *block, int src_reg, int base_reg, int offset_reg);
 
 void host_arm64_STR_REG_F32(codeblock_t *block, int src_reg, int base_reg, int offset_reg);
 void host_arm64_STR_IMM_F64(codeblock_t *block, int src_reg, int base_reg, int offset);
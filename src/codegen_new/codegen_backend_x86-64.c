@@ -69,22 +69,94 @@ host_reg_def_t codegen_host_fp_reg_list[CODEGEN_HOST_FP_REGS] = {
     { REG_XMM5, HOST_REG_FLAG_VOLATILE}
 };
 
+/*Look up the page of an address in the small TLB.
+  In - ESI = address
+  Out - RSI = host address - guest address for the page, R8 = &tlb[0].tag,
+        R9 = &tlb[0].addend, R10 = offset of the TLB entry
+  Returns the offset of the branch taken on a TLB miss, *hit is set to the
+  instruction that loads the addend.*/
+static uint8_t *
+build_tlb_probe(codeblock_t *block, int addr_reg, mem_tlb_t *tlb, uint8_t **hit)
+{
+    uint8_t *miss_offset;
+
+    /*SHR ESI, 8
+      AND ESI, 0xff0
+      MOV R10, RSI
+      MOV ESI, addr_reg
+      SHR ESI, 12
+      MOV R8, &tlb[0].tag
+      MOV R9, &tlb[0].addend
+      CMP ESI, [R8+R10]
+      JNZ miss
+    * MOV RSI, [R9+R10]
+    */
+    host_x86_SHR32_IMM(block, REG_ESI, 8);
+    host_x86_AND32_REG_IMM(block, REG_ESI, (MEM_TLB_SIZE - 1) * sizeof(mem_tlb_t));
+    host_x86_MOV64_REG_REG(block, REG_R10, REG_RSI);
+    host_x86_MOV32_REG_REG(block, REG_ESI, addr_reg);
+    host_x86_SHR32_IMM(block, REG_ESI, 12);
+    host_x86_MOV64_REG_IMM(block, REG_R8, (uint64_t) (uintptr_t) &tlb[0].tag);
+    host_x86_MOV64_REG_IMM(block, REG_R9, (uint64_t) (uintptr_t) &tlb[0].addend);
+    host_x86_CMP32_REG_BASE_INDEX(block, REG_ESI, REG_R8, REG_R10);
+    miss_offset = host_x86_JNZ_short(block);
+    *hit = &block_write_data[block_pos];
+    host_x86_MOV64_REG_BASE_INDEX_SHIFT(block, REG_RSI, REG_R9, REG_R10, 0);
+
+    return miss_offset;
+}
+
+/*Refill a TLB entry from lookup2 after a miss in build_tlb_probe(), then
+  retry the access.
+  Returns the offset of the branch taken when the page is not mapped.*/
+static uint8_t *
+build_tlb_refill(codeblock_t *block, int addr_reg, uintptr_t *lookup2, uint8_t *miss_offset, uint8_t *hit)
+{
+    uint8_t *branch_offset;
+
+    /*miss:
+      MOV R11, lookup2
+      MOV RSI, [R11+RSI*8]
+      CMP RSI, -1
+      JZ slow
+      MOV [R9+R10], RSI
+      MOV ESI, addr_reg
+      SHR ESI, 12
+      MOV [R8+R10], ESI
+      JMP hit
+    */
+    *miss_offset = (uint8_t) ((uintptr_t) &block_write_data[block_pos] - (uintptr_t) miss_offset) - 1;
+    host_x86_MOV64_REG_IMM(block, REG_R11, (uint64_t) (uintptr_t) lookup2);
+    host_x86_MOV64_REG_BASE_INDEX_SHIFT(block, REG_RSI, REG_R11, REG_RSI, 3);
+    host_x86_CMP64_REG_IMM(block, REG_RSI, (uint32_t) -1);
+    branch_offset = host_x86_JZ_short(block);
+    host_x86_MOV64_BASE_INDEX_REG(block, REG_R9, REG_R10, REG_RSI);
+    host_x86_MOV32_REG_REG(block, REG_ESI, addr_reg);
+    host_x86_SHR32_IMM(block, REG_ESI, 12);
+    host_x86_MOV32_BASE_INDEX_REG(block, REG_R8, REG_R10, REG_ESI);
+    host_x86_JMP(block, hit);
+
+    return branch_offset;
+}
+
 static void
 build_load_routine(codeblock_t *block, int size, int is_float)
 {
     uint8_t *branch_offset;
+    uint8_t *miss_offset;
+    uint8_t *hit;
     uint8_t *misaligned_offset = NULL;
 
     /*In - ESI = address
       Out - ECX = data, ESI = abrt*/
     /*MOV ECX, ESI
-      SHR ESI, 12
-      MOV RSI, [readlookup2+ESI*4]
-      CMP ESI, -1
-      JNZ +
+      TEST ECX, size-1
+      JNZ slow
+      <TLB probe>
       MOVZX ECX, B[RSI+RCX]
       XOR ESI,ESI
       RET
+      <TLB refill, JZ slow if not in readlookup2>
     * PUSH EAX
       PUSH EDX
       PUSH ECX
@@ -96,15 +168,11 @@ build_load_routine(codeblock_t *block, int size, int is_float)
       RET
     */
     host_x86_MOV32_REG_REG(block, REG_ECX, REG_ESI);
-    host_x86_SHR32_IMM(block, REG_ESI, 12);
-    host_x86_MOV64_REG_IMM(block, REG_RDI, (uint64_t) (uintptr_t) readlookup2);
-    host_x86_MOV64_REG_BASE_INDEX_SHIFT(block, REG_RSI, REG_RDI, REG_RSI, 3);
     if (size != 1) {
         host_x86_TEST32_REG_IMM(block, REG_ECX, size - 1);
         misaligned_offset = host_x86_JNZ_short(block);
     }
-    host_x86_CMP64_REG_IMM(block, REG_RSI, (uint32_t) -1);
-    branch_offset = host_x86_JZ_short(block);
+    miss_offset = build_tlb_probe(block, REG_ECX, read_tlb, &hit);
     if (size == 1 && !is_float)
         host_x86_MOVZX_BASE_INDEX_32_8(block, REG_ECX, REG_RSI, REG_RCX);
     else if (size == 2 && !is_float)
@@ -120,6 +188,7 @@ build_load_routine(codeblock_t *block, int size, int is_float)
     host_x86_XOR32_REG_REG(block, REG_ESI, REG_ESI);
     host_x86_RET(block);
 
+    branch_offset = build_tlb_refill(block, REG_ECX, readlookup2, miss_offset, hit);
     *branch_offset = (uint8_t) ((uintptr_t) &block_write_data[block_pos] - (uintptr_t) branch_offset) - 1;
     if (size != 1)
         *misaligned_offset = (uint8_t) ((uintptr_t) &block_write_data[block_pos] - (uintptr_t) misaligned_offset) - 1;
@@ -161,19 +230,21 @@ static void
 build_store_routine(codeblock_t *block, int size, int is_float)
 {
     uint8_t *branch_offset;
+    uint8_t *miss_offset;
+    uint8_t *hit;
     uint8_t *misaligned_offset = NULL;
 
     /*In - ECX = data, ESI = address
       Out - ESI = abrt
-      Corrupts EDI*/
+      Corrupts EDI, R8-R11*/
     /*MOV EDI, ESI
-      SHR ESI, 12
-      MOV ESI, [writelookup2+ESI*4]
-      CMP ESI, -1
-      JNZ +
+      TEST EDI, size-1
+      JNZ slow
+      <TLB probe>
       MOV [RSI+RDI], ECX
       XOR ESI,ESI
       RET
+      <TLB refill, JZ slow if not in writelookup2>
     * PUSH EAX
       PUSH EDX
       PUSH ECX
@@ -185,15 +256,11 @@ build_store_routine(codeblock_t *block, int size, int is_float)
       RET
     */
     host_x86_MOV32_REG_REG(block, REG_EDI, REG_ESI);
-    host_x86_SHR32_IMM(block, REG_ESI, 12);
-    host_x86_MOV64_REG_IMM(block, REG_R8, (uint64_t) (uintptr_t) writelookup2);
-    host_x86_MOV64_REG_BASE_INDEX_SHIFT(block, REG_RSI, REG_R8, REG_RSI, 3);
     if (size != 1) {
         host_x86_TEST32_REG_IMM(block, REG_EDI, size - 1);
         misaligned_offset = host_x86_JNZ_short(block);
     }
-    host_x86_CMP64_REG_IMM(block, REG_RSI, (uint32_t) -1);
-    branch_offset = host_x86_JZ_short(block);
+    miss_offset = build_tlb_probe(block, REG_EDI, write_tlb, &hit);
     if (size == 1 && !is_float)
         host_x86_MOV8_BASE_INDEX_REG(block, REG_RSI, REG_RDI, REG_ECX);
     else if (size == 2 && !is_float)
@@ -209,6 +276,7 @@ build_store_routine(codeblock_t *block, int size, int is_float)
     host_x86_XOR32_REG_REG(block, REG_ESI, REG_ESI);
     host_x86_RET(block);
 
+    branch_offset = build_tlb_refill(block, REG_EDI, writelookup2, miss_offset, hit);
     *branch_offset = (uint8_t) ((uintptr_t) &block_write_data[block_pos] - (uintptr_t) branch_offset) - 1;
     if (size != 1)
         *misaligned_offset = (uint8_t) ((uintptr_t) &block_write_data[block_pos] - (uintptr_t) misaligned_offset) - 1;
@@ -288,13 +356,13 @@ codegen_backend_init(void)
     codeblock_t *block;
     int          c;
 
-    codeblock      = malloc(BLOCK_SIZE * sizeof(codeblock_t));
-    codeblock_hash = malloc(HASH_SIZE * sizeof(codeblock_t *));
+    codeblock      = malloc(codegen_block_nr * sizeof(codeblock_t));
+    codeblock_hash = malloc(HASH_SIZE * sizeof(codeblock_hash_set_t));
 
-    memset(codeblock, 0, BLOCK_SIZE * sizeof(codeblock_t));
-    memset(codeblock_hash, 0, HASH_SIZE * sizeof(codeblock_t *));
+    memset(codeblock, 0, codegen_block_nr * sizeof(codeblock_t));
+    memset(codeblock_hash, 0, HASH_SIZE * sizeof(codeblock_hash_set_t));
 
-    for (c = 0; c < BLOCK_SIZE; c++)
+    for (c = 0; c < codegen_block_nr; c++)
         codeblock[c].pc = BLOCK_PC_INVALID;
 
     block_current                           = 0;
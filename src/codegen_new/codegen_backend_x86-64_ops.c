@@ -303,6 +303,21 @@ host_x86_CMP32_REG_REG(codeblock_t *block, int src_reg_a, int src_reg_b)
     codegen_alloc_bytes(block, 2);
     codegen_addbyte2(block, 0x39, 0xc0 | src_reg_a | (src_reg_b << 3)); /*CMP src_reg_a, src_reg_b*/
 }
+void
+host_x86_CMP32_REG_BASE_INDEX(codeblock_t *block, int src_reg, int base_reg, int index_reg)
+{
+    int rex = ((src_reg & 8) ? 4 : 0) | ((index_reg & 8) ? 2 : 0) | ((base_reg & 8) ? 1 : 0);
+
+    if ((base_reg & 7) == REG_EBP)
+        fatal("host_x86_CMP32_REG_BASE_INDEX - bad base_reg\n");
+    if (rex) {
+        codegen_alloc_bytes(block, 4);
+        codegen_addbyte4(block, 0x40 | rex, 0x3b, 0x04 | ((src_reg & 7) << 3), ((index_reg & 7) << 3) | (base_reg & 7)); /*CMP src_reg, L[base_reg + index_reg]*/
+    } else {
+        codegen_alloc_bytes(block, 3);
+        codegen_addbyte3(block, 0x3b, 0x04 | (src_reg << 3), (index_reg << 3) | base_reg); /*CMP src_reg, L[base_reg + index_reg]*/
+    }
+}
 
 void
 host_x86_JMP(codeblock_t *block, void *p)
@@ -673,10 +688,27 @@ host_x86_MOV16_BASE_INDEX_REG(codeblock_t *block, int base_reg, int index_reg, i
 void
 host_x86_MOV32_BASE_INDEX_REG(codeblock_t *block, int base_reg, int index_reg, int src_reg)
 {
-    if ((src_reg & 8) || (base_reg & 8) | (index_reg & 8))
-        fatal("host_x86_MOV8_BASE_INDEX_REG reg & 8\n");
-    codegen_alloc_bytes(block, 3);
-    codegen_addbyte3(block, 0x89, 0x04 | (src_reg << 3), (index_reg << 3) | base_reg); /*MOV L[base_reg + index_reg], src_reg*/
+    int rex = ((src_reg & 8) ? 4 : 0) | ((index_reg & 8) ? 2 : 0) | ((base_reg & 8) ? 1 : 0);
+
+    if ((base_reg & 7) == REG_EBP)
+        fatal("host_x86_MOV32_BASE_INDEX_REG - bad base_reg\n");
+    if (rex) {
+        codegen_alloc_bytes(block, 4);
+        codegen_addbyte4(block, 0x40 | rex, 0x89, 0x04 | ((src_reg & 7) << 3), ((index_reg & 7) << 3) | (base_reg & 7)); /*MOV L[base_reg + index_reg], src_reg*/
+    } else {
+        codegen_alloc_bytes(block, 3);
+        codegen_addbyte3(block, 0x89, 0x04 | (src_reg << 3), (index_reg << 3) | base_reg); /*MOV L[base_reg + index_reg], src_reg*/
+    }
+}
+void
+host_x86_MOV64_BASE_INDEX_REG(codeblock_t *block, int base_reg, int index_reg, int src_reg)
+{
+    int rex = ((src_reg & 8) ? 4 : 0) | ((index_reg & 8) ? 2 : 0) | ((base_reg & 8) ? 1 : 0);
+
+    if ((base_reg & 7) == REG_EBP)
+        fatal("host_x86_MOV64_BASE_INDEX_REG - bad base_reg\n");
+    codegen_alloc_bytes(block, 4);
+    codegen_addbyte4(block, 0x48 | rex, 0x89, 0x04 | ((src_reg & 7) << 3), ((index_reg & 7) << 3) | (base_reg & 7)); /*MOV Q[base_reg + index_reg], src_reg*/
 }
 
 void
@@ -807,13 +839,12 @@ host_x86_MOV32_REG_BASE_INDEX(codeblock_t *block, int dst_reg, int base_reg, int
 void
 host_x86_MOV64_REG_BASE_INDEX_SHIFT(codeblock_t *block, int dst_reg, int base_reg, int index_reg, int scale)
 {
-    if ((dst_reg & 8) || (index_reg & 8))
-        fatal("host_x86_MOV64_REG_BASE_INDEX_SHIFT reg & 8\n");
+    int rex = ((dst_reg & 8) ? 4 : 0) | ((index_reg & 8) ? 2 : 0) | ((base_reg & 8) ? 1 : 0);
+
+    if ((base_reg & 7) == REG_EBP)
+        fatal("host_x86_MOV64_REG_BASE_INDEX_SHIFT - bad base_reg\n");
     codegen_alloc_bytes(block, 4);
-    if (base_reg & 8)
-        codegen_addbyte4(block, 0x49, 0x8b, 0x04 | ((dst_reg & 7) << 3), (scale << 6) | ((index_reg & 7) << 3) | (base_reg & 7)); /*MOV dst_reg, Q[base_reg + index_reg << scale]*/
-    else
-        codegen_addbyte4(block, 0x48, 0x8b, 0x04 | ((dst_reg & 7) << 3), (scale << 6) | ((index_reg & 7) << 3) | (base_reg & 7)); /*MOV dst_reg, Q[base_reg + index_reg << scale]*/
+    codegen_addbyte4(block, 0x48 | rex, 0x8b, 0x04 | ((dst_reg & 7) << 3), (scale << 6) | ((index_reg & 7) << 3) | (base_reg & 7)); /*MOV dst_reg, Q[base_reg + index_reg << scale]*/
 }
 
 void
@@ -967,6 +998,15 @@ host_x86_MOV64_REG_IMM(codeblock_t *block, int reg, uint64_t imm_data)
     }
 }
 
+void
+host_x86_MOV64_REG_REG(codeblock_t *block, int dst_reg, int src_reg)
+{
+    int rex = ((src_reg & 8) ? 4 : 0) | ((dst_reg & 8) ? 1 : 0);
+
+    codegen_alloc_bytes(block, 3);
+    codegen_addbyte3(block, 0x48 | rex, 0x89, 0xc0 | ((src_reg & 7) << 3) | (dst_reg & 7)); /*MOV dst_reg, src_reg*/
+}
+
 void
 host_x86_MOV8_REG_REG(codeblock_t *block, int dst_reg, int src_reg)
 {
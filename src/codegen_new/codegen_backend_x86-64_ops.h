@@ -24,6 +24,7 @@ void host_x86_CMP64_REG_IMM(codeblock_t *block, int dst_reg, uint64_t imm_data);
 void host_x86_CMP8_REG_REG(codeblock_t *block, int src_reg_a, int src_reg_b);
 void host_x86_CMP16_REG_REG(codeblock_t *block, int src_reg_a, int src_reg_b);
 void host_x86_CMP32_REG_REG(codeblock_t *block, int src_reg_a, int src_reg_b);
+void host_x86_CMP32_REG_BASE_INDEX(codeblock_t *block, int src_reg, int base_reg, int index_reg);
 
 void host_x86_JMP(codeblock_t *block, void *p);
 
@@ -69,6 +70,7 @@ void host_x86_MOV8_ABS_REG_REG_SHIFT_REG(codeblock_t *block, uint32_t addr, int
 void host_x86_MOV8_BASE_INDEX_REG(codeblock_t *block, int dst_reg, int base_reg, int index_reg);
 void host_x86_MOV16_BASE_INDEX_REG(codeblock_t *block, int dst_reg, int base_reg, int index_reg);
 void host_x86_MOV32_BASE_INDEX_REG(codeblock_t *block, int dst_reg, int base_reg, int index_reg);
+void host_x86_MOV64_BASE_INDEX_REG(codeblock_t *block, int base_reg, int index_reg, int src_reg);
 
 void host_x86_MOV32_BASE_OFFSET_REG(codeblock_t *block, int base_reg, int offset, int src_reg);
 void host_x86_MOV64_BASE_OFFSET_REG(codeblock_t *block, int base_reg, int offset, int src_reg);
@@ -99,6 +101,7 @@ void host_x86_MOV64_REG_IMM(codeblock_t *block, int reg, uint64_t imm_data);
 void host_x86_MOV8_REG_REG(codeblock_t *block, int dst_reg, int src_reg);
 void host_x86_MOV16_REG_REG(codeblock_t *block, int dst_reg, int src_reg);
 void host_x86_MOV32_REG_REG(codeblock_t *block, int dst_reg, int src_reg);
+void host_x86_MOV64_REG_REG(codeblock_t *block, int dst_reg, int src_reg);
 
 void host_x86_MOV32_STACK_IMM(codeblock_t *block, int32_t offset, uint32_t imm_data);
 
@@ -1,4 +1,6 @@
 #include <inttypes.h>
+#include <setjmp.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,6 +8,10 @@
 #include "cpu.h"
 #include <86box/mem.h>
 #include <86box/plat_unused.h>
+#include <86box/thread.h>
+#if defined(__APPLE__) && defined(__aarch64__)
+#    include <pthread.h>
+#endif
 
 #include "x86.h"
 #include "x86_flags.h"
@@ -22,6 +28,7 @@
 #include "codegen_allocator.h"
 #include "codegen_backend.h"
 #include "codegen_ir.h"
+#include "codegen_public.h"
 #include "codegen_reg.h"
 
 uint8_t *block_write_data = NULL;
@@ -40,13 +47,23 @@ uint32_t op_old_pc;
 uint32_t recomp_page = -1;
 
 int        block_current = 0;
-static int block_num;
 int        block_pos;
 
 uint32_t codegen_endpc;
 
 int        codegen_block_cycles;
+uint64_t   codegen_chain_hits;
+uint64_t   codegen_hash_hits;
+uint64_t   codegen_hash_misses;
+uint64_t   codegen_hash_collisions;
+uint64_t   codegen_hash_evictions;
+uint64_t   codegen_block_evictions;
+uint64_t   codegen_evict_recompiles;
+uint64_t   codegen_async_failures;
 static int codegen_block_ins;
+
+codegen_stats_t        codegen_stats_sec;
+static codegen_stats_t codegen_stats_last;
 static int codegen_block_full_ins;
 
 static uint32_t last_op32;
@@ -58,9 +75,124 @@ uint32_t instr_counts[256 * 256];
 #endif
 
 static uint16_t block_free_list;
+static int      evict_hand;
+/*Physical addresses of recently evicted blocks, indexed by HASH(), used to
+  count blocks that come back after eviction*/
+static uint32_t evict_ghost[HASH_SIZE];
 static void     delete_block(codeblock_t *block);
 static void     delete_dirty_block(codeblock_t *block);
 
+int codegen_async = 0;
+
+enum {
+    ASYNC_IDLE = 0,
+    ASYNC_COMPILING,
+    ASYNC_DONE,
+    ASYNC_FAILED,
+    ASYNC_STOP
+};
+
+CODEGEN_THREAD_LOCAL int codegen_async_worker = 0;
+
+static atomic_int async_state;
+static int        async_block_nr = BLOCK_INVALID;
+static event_t   *async_wake_event;
+static event_t   *async_done_event;
+static thread_t  *async_thread;
+static jmp_buf    async_abort_jmp;
+static ir_data_t *ir_data;
+
+/*Runs the backend for the block handed over by codegen_block_end_recompile().
+  The CPU thread does not touch ir_data, the register allocator or the block's
+  code while the state is ASYNC_COMPILING, and has reserved mem blocks for the
+  backend. The reserve is an estimate; if the backend needs more, the compile
+  is abandoned through codegen_async_abort() rather than evicting here.*/
+static void
+codegen_async_thread(UNUSED(void *param))
+{
+    int state;
+
+    codegen_async_worker = 1;
+
+    while (1) {
+        thread_wait_event(async_wake_event, -1);
+        thread_reset_event(async_wake_event);
+
+        if (atomic_load(&async_state) == ASYNC_STOP)
+            break;
+        if (atomic_load(&async_state) != ASYNC_COMPILING)
+            continue;
+
+#if defined(__APPLE__) && defined(__aarch64__)
+        if (__builtin_available(macOS 11.0, *)) {
+            pthread_jit_write_protect_np(0);
+        }
+#endif
+        if (!setjmp(async_abort_jmp)) {
+            codegen_ir_compile(ir_data, &codeblock[async_block_nr]);
+            state = ASYNC_DONE;
+        } else {
+            block_write_data = NULL;
+            state            = ASYNC_FAILED;
+        }
+#if defined(__APPLE__) && defined(__aarch64__)
+        if (__builtin_available(macOS 11.0, *)) {
+            pthread_jit_write_protect_np(1);
+        }
+#endif
+
+        atomic_store(&async_state, state);
+        thread_set_event(async_done_event);
+    }
+}
+
+void
+codegen_async_abort(void)
+{
+    longjmp(async_abort_jmp, 1);
+}
+
+/*Publish a block the worker has finished. Called on the CPU thread*/
+void
+codegen_async_poll(void)
+{
+    int state = atomic_load(&async_state);
+
+    if (state == ASYNC_DONE) {
+        codeblock[async_block_nr].flags &= ~CODEBLOCK_COMPILING;
+        async_block_nr = BLOCK_INVALID;
+        atomic_store(&async_state, ASYNC_IDLE);
+    } else if (state == ASYNC_FAILED) {
+        codeblock_t *block = &codeblock[async_block_nr];
+
+        /*The worker ran out of code memory. Throw away the partial code; the
+          block is recompiled on the CPU thread, where it can evict, the next
+          time it is run*/
+        codegen_async_failures++;
+        codegen_allocator_free(block->head_mem_block);
+        block->head_mem_block = NULL;
+        block->flags &= ~(CODEBLOCK_COMPILING | CODEBLOCK_WAS_RECOMPILED);
+        block->flags |= CODEBLOCK_NO_ASYNC;
+        async_block_nr = BLOCK_INVALID;
+        atomic_store(&async_state, ASYNC_IDLE);
+    }
+}
+
+int
+codegen_async_busy(void)
+{
+    return atomic_load(&async_state) != ASYNC_IDLE;
+}
+
+/*Wait for the block in flight, if any, before it is modified or freed*/
+static void
+codegen_async_wait(void)
+{
+    while (atomic_load(&async_state) == ASYNC_COMPILING)
+        thread_wait_event(async_done_event, -1);
+    codegen_async_poll();
+}
+
 /*Temporary list of code blocks that have recently been evicted. This allows for
   some historical state to be kept when a block is the target of self-modifying
   code.
@@ -204,7 +336,7 @@ block_free_list_get(void)
         }
         /*Free list is empty - free up a block*/
         if (!codegen_purge_purgable_list())
-            codegen_delete_random_block(0);
+            codegen_evict_block(0);
     }
 
     block           = &codeblock[block_free_list];
@@ -217,17 +349,95 @@ block_free_list_get(void)
 void
 codegen_init(void)
 {
+    /*Pool size must be a power of two, and there is no point in having more
+      blocks than there is memory to put code in*/
+    codegen_block_nr = BLOCK_SIZE;
+    while ((codegen_block_nr < cpu_dynarec_blocks) && (codegen_block_nr < 0x10000) && (codegen_block_nr < MEM_BLOCK_NR))
+        codegen_block_nr <<= 1;
+
+    memset(evict_ghost, 0xff, sizeof(evict_ghost));
+    evict_hand = 0;
+
+    codegen_async = cpu_dynarec_async;
     codegen_allocator_init();
 
     codegen_backend_init();
     block_free_list = 0;
-    for (uint32_t c = 0; c < BLOCK_SIZE; c++)
+    for (int c = 0; c < codegen_block_nr; c++)
         block_free_list_add(&codeblock[c]);
     block_dirty_list_head = block_dirty_list_tail = 0;
     dirty_list_size                               = 0;
 #ifdef DEBUG_EXTRA
     memset(instr_counts, 0, sizeof(instr_counts));
 #endif
+
+    if (codegen_async) {
+        atomic_init(&async_state, ASYNC_IDLE);
+        async_wake_event = thread_create_event();
+        async_done_event = thread_create_event();
+        async_thread     = thread_create(codegen_async_thread, NULL);
+    }
+}
+
+static void
+codegen_stats_get(codegen_stats_t *stats)
+{
+    stats->hash_hits        = codegen_hash_hits;
+    stats->hash_misses      = codegen_hash_misses;
+    stats->hash_collisions  = codegen_hash_collisions;
+    stats->hash_evictions   = codegen_hash_evictions;
+    stats->block_evictions  = codegen_block_evictions;
+    stats->chain_hits       = codegen_chain_hits;
+    stats->evict_recompiles = codegen_evict_recompiles;
+    stats->async_failures   = codegen_async_failures;
+}
+
+/*Called once per second to sample the block lookup, chaining and eviction
+  statistics into codegen_stats_sec*/
+void
+codegen_stats_update(void)
+{
+    codegen_stats_t stats;
+
+    codegen_stats_get(&stats);
+
+    codegen_stats_sec.hash_hits        = stats.hash_hits - codegen_stats_last.hash_hits;
+    codegen_stats_sec.hash_misses      = stats.hash_misses - codegen_stats_last.hash_misses;
+    codegen_stats_sec.hash_collisions  = stats.hash_collisions - codegen_stats_last.hash_collisions;
+    codegen_stats_sec.hash_evictions   = stats.hash_evictions - codegen_stats_last.hash_evictions;
+    codegen_stats_sec.block_evictions  = stats.block_evictions - codegen_stats_last.block_evictions;
+    codegen_stats_sec.chain_hits       = stats.chain_hits - codegen_stats_last.chain_hits;
+    codegen_stats_sec.evict_recompiles = stats.evict_recompiles - codegen_stats_last.evict_recompiles;
+    codegen_stats_sec.async_failures   = stats.async_failures - codegen_stats_last.async_failures;
+
+    codegen_stats_last = stats;
+}
+
+/*Finish the block in flight and stop the worker thread*/
+void
+codegen_close(void)
+{
+    if (codegen_hash_hits || codegen_hash_misses)
+        pclog("Dynarec: %" PRIu64 " block lookup hits, %" PRIu64 " misses, %" PRIu64 " tag collisions, "
+              "%" PRIu64 " hash set evictions, %" PRIu64 " blocks evicted, %" PRIu64 " chained block entries, "
+              "%" PRIu64 " evicted blocks recompiled, %" PRIu64 " background compiles failed\n",
+              codegen_hash_hits, codegen_hash_misses, codegen_hash_collisions,
+              codegen_hash_evictions, codegen_block_evictions, codegen_chain_hits,
+              codegen_evict_recompiles, codegen_async_failures);
+
+    if (async_thread == NULL)
+        return;
+
+    codegen_async_wait();
+    atomic_store(&async_state, ASYNC_STOP);
+    thread_set_event(async_wake_event);
+    thread_wait(async_thread);
+    async_thread = NULL;
+
+    thread_destroy_event(async_done_event);
+    thread_destroy_event(async_wake_event);
+
+    codegen_allocator_close();
 }
 
 void
@@ -235,7 +445,10 @@ codegen_reset(void)
 {
     int c;
 
-    for (c = 1; c < BLOCK_SIZE; c++) {
+    if (codegen_async)
+        codegen_async_wait();
+
+    for (c = 1; c < codegen_block_nr; c++) {
         codeblock_t *block = &codeblock[c];
 
         if (block->pc != BLOCK_PC_INVALID) {
@@ -245,12 +458,12 @@ codegen_reset(void)
         }
     }
 
-    memset(codeblock, 0, BLOCK_SIZE * sizeof(codeblock_t));
-    memset(codeblock_hash, 0, HASH_SIZE * sizeof(uint16_t));
+    memset(codeblock, 0, codegen_block_nr * sizeof(codeblock_t));
+    memset(codeblock_hash, 0, HASH_SIZE * sizeof(codeblock_hash_set_t));
     mem_reset_page_blocks();
 
     block_free_list = 0;
-    for (c = 0; c < BLOCK_SIZE; c++) {
+    for (c = 0; c < codegen_block_nr; c++) {
         codeblock[c].pc = BLOCK_PC_INVALID;
         block_free_list_add(&codeblock[c]);
     }
@@ -376,8 +589,12 @@ invalidate_block(codeblock_t *block)
     if (block->pc == BLOCK_PC_INVALID)
         fatal("Invalidating deleted block\n");
 #endif
+    if (get_block_nr(block) == async_block_nr)
+        codegen_async_wait();
+
     remove_from_block_list(block, old_pc);
     block_dirty_list_add(block);
+    codeblock_unlink(block);
     if (block->head_mem_block)
         codegen_allocator_free(block->head_mem_block);
     block->head_mem_block = NULL;
@@ -388,8 +605,10 @@ delete_block(codeblock_t *block)
 {
     uint32_t old_pc = block->pc;
 
-    if (block == &codeblock[codeblock_hash[HASH(block->phys)]])
-        codeblock_hash[HASH(block->phys)] = BLOCK_INVALID;
+    if (get_block_nr(block) == async_block_nr)
+        codegen_async_wait();
+
+    codeblock_hash_remove(block);
 
 #ifndef RELEASE_BUILD
     if (block->pc == BLOCK_PC_INVALID)
@@ -398,6 +617,7 @@ delete_block(codeblock_t *block)
     block->pc = BLOCK_PC_INVALID;
 
     codeblock_tree_delete(block);
+    codeblock_unlink(block);
     if (block->flags & CODEBLOCK_IN_DIRTY_LIST)
         block_dirty_list_remove(block);
     else
@@ -411,8 +631,7 @@ delete_block(codeblock_t *block)
 static void
 delete_dirty_block(codeblock_t *block)
 {
-    if (block == &codeblock[codeblock_hash[HASH(block->phys)]])
-        codeblock_hash[HASH(block->phys)] = BLOCK_INVALID;
+    codeblock_hash_remove(block);
 
 #ifndef RELEASE_BUILD
     if (block->pc == BLOCK_PC_INVALID)
@@ -421,6 +640,7 @@ delete_dirty_block(codeblock_t *block)
     block->pc = BLOCK_PC_INVALID;
 
     codeblock_tree_delete(block);
+    codeblock_unlink(block);
     block_free_list_add(block);
 }
 
@@ -431,21 +651,30 @@ codegen_delete_block(codeblock_t *block)
         delete_block(block);
 }
 
+/*Free up a block using the clock algorithm. The hand sweeps the block pool
+  from where it last stopped; blocks that have run since the hand last
+  passed have their referenced bit cleared and are skipped, the first one
+  that has not is deleted.*/
 void
-codegen_delete_random_block(int required_mem_block)
+codegen_evict_block(int required_mem_block)
 {
-    int block_nr = rand() & BLOCK_MASK;
-
     while (1) {
-        if (block_nr && block_nr != block_current) {
-            codeblock_t *block = &codeblock[block_nr];
+        evict_hand = (evict_hand + 1) & (codegen_block_nr - 1);
+
+        if (evict_hand && evict_hand != block_current && evict_hand != async_block_nr) {
+            codeblock_t *block = &codeblock[evict_hand];
 
             if (block->pc != BLOCK_PC_INVALID && (!required_mem_block || block->head_mem_block)) {
-                delete_block(block);
-                return;
+                if (block->flags & CODEBLOCK_REFERENCED)
+                    block->flags &= ~CODEBLOCK_REFERENCED;
+                else {
+                    codegen_block_evictions++;
+                    evict_ghost[HASH(block->phys)] = block->phys;
+                    delete_block(block);
+                    return;
+                }
             }
         }
-        block_nr = (block_nr + 1) & BLOCK_MASK;
     }
 }
 
@@ -515,9 +744,6 @@ codegen_block_init(uint32_t phys_addr)
 #endif
     block_current = get_block_nr(block);
 
-    block_num                 = HASH(phys_addr);
-    codeblock_hash[block_num] = block_current;
-
     block->ins         = 0;
     block->pc          = cs + cpu_state.pc;
     block->_cs         = cs;
@@ -527,14 +753,19 @@ codegen_block_init(uint32_t phys_addr)
     block->next = block->prev = BLOCK_INVALID;
     block->next_2 = block->prev_2 = BLOCK_INVALID;
     block->page_mask = block->page_mask2 = 0;
-    block->flags                         = CODEBLOCK_STATIC_TOP;
+    block->flags                         = CODEBLOCK_STATIC_TOP | CODEBLOCK_REFERENCED;
     block->status                        = cpu_cur_status;
+    codeblock_unlink(block);
 
     recomp_page = block->phys & ~0xfff;
     codeblock_tree_add(block);
-}
+    codeblock_hash_add(block);
 
-static ir_data_t *ir_data;
+    if (evict_ghost[HASH(phys_addr)] == phys_addr) {
+        codegen_evict_recompiles++;
+        evict_ghost[HASH(phys_addr)] = 0xffffffff;
+    }
+}
 
 ir_data_t *
 codegen_get_ir_data(void)
@@ -550,7 +781,6 @@ codegen_block_start_recompile(codeblock_t *block)
     if (!page->block)
         mem_flush_write_page(block->phys, cs + cpu_state.pc);
 
-    block_num     = HASH(block->phys);
     block_current = get_block_nr(block); // block->pnt;
 
 #ifndef RELEASE_BUILD
@@ -775,7 +1005,21 @@ codegen_block_end_recompile(codeblock_t *block)
         block->flags &= ~CODEBLOCK_STATIC_TOP;
 
     codegen_accumulate_flush(ir_data);
-    codegen_ir_compile(ir_data, block);
+
+    if (codegen_async && !(block->flags & CODEBLOCK_NO_ASYNC)) {
+        /*Reserve a generous estimate of the backend output, so the worker
+          rarely runs out of code memory*/
+        int reserve = ((ir_data->wr_pos * 256) / MEM_BLOCK_SIZE) + 2;
+
+        codegen_allocator_reserve((reserve > (MEM_BLOCK_NR / 2)) ? (MEM_BLOCK_NR / 2) : reserve);
+
+        block->flags |= CODEBLOCK_COMPILING;
+        async_block_nr = block_current;
+        thread_reset_event(async_done_event);
+        atomic_store(&async_state, ASYNC_COMPILING);
+        thread_set_event(async_wake_event);
+    } else
+        codegen_ir_compile(ir_data, block);
 }
 
 void
@@ -1,6 +1,12 @@
 #include "codegen_ir_defs.h"
 
+/*Bits of cpu_dynarec_ir_disable, each of which turns off one optimisation pass*/
+#define IR_OPT_CONST      (1 << 0) /*Constant folding and propagation*/
+#define IR_OPT_DEAD_FLAGS (1 << 1) /*Dead flags operand elimination*/
+#define IR_OPT_STORES     (1 << 2) /*Redundant register store elimination*/
+
 ir_data_t *codegen_ir_init(void);
 
 void codegen_ir_set_unroll(int count, int start, int first_instruction);
 void codegen_ir_compile(ir_data_t *ir, codeblock_t *block);
+void codegen_ir_optimise(ir_data_t *ir);
@@ -0,0 +1,464 @@
+/*IR optimisation passes. These run on a block's uOPs after the dead register
+  list has been processed and before host code is generated.
+
+  Register versions are only exact between barriers. A full barrier may call a
+  function that changes any emulated register in memory, and a jump destination
+  merges in a path that skipped the uOPs before it, so values known before
+  either are forgotten. A register version is live if it is the current
+  version at a barrier or at the end of the block, as it is then written back
+  to the emulated CPU state.
+
+  - Constant folding and propagation replaces uOPs whose sources are known
+    constants with UOP_MOV_IMM, or with the immediate form of the uOP.
+  - Dead flags elimination treats flags_op1 and flags_op2 as live only at
+    barriers where flags_op may be a flags type that reads them.
+  - Redundant store elimination removes a UOP_MOV_IMM that writes the value
+    the previous version of the register has already written back.
+
+  Each pass can be turned off with cpu_dynarec_ir_disable.*/
+#include <stdint.h>
+#include <string.h>
+#include <86box/86box.h>
+#include "cpu.h"
+#include <86box/mem.h>
+
+#include "x86.h"
+#include "x86_flags.h"
+#include "codegen.h"
+#include "codegen_ir.h"
+#include "codegen_reg.h"
+
+/*Register version was current at a barrier*/
+static uint8_t reg_live[IREG_COUNT][256 / 8];
+/*flags_op1/op2 version was current at a barrier that may evaluate flags*/
+static uint8_t reg_flags_live[2][256 / 8];
+static int     use_flags_live;
+
+static uint8_t  jump_dest[UOP_NR_MAX + 1];
+/*Jump destinations at or before each uOP*/
+static uint16_t dest_count[UOP_NR_MAX + 1];
+/*Barriers that may change emulated registers before each uOP*/
+static uint16_t clobber_count[UOP_NR_MAX + 1];
+
+#define VERSION_SET(map, version)  map[(version) >> 3] |= (1 << ((version) &7))
+#define VERSION_TEST(map, version) (map[(version) >> 3] & (1 << ((version) &7)))
+
+static int
+is_const_reg(ir_reg_t ir_reg)
+{
+    return !ir_reg_is_invalid(ir_reg) && IREG_GET_SIZE(ir_reg.reg) == IREG_SIZE_L && reg_is_native_size(ir_reg);
+}
+
+/*Return whether ir_reg holds a constant that was set at or after uOP reset*/
+static int
+get_const(ir_data_t *ir, ir_reg_t ir_reg, int reset, uint32_t *val)
+{
+    const reg_version_t *regv;
+    const uop_t         *uop;
+
+    if (!is_const_reg(ir_reg) || !ir_reg.version)
+        return 0;
+
+    regv = &reg_version[IREG_GET_REG(ir_reg.reg)][ir_reg.version];
+    if ((regv->flags & REG_FLAGS_DEAD) || regv->parent_uop < reset)
+        return 0;
+
+    uop = &ir->uops[regv->parent_uop];
+    if ((uop->type & UOP_MASK) != (UOP_MOV_IMM & UOP_MASK) || !is_const_reg(uop->dest_reg_a))
+        return 0;
+
+    *val = uop->imm_data;
+    return 1;
+}
+
+/*Barriers that can not change emulated registers*/
+static int
+is_benign_barrier(const uop_t *uop)
+{
+    switch (uop->type & UOP_MASK) {
+        case (UOP_NOP_BARRIER & UOP_MASK):
+        case (UOP_LOAD_FUNC_ARG_0_IMM & UOP_MASK):
+        case (UOP_LOAD_FUNC_ARG_1_IMM & UOP_MASK):
+        case (UOP_LOAD_FUNC_ARG_2_IMM & UOP_MASK):
+        case (UOP_LOAD_FUNC_ARG_3_IMM & UOP_MASK):
+        case (UOP_FP_ENTER & UOP_MASK):
+        case (UOP_MMX_ENTER & UOP_MASK):
+            return 1;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+/*Return whether flags_op_version is known not to need flags_op1/op2*/
+static int
+flags_ops_unused(ir_data_t *ir, int flags_op_version, int reset)
+{
+    uint32_t flags_op;
+
+    if (!get_const(ir, (ir_reg_t) { IREG_flags_op, flags_op_version }, reset, &flags_op))
+        return 0;
+
+    switch (flags_op) {
+        case FLAGS_UNKNOWN:
+        case FLAGS_ZN8:
+        case FLAGS_ZN16:
+        case FLAGS_ZN32:
+            return 1;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+/*Mark the version of reg that was current before uOP c as live if there has
+  been a barrier since it was written. Versions that have been optimised out
+  were never written, so their predecessor stays current.*/
+static void
+mark_live(int reg, int version, int last_barrier, int last_flags_barrier)
+{
+    int parent;
+
+    while (version > 0 && (reg_version[reg][version].flags & REG_FLAGS_DEAD))
+        version--;
+    if (!version)
+        return;
+
+    parent = reg_version[reg][version].parent_uop;
+    if (last_barrier > parent)
+        VERSION_SET(reg_live[reg], version);
+    if ((reg == IREG_flags_op1 || reg == IREG_flags_op2) && last_flags_barrier > parent)
+        VERSION_SET(reg_flags_live[reg - IREG_flags_op1], version);
+}
+
+static void
+scan_block(ir_data_t *ir)
+{
+    int last_barrier       = -1;
+    int last_flags_barrier = -1;
+    int flags_op_version   = 0;
+    int reset              = 0;
+    int dests              = 0;
+    int clobbers           = 0;
+    int c;
+
+    memset(reg_live, 0, sizeof(reg_live));
+    memset(reg_flags_live, 0, sizeof(reg_flags_live));
+    memset(jump_dest, 0, ir->wr_pos + 1);
+
+    for (c = 0; c < ir->wr_pos; c++) {
+        const uop_t *uop = &ir->uops[c];
+
+        if ((uop->type & UOP_TYPE_JUMP) && uop->jump_dest_uop != -1)
+            jump_dest[uop->jump_dest_uop] = 1;
+    }
+
+    for (c = 0; c < ir->wr_pos; c++) {
+        const uop_t *uop = &ir->uops[c];
+
+        if (jump_dest[c]) {
+            dests++;
+            reset = c;
+        }
+        dest_count[c]    = dests;
+        clobber_count[c] = clobbers;
+
+        if ((uop->type & UOP_MASK) == UOP_INVALID)
+            continue;
+
+        if (uop->type & (UOP_TYPE_BARRIER | UOP_TYPE_ORDER_BARRIER)) {
+            last_barrier = c;
+            if (!flags_ops_unused(ir, flags_op_version, reset))
+                last_flags_barrier = c;
+        }
+        if (uop->type & UOP_TYPE_BARRIER) {
+            if (!is_benign_barrier(uop))
+                clobbers++;
+            reset = c + 1;
+        }
+
+        if (!ir_reg_is_invalid(uop->dest_reg_a)) {
+            int reg = IREG_GET_REG(uop->dest_reg_a.reg);
+
+            mark_live(reg, uop->dest_reg_a.version - 1, last_barrier, last_flags_barrier);
+            if (reg == IREG_flags_op)
+                flags_op_version = uop->dest_reg_a.version;
+        }
+    }
+
+    dest_count[c]    = dests;
+    clobber_count[c] = clobbers;
+
+    /*The end of the block writes back all registers*/
+    last_barrier = c;
+    if (!flags_ops_unused(ir, flags_op_version, reset))
+        last_flags_barrier = c;
+    for (int reg = 0; reg < IREG_COUNT; reg++)
+        mark_live(reg, reg_last_version[reg], last_barrier, last_flags_barrier);
+}
+
+static int
+version_is_dead(ir_data_t *ir, int reg, int version)
+{
+    const reg_version_t *regv = &reg_version[reg][version];
+    const uop_t         *uop  = &ir->uops[regv->parent_uop];
+
+    if (!version || regv->refcount || (regv->flags & REG_FLAGS_DEAD))
+        return 0;
+    if ((uop->type & UOP_MASK) == UOP_INVALID || (uop->type & (UOP_TYPE_BARRIER | UOP_TYPE_ORDER_BARRIER)))
+        return 0;
+    /*Non-native size writes have an implicit dependency on the previous version*/
+    if (version < reg_last_version[reg] && !reg_is_native_size(ir->uops[reg_version[reg][version + 1].parent_uop].dest_reg_a))
+        return 0;
+
+    if (reg_is_volatile(reg))
+        return 1;
+    if (reg <= IREG_EBX || version == reg_last_version[reg])
+        return 0;
+    if (use_flags_live && (reg == IREG_flags_op1 || reg == IREG_flags_op2))
+        return !VERSION_TEST(reg_flags_live[reg - IREG_flags_op1], version);
+    return !VERSION_TEST(reg_live[reg], version);
+}
+
+static void kill_version(ir_data_t *ir, int reg, int version);
+
+static void
+release_reg(ir_data_t *ir, ir_reg_t ir_reg)
+{
+    int reg = IREG_GET_REG(ir_reg.reg);
+
+    if (ir_reg_is_invalid(ir_reg))
+        return;
+
+    reg_version[reg][ir_reg.version].refcount--;
+    if (version_is_dead(ir, reg, ir_reg.version))
+        kill_version(ir, reg, ir_reg.version);
+}
+
+static void
+kill_version(ir_data_t *ir, int reg, int version)
+{
+    reg_version_t *regv = &reg_version[reg][version];
+    uop_t         *uop  = &ir->uops[regv->parent_uop];
+
+    uop->type = UOP_INVALID;
+    regv->flags |= REG_FLAGS_DEAD;
+    release_reg(ir, uop->src_reg_a);
+    release_reg(ir, uop->src_reg_b);
+    release_reg(ir, uop->src_reg_c);
+}
+
+static void
+set_mov_imm(ir_data_t *ir, uop_t *uop, uint32_t imm_data)
+{
+    ir_reg_t src_reg_a = uop->src_reg_a;
+    ir_reg_t src_reg_b = uop->src_reg_b;
+
+    uop->type      = UOP_MOV_IMM;
+    uop->imm_data  = imm_data;
+    uop->src_reg_a = invalid_ir_reg;
+    uop->src_reg_b = invalid_ir_reg;
+    release_reg(ir, src_reg_a);
+    release_reg(ir, src_reg_b);
+}
+
+/*Replace dest = a op b with dest = a op imm_data, swapping the sources first
+  for commutative ops where a is the constant*/
+static void
+set_op_imm(ir_data_t *ir, uop_t *uop, uint32_t type, uint32_t imm_data, int swap)
+{
+    ir_reg_t src_reg = swap ? uop->src_reg_a : uop->src_reg_b;
+
+    if (swap)
+        uop->src_reg_a = uop->src_reg_b;
+    uop->type      = type;
+    uop->imm_data  = imm_data;
+    uop->src_reg_b = invalid_ir_reg;
+    release_reg(ir, src_reg);
+}
+
+static void
+fold_constants(ir_data_t *ir)
+{
+    int reset = 0;
+
+    for (int c = 0; c < ir->wr_pos; c++) {
+        uop_t   *uop = &ir->uops[c];
+        uint32_t a;
+        uint32_t b;
+        int      a_const;
+        int      b_const;
+        int      regs_l;
+        int      in_place;
+
+        if (jump_dest[c])
+            reset = c;
+        if (uop->type & UOP_TYPE_BARRIER) {
+            reset = c + 1;
+            continue;
+        }
+        if ((uop->type & (UOP_TYPE_ORDER_BARRIER | UOP_TYPE_JUMP)) || (uop->type & UOP_MASK) == UOP_INVALID || !is_const_reg(uop->dest_reg_a))
+            continue;
+
+        a_const = get_const(ir, uop->src_reg_a, reset, &a);
+        b_const = get_const(ir, uop->src_reg_b, reset, &b);
+        if (!a_const && !b_const)
+            continue;
+        regs_l = !ir_reg_is_invalid(uop->src_reg_a) && !ir_reg_is_invalid(uop->src_reg_b) && IREG_GET_SIZE(uop->src_reg_a.reg) == IREG_SIZE_L && IREG_GET_SIZE(uop->src_reg_b.reg) == IREG_SIZE_L;
+        /*The x86 backend can only do logic ops with an immediate in place*/
+        in_place = regs_l && IREG_GET_REG(a_const ? uop->src_reg_b.reg : uop->src_reg_a.reg) == IREG_GET_REG(uop->dest_reg_a.reg);
+
+        switch (uop->type & UOP_MASK) {
+            case (UOP_MOV & UOP_MASK):
+                if (a_const)
+                    set_mov_imm(ir, uop, a);
+                break;
+
+            case (UOP_ADD_IMM & UOP_MASK):
+                if (a_const)
+                    set_mov_imm(ir, uop, a + uop->imm_data);
+                break;
+            case (UOP_SUB_IMM & UOP_MASK):
+                if (a_const)
+                    set_mov_imm(ir, uop, a - uop->imm_data);
+                break;
+            case (UOP_AND_IMM & UOP_MASK):
+                if (a_const)
+                    set_mov_imm(ir, uop, a & uop->imm_data);
+                break;
+            case (UOP_OR_IMM & UOP_MASK):
+                if (a_const)
+                    set_mov_imm(ir, uop, a | uop->imm_data);
+                break;
+            case (UOP_XOR_IMM & UOP_MASK):
+                if (a_const)
+                    set_mov_imm(ir, uop, a ^ uop->imm_data);
+                break;
+            case (UOP_SHL_IMM & UOP_MASK):
+                if (a_const && uop->imm_data < 32)
+                    set_mov_imm(ir, uop, a << uop->imm_data);
+                break;
+            case (UOP_SHR_IMM & UOP_MASK):
+                if (a_const && uop->imm_data < 32)
+                    set_mov_imm(ir, uop, a >> uop->imm_data);
+                break;
+            case (UOP_SAR_IMM & UOP_MASK):
+                if (a_const && uop->imm_data < 32)
+                    set_mov_imm(ir, uop, (uint32_t) ((int32_t) a >> uop->imm_data));
+                break;
+
+            case (UOP_ADD & UOP_MASK):
+                if (a_const && b_const)
+                    set_mov_imm(ir, uop, a + b);
+                else if (regs_l)
+                    set_op_imm(ir, uop, UOP_ADD_IMM, a_const ? a : b, a_const);
+                break;
+            case (UOP_SUB & UOP_MASK):
+                if (a_const && b_const)
+                    set_mov_imm(ir, uop, a - b);
+                else if (b_const && regs_l)
+                    set_op_imm(ir, uop, UOP_SUB_IMM, b, 0);
+                break;
+            case (UOP_AND & UOP_MASK):
+                if (a_const && b_const)
+                    set_mov_imm(ir, uop, a & b);
+                else if (in_place)
+                    set_op_imm(ir, uop, UOP_AND_IMM, a_const ? a : b, a_const);
+                break;
+            case (UOP_OR & UOP_MASK):
+                if (a_const && b_const)
+                    set_mov_imm(ir, uop, a | b);
+                else if (in_place)
+                    set_op_imm(ir, uop, UOP_OR_IMM, a_const ? a : b, a_const);
+                break;
+            case (UOP_XOR & UOP_MASK):
+                if (a_const && b_const)
+                    set_mov_imm(ir, uop, a ^ b);
+                else if (in_place)
+                    set_op_imm(ir, uop, UOP_XOR_IMM, a_const ? a : b, a_const);
+                break;
+            case (UOP_ADD_LSHIFT & UOP_MASK):
+                if (uop->imm_data >= 32)
+                    break;
+                if (a_const && b_const)
+                    set_mov_imm(ir, uop, a + (b << uop->imm_data));
+                else if (b_const && regs_l)
+                    set_op_imm(ir, uop, UOP_ADD_IMM, b << uop->imm_data, 0);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+static void
+eliminate_dead_flags(ir_data_t *ir)
+{
+    for (int reg = IREG_flags_op1; reg <= IREG_flags_op2; reg++) {
+        for (int version = 1; version < reg_last_version[reg]; version++) {
+            if (version_is_dead(ir, reg, version))
+                kill_version(ir, reg, version);
+        }
+    }
+}
+
+static void
+eliminate_redundant_stores(ir_data_t *ir)
+{
+    for (int c = 0; c < ir->wr_pos; c++) {
+        const uop_t         *uop = &ir->uops[c];
+        const uop_t         *prev_uop;
+        const reg_version_t *regv;
+        const reg_version_t *prev_regv;
+        int                  reg;
+        int                  version;
+
+        if ((uop->type & UOP_MASK) != (UOP_MOV_IMM & UOP_MASK) || !reg_is_native_size(uop->dest_reg_a))
+            continue;
+
+        reg     = IREG_GET_REG(uop->dest_reg_a.reg);
+        version = uop->dest_reg_a.version;
+        if (reg <= IREG_EBX || reg_is_volatile(reg) || version < 2)
+            continue;
+
+        regv      = &reg_version[reg][version];
+        prev_regv = &reg_version[reg][version - 1];
+        prev_uop  = &ir->uops[prev_regv->parent_uop];
+        if (regv->refcount || (prev_regv->flags & REG_FLAGS_DEAD) || !VERSION_TEST(reg_live[reg], version - 1))
+            continue;
+        if ((prev_uop->type & UOP_MASK) != (UOP_MOV_IMM & UOP_MASK) || prev_uop->dest_reg_a.reg != uop->dest_reg_a.reg || prev_uop->imm_data != uop->imm_data)
+            continue;
+        /*The previous version must still be in memory, and this uOP must not
+          be reachable from a jump that skipped it*/
+        if (clobber_count[c] != clobber_count[prev_regv->parent_uop + 1] || dest_count[c] != dest_count[prev_regv->parent_uop])
+            continue;
+        if (version < reg_last_version[reg] && !reg_is_native_size(ir->uops[reg_version[reg][version + 1].parent_uop].dest_reg_a))
+            continue;
+
+        kill_version(ir, reg, version);
+    }
+}
+
+void
+codegen_ir_optimise(ir_data_t *ir)
+{
+    int disable = cpu_dynarec_ir_disable;
+
+    if ((disable & (IR_OPT_CONST | IR_OPT_DEAD_FLAGS | IR_OPT_STORES)) == (IR_OPT_CONST | IR_OPT_DEAD_FLAGS | IR_OPT_STORES))
+        return;
+
+    use_flags_live = !(disable & IR_OPT_DEAD_FLAGS);
+    scan_block(ir);
+
+    if (!(disable & IR_OPT_CONST))
+        fold_constants(ir);
+    if (!(disable & IR_OPT_DEAD_FLAGS))
+        eliminate_dead_flags(ir);
+    if (!(disable & IR_OPT_STORES))
+        eliminate_redundant_stores(ir);
+}
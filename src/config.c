@@ -389,6 +389,9 @@ load_machine(void)
         mem_size = machine_get_max_ram(machine);
 
     cpu_use_dynarec = !!ini_section_get_int(cat, "cpu_use_dynarec", 0);
+    cpu_dynarec_blocks = ini_section_get_int(cat, "cpu_dynarec_blocks", 0);
+    cpu_dynarec_async = !!ini_section_get_int(cat, "cpu_dynarec_async", 0);
+    cpu_dynarec_ir_disable = ini_section_get_int(cat, "cpu_dynarec_ir_disable", 0);
     fpu_softfloat = !!ini_section_get_int(cat, "fpu_softfloat", 0);
     if ((fpu_type != FPU_NONE) && machine_has_flags(machine, MACHINE_SOFTFLOAT_ONLY))
         fpu_softfloat = 1;
@@ -458,6 +461,9 @@ load_video(void)
     xga_active                       = xga_standalone_enabled;
     show_second_monitors             = !!ini_section_get_int(cat, "show_second_monitors", 1);
     video_fullscreen_scale_maximized = !!ini_section_get_int(cat, "video_fullscreen_scale_maximized", 0);
+    video_render_worker              = !!ini_section_get_int(cat, "render_worker", 0);
+    video_pacing                     = !!ini_section_get_int(cat, "frame_pacing", 0);
+    video_pacing_overlay             = !!ini_section_get_int(cat, "frame_pacing_overlay", 0);
 
     // TODO
     for (uint8_t i = 1; i < GFXCARD_MAX; i ++) {
@@ -962,6 +968,10 @@ load_hard_disks(void)
     uint32_t      board = 0;
     uint32_t      dev = 0;
 
+    hdd_aio_queue_depth  = ini_section_get_int(cat, "aio_queue_depth", 0);
+    hdd_aio_max_inflight = ini_section_get_int(cat, "aio_max_inflight", 8);
+    hdd_mmap_enabled     = !!ini_section_get_int(cat, "mmap_images", 0);
+
     memset(temp, '\0', sizeof(temp));
     for (uint8_t c = 0; c < HDD_NUM; c++) {
         sprintf(temp, "hdd_%02i_parameters", c + 1);
@@ -1123,6 +1133,17 @@ load_hard_disks(void)
         p = ini_section_get_string(cat, temp, "");
         strncpy(hdd[c].vhd_parent, p, sizeof(hdd[c].vhd_parent) - 1);
 
+        memset(hdd[c].overlay_fn, 0x00, sizeof(hdd[c].overlay_fn));
+        sprintf(temp, "hdd_%02i_overlay", c + 1);
+        p = ini_section_get_string(cat, temp, "");
+        if (p[0] != 0x00) {
+            if (path_abs(p))
+                strncpy(hdd[c].overlay_fn, p, sizeof(hdd[c].overlay_fn) - 1);
+            else
+                path_append_filename(hdd[c].overlay_fn, usr_path, p);
+            path_normalize(hdd[c].overlay_fn);
+        }
+
         /* If disk is empty or invalid, mark it for deletion. */
         if (!hdd_is_valid(c)) {
             sprintf(temp, "hdd_%02i_parameters", c + 1);
@@ -2019,6 +2040,18 @@ save_machine(void)
     ini_section_set_int(cat, "mem_size", mem_size);
 
     ini_section_set_int(cat, "cpu_use_dynarec", cpu_use_dynarec);
+    if (cpu_dynarec_blocks == 0)
+        ini_section_delete_var(cat, "cpu_dynarec_blocks");
+    else
+        ini_section_set_int(cat, "cpu_dynarec_blocks", cpu_dynarec_blocks);
+    if (cpu_dynarec_async == 0)
+        ini_section_delete_var(cat, "cpu_dynarec_async");
+    else
+        ini_section_set_int(cat, "cpu_dynarec_async", cpu_dynarec_async);
+    if (cpu_dynarec_ir_disable == 0)
+        ini_section_delete_var(cat, "cpu_dynarec_ir_disable");
+    else
+        ini_section_set_int(cat, "cpu_dynarec_ir_disable", cpu_dynarec_ir_disable);
     ini_section_set_int(cat, "fpu_softfloat", fpu_softfloat);
 
     if (time_sync & TIME_SYNC_ENABLED)
@@ -2079,6 +2112,21 @@ save_video(void)
     else
         ini_section_set_int(cat, "video_fullscreen_scale_maximized", video_fullscreen_scale_maximized);
 
+    if (video_render_worker == 0)
+        ini_section_delete_var(cat, "render_worker");
+    else
+        ini_section_set_int(cat, "render_worker", video_render_worker);
+
+    if (video_pacing == 0)
+        ini_section_delete_var(cat, "frame_pacing");
+    else
+        ini_section_set_int(cat, "frame_pacing", video_pacing);
+
+    if (video_pacing_overlay == 0)
+        ini_section_delete_var(cat, "frame_pacing_overlay");
+    else
+        ini_section_set_int(cat, "frame_pacing_overlay", video_pacing_overlay);
+
     ini_delete_section_if_empty(config, cat);
 }
 
@@ -2516,6 +2564,21 @@ save_hard_disks(void)
     char          tmp2[512];
     char         *p;
 
+    if (hdd_aio_queue_depth == 0)
+        ini_section_delete_var(cat, "aio_queue_depth");
+    else
+        ini_section_set_int(cat, "aio_queue_depth", hdd_aio_queue_depth);
+
+    if (hdd_aio_max_inflight == 8)
+        ini_section_delete_var(cat, "aio_max_inflight");
+    else
+        ini_section_set_int(cat, "aio_max_inflight", hdd_aio_max_inflight);
+
+    if (hdd_mmap_enabled == 0)
+        ini_section_delete_var(cat, "mmap_images");
+    else
+        ini_section_set_int(cat, "mmap_images", 1);
+
     memset(temp, 0x00, sizeof(temp));
     for (uint8_t c = 0; c < HDD_NUM; c++) {
         sprintf(temp, "hdd_%02i_parameters", c + 1);
@@ -2589,6 +2652,13 @@ save_hard_disks(void)
         } else
             ini_section_delete_var(cat, temp);
 
+        sprintf(temp, "hdd_%02i_overlay", c + 1);
+        if (hdd_is_valid(c) && hdd[c].overlay_fn[0]) {
+            path_normalize(hdd[c].overlay_fn);
+            ini_section_set_string(cat, temp, hdd[c].overlay_fn);
+        } else
+            ini_section_delete_var(cat, temp);
+
         sprintf(temp, "hdd_%02i_speed", c + 1);
         if (!hdd_is_valid(c) || ((hdd[c].bus != HDD_BUS_ESDI) && (hdd[c].bus != HDD_BUS_IDE) &&
             (hdd[c].bus != HDD_BUS_SCSI) && (hdd[c].bus != HDD_BUS_ATAPI)))
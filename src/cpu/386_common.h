@@ -290,6 +290,55 @@ int checkio(uint32_t port, int mask);
         break;                                                                   \
     }
 
+/* Number of elements of a forward REP string op that can be handled in one
+   go starting at offset reg, without leaving the segment limit or wrapping
+   the reg_size byte index register. */
+static __inline uint32_t
+rep_bulk_limit(uint32_t count, uint32_t reg, int reg_size, const x86seg *seg, int size)
+{
+    uint32_t end = (reg_size == 2) ? 0xffff : 0xffffffff;
+
+    if (seg->limit_high < end)
+        end = seg->limit_high;
+    if ((reg < seg->limit_low) || (reg > end) || ((end - reg) < (uint32_t) (size - 1)))
+        return 0;
+    if ((((uint64_t) end - reg + 1) / size) < count)
+        count = (((uint64_t) end - reg + 1) / size);
+
+    return count;
+}
+
+/* Bulk paths for REP MOVS and REP STOS. They return the number of elements
+   moved, 0 if the next element has to go through the normal path. */
+static __inline uint32_t
+rep_movs_bulk(uint32_t src_reg, uint32_t dest_reg, uint32_t count, int reg_size, int size, int elem_cycles, int cycles_left)
+{
+    if ((cpu_state.flags & D_FLAG) || (cycles_left < elem_cycles))
+        return 0;
+    if ((uint32_t) (cycles_left / elem_cycles) < count)
+        count = cycles_left / elem_cycles;
+    count = rep_bulk_limit(count, src_reg, reg_size, cpu_state.ea_seg, size);
+    count = rep_bulk_limit(count, dest_reg, reg_size, &cpu_state.seg_es, size);
+    if (!count)
+        return 0;
+
+    return mem_movs_bulk(cpu_state.ea_seg->base + src_reg, es + dest_reg, count, size);
+}
+
+static __inline uint32_t
+rep_stos_bulk(uint32_t dest_reg, uint32_t count, int reg_size, int size, uint32_t val, int elem_cycles, int cycles_left)
+{
+    if ((cpu_state.flags & D_FLAG) || (cycles_left < elem_cycles))
+        return 0;
+    if ((uint32_t) (cycles_left / elem_cycles) < count)
+        count = cycles_left / elem_cycles;
+    count = rep_bulk_limit(count, dest_reg, reg_size, &cpu_state.seg_es, size);
+    if (!count)
+        return 0;
+
+    return mem_stos_bulk(es + dest_reg, count, size, val);
+}
+
 #define NOTRM                                         \
     if (!(msw & 1) || (cpu_state.eflags & VM_FLAG)) { \
         x86_int(6);                                   \
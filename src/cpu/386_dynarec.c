@@ -386,18 +386,66 @@ block_ended:
     cpu_end_block_after_ins = 0;
 }
 
+#    ifdef USE_NEW_DYNAREC
+/* Whether the next block can be run straight after the one that just
+   returned, without going back through exec386_dynarec(). Anything that
+   loop would act on between blocks - aborts, resets, pending SMI, NMI or
+   interrupts, single stepping, the end of the timeslice or a due timer -
+   ends the chain. */
+static __inline int
+exec386_dynarec_can_chain(void)
+{
+#        ifdef USE_GDBSTUB
+    return 0;
+#        else
+    if (cpu_state.abrt || cpu_init || (cycles <= 0) || cpu_end_block_after_ins)
+        return 0;
+    if (!CACHE_ON() || cpu_override_dynarec)
+        return 0;
+    if (smi_line || (nmi && nmi_enable && nmi_mask) || ((cpu_state.flags & I_FLAG) && pic.int_pending))
+        return 0;
+    /* tsc only moves mid-block if a timer was processed early */
+    if (tsc != tsc_old)
+        return 0;
+
+    return !TIMER_VAL_LESS_THAN_VAL(timer_target, (uint32_t) (tsc + (cycles_old - cycles)));
+#        endif
+}
+#    endif
+
 static __inline void
 exec386_dynarec_dyn(void)
 {
-    uint32_t start_pc  = 0;
-    uint32_t phys_addr = get_phys(cs + cpu_state.pc);
-    int      hash      = HASH(phys_addr);
+    uint32_t     start_pc = 0;
+    uint32_t     phys_addr;
+    codeblock_t *block;
+    int          valid_block;
+#    ifdef USE_NEW_DYNAREC
+    codeblock_t *prev_block = NULL;
+    int          linked;
+
+    if (codegen_async)
+        codegen_async_poll();
+
+next_block:
+#    else
+    int hash;
+#    endif
+    phys_addr   = get_phys(cs + cpu_state.pc);
+    valid_block = 0;
 #    ifdef USE_NEW_DYNAREC
-    codeblock_t *block = &codeblock[codeblock_hash[hash]];
+    block  = NULL;
+    linked = 0;
+    if (prev_block && !cpu_state.abrt)
+        block = codeblock_link_find(prev_block, cs + cpu_state.pc);
+    if (block)
+        linked = 1;
+    else
+        block = codeblock_hash_find(phys_addr, cs);
 #    else
-    codeblock_t *block = codeblock_hash[hash];
+    hash  = HASH(phys_addr);
+    block = codeblock_hash[hash];
 #    endif
-    int valid_block = 0;
 
 #    ifdef USE_NEW_DYNAREC
     if (!cpu_state.abrt)
@@ -411,6 +459,14 @@ exec386_dynarec_dyn(void)
            and physical address. The physical address check will
            also catch any page faults at this stage */
         valid_block = (block->pc == cs + cpu_state.pc) && (block->_cs == cs) && (block->phys == phys_addr) && !((block->status ^ cpu_cur_status) & CPU_STATUS_FLAGS) && ((block->status & cpu_cur_status & CPU_STATUS_MASK) == (cpu_cur_status & CPU_STATUS_MASK));
+#    ifdef USE_NEW_DYNAREC
+        if (!valid_block && linked) {
+            /* Stale link, fall back to the hash table */
+            block       = codeblock_hash_find(phys_addr, cs);
+            linked      = 0;
+            valid_block = (block->pc == cs + cpu_state.pc) && (block->_cs == cs) && (block->phys == phys_addr) && !((block->status ^ cpu_cur_status) & CPU_STATUS_FLAGS) && ((block->status & cpu_cur_status & CPU_STATUS_MASK) == (cpu_cur_status & CPU_STATUS_MASK));
+        }
+#    endif
         if (!valid_block) {
             uint64_t mask = (uint64_t) 1 << ((phys_addr >> PAGE_MASK_SHIFT) & PAGE_MASK_MASK);
 #    ifdef USE_NEW_DYNAREC
@@ -430,7 +486,7 @@ exec386_dynarec_dyn(void)
                     if (valid_block) {
                         block = new_block;
 #    ifdef USE_NEW_DYNAREC
-                        codeblock_hash[hash] = get_block_nr(block);
+                        codeblock_hash_add(block);
 #    endif
                     }
                 }
@@ -491,7 +547,7 @@ exec386_dynarec_dyn(void)
             else
                 block->flags |= CODEBLOCK_BYTE_MASK;
         }
-        if (valid_block && (block->flags & CODEBLOCK_WAS_RECOMPILED) && (block->flags & CODEBLOCK_STATIC_TOP) && block->TOP != (cpu_state.TOP & 7))
+        if (valid_block && !(block->flags & CODEBLOCK_COMPILING) && (block->flags & CODEBLOCK_WAS_RECOMPILED) && (block->flags & CODEBLOCK_STATIC_TOP) && block->TOP != (cpu_state.TOP & 7))
 #    else
         if (valid_block && block->was_recompiled && (block->flags & CODEBLOCK_STATIC_TOP) && block->TOP != cpu_state.TOP)
 #    endif
@@ -508,7 +564,11 @@ exec386_dynarec_dyn(void)
     }
 
 #    ifdef USE_NEW_DYNAREC
-    if (valid_block && (block->flags & CODEBLOCK_WAS_RECOMPILED))
+    if (valid_block && codegen_async && ((block->flags & CODEBLOCK_COMPILING) || (!(block->flags & CODEBLOCK_WAS_RECOMPILED) && codegen_async_busy()))) {
+        /* Block is still being compiled, or is due to be and the background
+           compiler is busy - interpret it this time round */
+        exec386_dynarec_int();
+    } else if (valid_block && (block->flags & CODEBLOCK_WAS_RECOMPILED))
 #    else
     if (valid_block && block->was_recompiled)
 #    endif
@@ -517,6 +577,13 @@ exec386_dynarec_dyn(void)
 
 #    ifndef USE_NEW_DYNAREC
         codeblock_hash[hash] = block;
+#    endif
+#    ifdef USE_NEW_DYNAREC
+        block->flags |= CODEBLOCK_REFERENCED;
+        if (linked)
+            codegen_chain_hits++;
+        else if (prev_block && (prev_block->pc != BLOCK_PC_INVALID))
+            codeblock_link_add(prev_block, block);
 #    endif
         inrecomp = 1;
         code();
@@ -525,7 +592,12 @@ exec386_dynarec_dyn(void)
 #    endif
         inrecomp = 0;
 
-#    ifndef USE_NEW_DYNAREC
+#    ifdef USE_NEW_DYNAREC
+        if (exec386_dynarec_can_chain()) {
+            prev_block = block;
+            goto next_block;
+        }
+#    else
         if (!use32)
             cpu_state.pc &= 0xffff;
 #    endif
@@ -51,6 +51,24 @@
 
 extern void codegen_init(void);
 extern void codegen_flush(void);
+#ifdef USE_NEW_DYNAREC
+/*Block lookup, chaining and eviction statistics of the last second*/
+typedef struct codegen_stats_t {
+    uint64_t hash_hits;
+    uint64_t hash_misses;
+    uint64_t hash_collisions;
+    uint64_t hash_evictions;
+    uint64_t block_evictions;
+    uint64_t chain_hits;
+    uint64_t evict_recompiles;
+    uint64_t async_failures;
+} codegen_stats_t;
+
+extern codegen_stats_t codegen_stats_sec;
+
+extern void codegen_close(void);
+extern void codegen_stats_update(void);
+#endif
 
 /*Current physical page of block being recompiled. -1 if no recompilation taking place */
 extern uint32_t recomp_page;
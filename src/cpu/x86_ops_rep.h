@@ -223,10 +223,23 @@
             SEG_CHECK_WRITE(&cpu_state.seg_es);                                                                   \
         }                                                                                                         \
         while (CNT_REG > 0) {                                                                                     \
+            uint32_t bulk;                                                                                        \
             uint8_t temp;                                                                                         \
                                                                                                                   \
             CHECK_READ_REP(cpu_state.ea_seg, SRC_REG, SRC_REG);                                                   \
             CHECK_WRITE_REP(&cpu_state.seg_es, DEST_REG, DEST_REG);                                               \
+            bulk = rep_movs_bulk(SRC_REG, DEST_REG, CNT_REG, sizeof(DEST_REG), 1,                                 \
+                                 is486 ? 3 : 4, cycles - cycles_end);                                             \
+            if (bulk) {                                                                                           \
+                SRC_REG += bulk;                                                                                  \
+                DEST_REG += bulk;                                                                                 \
+                CNT_REG -= bulk;                                                                                  \
+                cycles -= bulk * (is486 ? 3 : 4);                                                                 \
+                reads += bulk;                                                                                    \
+                writes += bulk;                                                                                   \
+                total_cycles += bulk * (is486 ? 3 : 4);                                                           \
+                continue;                                                                                         \
+            }                                                                                                     \
             high_page = 0;                                                                                        \
             do_mmut_rb(cpu_state.ea_seg->base, SRC_REG, &addr64);                                                 \
             if (cpu_state.abrt)                                                                                   \
@@ -277,10 +290,23 @@
             SEG_CHECK_WRITE(&cpu_state.seg_es);                                                                   \
         }                                                                                                         \
         while (CNT_REG > 0) {                                                                                     \
+            uint32_t bulk;                                                                                        \
             uint16_t temp;                                                                                        \
                                                                                                                   \
             CHECK_READ_REP(cpu_state.ea_seg, SRC_REG, SRC_REG + 1UL);                                             \
             CHECK_WRITE_REP(&cpu_state.seg_es, DEST_REG, DEST_REG + 1UL);                                         \
+            bulk = rep_movs_bulk(SRC_REG, DEST_REG, CNT_REG, sizeof(DEST_REG), 2,                                 \
+                                 is486 ? 3 : 4, cycles - cycles_end);                                             \
+            if (bulk) {                                                                                           \
+                SRC_REG += bulk * 2;                                                                              \
+                DEST_REG += bulk * 2;                                                                             \
+                CNT_REG -= bulk;                                                                                  \
+                cycles -= bulk * (is486 ? 3 : 4);                                                                 \
+                reads += bulk;                                                                                    \
+                writes += bulk;                                                                                   \
+                total_cycles += bulk * (is486 ? 3 : 4);                                                           \
+                continue;                                                                                         \
+            }                                                                                                     \
             high_page = 0;                                                                                        \
             do_mmut_rw(cpu_state.ea_seg->base, SRC_REG, addr64a);                                                 \
             if (cpu_state.abrt)                                                                                   \
@@ -331,10 +357,23 @@
             SEG_CHECK_WRITE(&cpu_state.seg_es);                                                                   \
         }                                                                                                         \
         while (CNT_REG > 0) {                                                                                     \
+            uint32_t bulk;                                                                                        \
             uint32_t temp;                                                                                        \
                                                                                                                   \
             CHECK_READ_REP(cpu_state.ea_seg, SRC_REG, SRC_REG + 3UL);                                             \
             CHECK_WRITE_REP(&cpu_state.seg_es, DEST_REG, DEST_REG + 3UL);                                         \
+            bulk = rep_movs_bulk(SRC_REG, DEST_REG, CNT_REG, sizeof(DEST_REG), 4,                                 \
+                                 is486 ? 3 : 4, cycles - cycles_end);                                             \
+            if (bulk) {                                                                                           \
+                SRC_REG += bulk * 4;                                                                              \
+                DEST_REG += bulk * 4;                                                                             \
+                CNT_REG -= bulk;                                                                                  \
+                cycles -= bulk * (is486 ? 3 : 4);                                                                 \
+                reads += bulk;                                                                                    \
+                writes += bulk;                                                                                   \
+                total_cycles += bulk * (is486 ? 3 : 4);                                                           \
+                continue;                                                                                         \
+            }                                                                                                     \
             high_page = 0;                                                                                        \
             do_mmut_rl(cpu_state.ea_seg->base, SRC_REG, addr64a);                                                 \
             if (cpu_state.abrt)                                                                                   \
@@ -382,7 +421,18 @@
         if (CNT_REG > 0)                                                                                          \
             SEG_CHECK_WRITE(&cpu_state.seg_es);                                                                   \
         while (CNT_REG > 0) {                                                                                     \
+            uint32_t bulk;                                                                                        \
+                                                                                                                  \
             CHECK_WRITE_REP(&cpu_state.seg_es, DEST_REG, DEST_REG);                                               \
+            bulk = rep_stos_bulk(DEST_REG, CNT_REG, sizeof(DEST_REG), 1, AL, is486 ? 4 : 5, cycles - cycles_end); \
+            if (bulk) {                                                                                           \
+                DEST_REG += bulk;                                                                                 \
+                CNT_REG -= bulk;                                                                                  \
+                cycles -= bulk * (is486 ? 4 : 5);                                                                 \
+                writes += bulk;                                                                                   \
+                total_cycles += bulk * (is486 ? 4 : 5);                                                           \
+                continue;                                                                                         \
+            }                                                                                                     \
             writememb(es, DEST_REG, AL);                                                                          \
             if (cpu_state.abrt)                                                                                   \
                 return 1;                                                                                         \
@@ -414,7 +464,18 @@
         if (CNT_REG > 0)                                                                                          \
             SEG_CHECK_WRITE(&cpu_state.seg_es);                                                                   \
         while (CNT_REG > 0) {                                                                                     \
+            uint32_t bulk;                                                                                        \
+                                                                                                                  \
             CHECK_WRITE_REP(&cpu_state.seg_es, DEST_REG, DEST_REG + 1UL);                                         \
+            bulk = rep_stos_bulk(DEST_REG, CNT_REG, sizeof(DEST_REG), 2, AX, is486 ? 4 : 5, cycles - cycles_end); \
+            if (bulk) {                                                                                           \
+                DEST_REG += bulk * 2;                                                                             \
+                CNT_REG -= bulk;                                                                                  \
+                cycles -= bulk * (is486 ? 4 : 5);                                                                 \
+                writes += bulk;                                                                                   \
+                total_cycles += bulk * (is486 ? 4 : 5);                                                           \
+                continue;                                                                                         \
+            }                                                                                                     \
             writememw(es, DEST_REG, AX);                                                                          \
             if (cpu_state.abrt)                                                                                   \
                 return 1;                                                                                         \
@@ -446,7 +507,18 @@
         if (CNT_REG > 0)                                                                                          \
             SEG_CHECK_WRITE(&cpu_state.seg_es);                                                                   \
         while (CNT_REG > 0) {                                                                                     \
+            uint32_t bulk;                                                                                        \
+                                                                                                                  \
             CHECK_WRITE_REP(&cpu_state.seg_es, DEST_REG, DEST_REG + 3UL);                                         \
+            bulk = rep_stos_bulk(DEST_REG, CNT_REG, sizeof(DEST_REG), 4, EAX, is486 ? 4 : 5, cycles - cycles_end);\
+            if (bulk) {                                                                                           \
+                DEST_REG += bulk * 4;                                                                             \
+                CNT_REG -= bulk;                                                                                  \
+                cycles -= bulk * (is486 ? 4 : 5);                                                                 \
+                writes += bulk;                                                                                   \
+                total_cycles += bulk * (is486 ? 4 : 5);                                                           \
+                continue;                                                                                         \
+            }                                                                                                     \
             writememl(es, DEST_REG, EAX);                                                                         \
             if (cpu_state.abrt)                                                                                   \
                 return 1;                                                                                         \
@@ -134,6 +134,7 @@ void codegen_set_rounding_mode(int mode);
 #define FPU_PR_80_BITS          (0x300)
 
 #include "softfloat3e/softfloat.h"
+#include "x87_fast.h"
 
 static __inline int
 is_IA_masked(void)
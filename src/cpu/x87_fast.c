@@ -0,0 +1,172 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Host double fast path for the x87 softfloat arithmetic.
+ *
+ *
+ *
+ * Authors: agent, <agent@local>
+ *
+ *          Copyright 2026 agent.
+ */
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <86box/plat_fallthrough.h>
+#include "softfloat3e/config.h"
+#include "x87_fast.h"
+
+/* Hybrid fast path for the softfloat arithmetic. With round to nearest and
+   operands that are normal doubles well inside the double exponent range,
+   the host double result is the correctly rounded 53-bit result, and its
+   rounding error can be recovered exactly to produce the precision flag and
+   C1. That is the x87 result for 53-bit precision control, and for 24 and
+   64-bit precision whenever the result needs no rounding to them. Anything
+   else goes through softfloat. The exponent limit keeps the error terms of
+   the products and quotients clear of the double subnormal range.
+
+   fpu_bench (x87_fast_bench.c) checks the fast path against softfloat. */
+#if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)
+#    define FPU_FAST_PATH
+#endif
+
+enum {
+    FPU_FAST_ADD = 0,
+    FPU_FAST_SUB,
+    FPU_FAST_MUL,
+    FPU_FAST_DIV
+};
+
+static extFloat80_t
+FPU_fast_softfloat(int op, extFloat80_t a, extFloat80_t b, struct softfloat_status_t *status)
+{
+    switch (op) {
+        case FPU_FAST_ADD:
+            return extF80_add(a, b, status);
+        case FPU_FAST_SUB:
+            return extF80_sub(a, b, status);
+        case FPU_FAST_MUL:
+            return extF80_mul(a, b, status);
+        default:
+            return extF80_div(a, b, status);
+    }
+}
+
+#ifdef FPU_FAST_PATH
+static __inline int
+FPU_fast_to_double(extFloat80_t a, double *d)
+{
+    int      exp = (a.signExp & 0x7fff) - 16383;
+    uint64_t bits;
+
+    /* Zeroes, denormals, unnormals, infinities and NaNs all fail this. */
+    if (!(a.signif & BX_CONST64(0x8000000000000000)) || (a.signif & 0x7ff) || (exp < -FPU_FAST_EXP_MAX) || (exp > FPU_FAST_EXP_MAX))
+        return 0;
+
+    bits = ((uint64_t) (a.signExp & 0x8000) << 48) | ((uint64_t) (exp + 1023) << 52) | ((a.signif >> 11) & BX_CONST64(0x000fffffffffffff));
+    memcpy(d, &bits, sizeof(double));
+
+    return 1;
+}
+
+/* err is the rounding error of r, or anything with the same sign. */
+static __inline int
+FPU_fast_result(double r, double err, struct softfloat_status_t *status, extFloat80_t *res)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &r, sizeof(double));
+
+    if (err != 0.0) {
+        if (status->extF80_roundingPrecision != 64)
+            return 0;
+        softfloat_raiseFlags(status, softfloat_flag_inexact);
+        if ((r < 0.0) != (err < 0.0))
+            softfloat_setRoundingUp(status);
+    } else if ((status->extF80_roundingPrecision == 32) && (bits & 0x1fffffff))
+        return 0;
+
+    if (!(bits & BX_CONST64(0x7fffffffffffffff))) {
+        res->signExp = (bits >> 48) & 0x8000;
+        res->signif  = 0;
+    } else {
+        res->signExp = ((bits >> 48) & 0x8000) | (((bits >> 52) & 0x7ff) - 1023 + 16383);
+        res->signif  = BX_CONST64(0x8000000000000000) | ((bits & BX_CONST64(0x000fffffffffffff)) << 11);
+    }
+
+    return 1;
+}
+#endif
+
+static extFloat80_t
+FPU_fast_op(int op, extFloat80_t a, extFloat80_t b, struct softfloat_status_t *status)
+{
+#ifdef FPU_FAST_PATH
+    extFloat80_t res;
+    double       x;
+    double       y;
+    double       r;
+    double       t;
+    double       err;
+
+    if ((status->softfloat_roundingMode == softfloat_round_near_even) && FPU_fast_to_double(a, &x) && FPU_fast_to_double(b, &y)) {
+        switch (op) {
+            case FPU_FAST_SUB:
+                y = -y;
+                fallthrough;
+            case FPU_FAST_ADD:
+                /* Knuth's two-sum, exact for any finite operands. */
+                r   = x + y;
+                t   = r - x;
+                err = (x - (r - t)) + (y - t);
+                break;
+            case FPU_FAST_MUL:
+                r   = x * y;
+                err = fma(x, y, -r);
+                break;
+            default:
+                /* The remainder has the sign of the error times the divisor. */
+                r   = x / y;
+                err = fma(-r, y, x);
+                if (y < 0.0)
+                    err = -err;
+                break;
+        }
+
+        if (FPU_fast_result(r, err, status, &res))
+            return res;
+    }
+#endif
+
+    return FPU_fast_softfloat(op, a, b, status);
+}
+
+extFloat80_t
+FPU_fast_add(extFloat80_t a, extFloat80_t b, struct softfloat_status_t *status)
+{
+    return FPU_fast_op(FPU_FAST_ADD, a, b, status);
+}
+
+extFloat80_t
+FPU_fast_sub(extFloat80_t a, extFloat80_t b, struct softfloat_status_t *status)
+{
+    return FPU_fast_op(FPU_FAST_SUB, a, b, status);
+}
+
+extFloat80_t
+FPU_fast_mul(extFloat80_t a, extFloat80_t b, struct softfloat_status_t *status)
+{
+    return FPU_fast_op(FPU_FAST_MUL, a, b, status);
+}
+
+extFloat80_t
+FPU_fast_div(extFloat80_t a, extFloat80_t b, struct softfloat_status_t *status)
+{
+    return FPU_fast_op(FPU_FAST_DIV, a, b, status);
+}
@@ -0,0 +1,31 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Definitions for the host double fast path of the x87 softfloat
+ *          arithmetic.
+ *
+ *
+ *
+ * Authors: agent, <agent@local>
+ *
+ *          Copyright 2026 agent.
+ */
+#ifndef EMU_X87_FAST_H
+#define EMU_X87_FAST_H
+
+#include "softfloat3e/softfloat.h"
+
+/* Largest unbiased operand exponent the fast path takes. */
+#define FPU_FAST_EXP_MAX 400
+
+extFloat80_t FPU_fast_add(extFloat80_t a, extFloat80_t b, struct softfloat_status_t *status);
+extFloat80_t FPU_fast_sub(extFloat80_t a, extFloat80_t b, struct softfloat_status_t *status);
+extFloat80_t FPU_fast_mul(extFloat80_t a, extFloat80_t b, struct softfloat_status_t *status);
+extFloat80_t FPU_fast_div(extFloat80_t a, extFloat80_t b, struct softfloat_status_t *status);
+
+#endif /*EMU_X87_FAST_H*/
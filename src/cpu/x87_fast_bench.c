@@ -0,0 +1,291 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Standalone test and benchmark for the host double fast path
+ *          of the x87 softfloat arithmetic.
+ *
+ *          Runs random operands through the fast path and through plain
+ *          softfloat for every operation, rounding mode and precision
+ *          control, and checks that both give the same result and the
+ *          same status word bits. Operands are mostly ones the fast path
+ *          takes, with exact values, extra low bits, exponents around the
+ *          fast path limit, cancellations and special values mixed in.
+ *          Then times both on fast path operands. Exits with 1 on any
+ *          difference.
+ *
+ *          Usage: fpu_bench [operations]
+ *
+ *
+ *
+ * Authors: agent, <agent@local>
+ *
+ *          Copyright 2026 agent.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "softfloat3e/config.h"
+#include "x87_fast.h"
+
+#define BENCH_OPS       4000000
+#define BENCH_TIMED_OPS 1000000
+
+typedef extFloat80_t (*fpu_op_t)(extFloat80_t a, extFloat80_t b, struct softfloat_status_t *status);
+
+static const struct {
+    const char *name;
+    fpu_op_t    ref;
+    fpu_op_t    fast;
+} ops[] = {
+    { "add", extF80_add, FPU_fast_add },
+    { "sub", extF80_sub, FPU_fast_sub },
+    { "mul", extF80_mul, FPU_fast_mul },
+    { "div", extF80_div, FPU_fast_div }
+};
+
+static const int precisions[] = { 32, 64, 80 };
+
+/* Read by the softfloat comparisons, which are not used here. */
+int fpu_type = 0;
+
+static uint64_t seed = BX_CONST64(0x9e3779b97f4a7c15);
+
+static uint64_t
+bench_time_us(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ((uint64_t) ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+static uint64_t
+bench_rand(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+
+    return seed;
+}
+
+/* Status as i387cw_to_softfloat_status_word() sets it up, with all
+   exceptions masked. */
+static struct softfloat_status_t
+bench_status(int rounding_mode, int precision)
+{
+    struct softfloat_status_t status;
+
+    memset(&status, 0, sizeof(status));
+    status.softfloat_roundingMode   = rounding_mode;
+    status.softfloat_exceptionMasks = softfloat_all_exceptions_mask;
+    status.extF80_roundingPrecision = precision;
+
+    return status;
+}
+
+/* A normal operand that fits in a double, inside the fast path range. */
+static extFloat80_t
+bench_operand(uint64_t r)
+{
+    extFloat80_t op;
+
+    op.signif  = (r | BX_CONST64(0x8000000000000000)) & ~BX_CONST64(0x7ff);
+    op.signExp = (uint16_t) (((r >> 11) & 0x8000) | (16383 + (int) ((r >> 12) % (2 * FPU_FAST_EXP_MAX + 1)) - FPU_FAST_EXP_MAX));
+
+    return op;
+}
+
+static extFloat80_t
+bench_operand_mixed(void)
+{
+    uint64_t     r  = bench_rand();
+    extFloat80_t op = bench_operand(r);
+
+    switch ((r >> 40) & 15) {
+        case 0:
+            /* Short significands give exact results. */
+            op.signif &= BX_CONST64(0xffff000000000000);
+            break;
+        case 1:
+            op.signExp = (op.signExp & 0x8000) | (16383 + ((r >> 44) & 7));
+            break;
+        case 2:
+            /* Not a double, so softfloat. */
+            op.signif |= (r >> 50) & 0x7ff;
+            break;
+        case 3:
+            /* Either side of the exponent limit. */
+            op.signExp = (op.signExp & 0x8000) | (16383 + ((r & 1) ? -1 : 1) * (FPU_FAST_EXP_MAX - 1 + (int) ((r >> 44) & 3)));
+            break;
+        case 4:
+            switch ((r >> 44) & 7) {
+                case 0:
+                    op.signExp &= 0x8000;
+                    op.signif = 0;
+                    break;
+                case 1:
+                    /* Denormal. */
+                    op.signExp &= 0x8000;
+                    op.signif >>= 1 + ((r >> 47) & 31);
+                    break;
+                case 2:
+                    /* Unnormal. */
+                    op.signif &= BX_CONST64(0x7fffffffffffffff);
+                    break;
+                case 3:
+                    op.signExp |= 0x7fff;
+                    op.signif = BX_CONST64(0x8000000000000000);
+                    break;
+                case 4:
+                    op.signExp |= 0x7fff;
+                    op.signif |= BX_CONST64(0x4000000000000000);
+                    break;
+                default:
+                    /* Far outside the double range. */
+                    op.signExp = (op.signExp & 0x8000) | (16383 + ((r & 1) ? -1 : 1) * (2000 + (int) ((r >> 48) & 0xfff)));
+                    break;
+            }
+            break;
+        default:
+            break;
+    }
+
+    return op;
+}
+
+/* Runs every operation on a and b in the given mode, and returns the number
+   of differences. */
+static int
+bench_compare(extFloat80_t a, extFloat80_t b, int rounding_mode, int precision, int *printed)
+{
+    struct softfloat_status_t ref_status;
+    struct softfloat_status_t fast_status;
+    extFloat80_t              ref;
+    extFloat80_t              fast;
+    int                       errors = 0;
+
+    for (int i = 0; i < (int) (sizeof(ops) / sizeof(ops[0])); i++) {
+        ref_status  = bench_status(rounding_mode, precision);
+        fast_status = ref_status;
+        ref         = ops[i].ref(a, b, &ref_status);
+        fast        = ops[i].fast(a, b, &fast_status);
+
+        if ((ref.signExp != fast.signExp) || (ref.signif != fast.signif) ||
+            (ref_status.softfloat_exceptionFlags != fast_status.softfloat_exceptionFlags)) {
+            if ((*printed)++ < 20)
+                printf("  %s, rounding %i, precision %i: %04X:%016" PRIX64 ", %04X:%016" PRIX64 " -> "
+                       "%04X:%016" PRIX64 " flags %04X, softfloat %04X:%016" PRIX64 " flags %04X\n",
+                       ops[i].name, rounding_mode, precision, a.signExp, a.signif, b.signExp, b.signif,
+                       fast.signExp, fast.signif, fast_status.softfloat_exceptionFlags,
+                       ref.signExp, ref.signif, ref_status.softfloat_exceptionFlags);
+            errors++;
+        }
+    }
+
+    return errors;
+}
+
+/* Returns the time taken for the given operands in microseconds. */
+static uint64_t
+bench_run(fpu_op_t op, const extFloat80_t *a, const extFloat80_t *b, int count, int precision, uint64_t *sink)
+{
+    struct softfloat_status_t status;
+    extFloat80_t              res;
+    uint64_t                  start = bench_time_us();
+
+    for (int c = 0; c < count; c++) {
+        status = bench_status(softfloat_round_near_even, precision);
+        res    = op(a[c], b[c], &status);
+        *sink += res.signif ^ status.softfloat_exceptionFlags;
+    }
+
+    return bench_time_us() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+    extFloat80_t *a;
+    extFloat80_t *b;
+    extFloat80_t  x;
+    extFloat80_t  y;
+    int           count   = BENCH_OPS;
+    int           errors  = 0;
+    int           printed = 0;
+    int           rounding_mode;
+    uint64_t      r;
+    uint64_t      sink = 0;
+    uint64_t      ref_us;
+    uint64_t      fast_us;
+
+    if (argc > 1)
+        count = atoi(argv[1]);
+    if (count <= 0)
+        count = 1;
+
+    for (int c = 0; c < count; c++) {
+        r = bench_rand();
+        x = bench_operand_mixed();
+        if (!((r >> 8) & 7)) {
+            /* Nearly cancelling operands. */
+            y = x;
+            y.signExp ^= (r & 1) ? 0x8000 : 0;
+            y.signif += ((r >> 16) & 0xff) << 11;
+            if (!(y.signif & BX_CONST64(0x8000000000000000)))
+                y.signif = x.signif;
+        } else
+            y = bench_operand_mixed();
+
+        /* The fast path only handles round to nearest, but check that the
+           others fall through. */
+        rounding_mode = ((r >> 12) & 3) ? softfloat_round_near_even : (int) ((r >> 14) & 3);
+
+        errors += bench_compare(x, y, rounding_mode, precisions[(r >> 16) % 3], &printed);
+    }
+
+    printf("%i operand pairs checked, %i differences\n\n", count, errors);
+
+    a = malloc(BENCH_TIMED_OPS * sizeof(extFloat80_t));
+    b = malloc(BENCH_TIMED_OPS * sizeof(extFloat80_t));
+    for (int c = 0; c < BENCH_TIMED_OPS; c++) {
+        a[c] = bench_operand(bench_rand());
+        b[c] = bench_operand(bench_rand());
+    }
+
+    printf("%i operations each, times in ms\n\n", BENCH_TIMED_OPS);
+    printf("%-4s %-9s %10s %10s %8s\n", "op", "precision", "softfloat", "fast", "speedup");
+
+    for (int i = 0; i < (int) (sizeof(ops) / sizeof(ops[0])); i++) {
+        for (int p = 0; p < (int) (sizeof(precisions) / sizeof(precisions[0])); p++) {
+            ref_us  = bench_run(ops[i].ref, a, b, BENCH_TIMED_OPS, precisions[p], &sink);
+            fast_us = bench_run(ops[i].fast, a, b, BENCH_TIMED_OPS, precisions[p], &sink);
+
+            printf("%-4s %-9i %10.1f %10.1f %7.2fx\n", ops[i].name, precisions[p],
+                   ref_us / 1000.0, fast_us / 1000.0, fast_us ? ((double) ref_us / fast_us) : 0.0);
+        }
+    }
+
+    free(b);
+    free(a);
+
+    /* Keeps the timed loops from being optimized away. */
+    if (sink == 1)
+        printf("\n");
+
+    if (errors) {
+        printf("\n%i differences between the fast path and softfloat\n", errors);
+        return 1;
+    }
+
+    return 0;
+}
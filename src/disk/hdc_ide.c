@@ -759,6 +759,54 @@ ide_get_sector_format(ide_t *ide)
     }
 }
 
+static void
+ide_prefetch_done(void *priv, int ret)
+{
+    ide_t *ide = (ide_t *) priv;
+
+    ide->aio_tag = 0;
+    if (ret < 0)
+        ide->aio_valid = 0;
+}
+
+/* Wait for an outstanding prefetch, so that sector_buffer may be reused. */
+static void
+ide_prefetch_wait(ide_t *ide)
+{
+    if (ide->aio_tag)
+        hdd_image_aio_wait(ide->hdd_num, ide->aio_tag);
+
+    ide->aio_tag = 0;
+}
+
+/* Start reading the sectors of a read command into sector_buffer while the
+   emulated seek is still in progress. */
+static void
+ide_prefetch(ide_t *ide)
+{
+    ide_prefetch_wait(ide);
+
+    ide->aio_valid  = 1;
+    ide->aio_sector = ide_get_sector(ide);
+    ide->aio_count  = ide->tf->secount ? ide->tf->secount : 256;
+    ide->aio_tag    = hdd_image_aio_submit(ide->hdd_num, 0, ide->aio_sector, ide->aio_count,
+                                           ide->sector_buffer, ide_prefetch_done, ide);
+}
+
+/* Fill sector_buffer, using the prefetched data if it matches the request. */
+static void
+ide_read_sectors(ide_t *ide, uint32_t count)
+{
+    uint32_t sector = ide_get_sector(ide);
+
+    ide_prefetch_wait(ide);
+
+    if (!ide->aio_valid || (ide->aio_sector != sector) || (ide->aio_count != count))
+        hdd_image_read(ide->hdd_num, sector, count, ide->sector_buffer);
+
+    ide->aio_valid = 0;
+}
+
 /**
  * Move to the next sector using CHS addressing
  */
@@ -1670,6 +1718,12 @@ ide_writeb(uint16_t addr, uint8_t val, void *priv)
                             wait_time        = seek_time + xfer_time;
                         }
                         ide_set_callback(ide, wait_time);
+
+                        /* Without a queue the prefetch would be a synchronous read
+                           ahead of the seek delay, so leave it to the callback. */
+                        if (hdd_image_aio_enabled(ide->hdd_num) && (ide->tf->lba || ide->cfg_spt) &&
+                            ((val != WIN_READ_MULTIPLE) || (ide->blocksize > 0)))
+                            ide_prefetch(ide);
                     } else
                         ide_set_callback(ide, 200.0 * IDE_TIME);
                     ide->do_initial_read = 1;
@@ -2202,8 +2256,7 @@ ide_callback(void *priv)
                 if (ide->do_initial_read) {
                     ide->do_initial_read = 0;
                     ide->sector_pos      = 0;
-                    hdd_image_read(ide->hdd_num, ide_get_sector(ide),
-                                   ide->tf->secount ? ide->tf->secount : 256, ide->sector_buffer);
+                    ide_read_sectors(ide, ide->tf->secount ? ide->tf->secount : 256);
                 }
 
                 memcpy(ide->buffer, &ide->sector_buffer[ide->sector_pos * 512], 512);
@@ -2233,7 +2286,7 @@ ide_callback(void *priv)
                     ide->sector_pos = ide->tf->secount;
                 else
                     ide->sector_pos = 256;
-                hdd_image_read(ide->hdd_num, ide_get_sector(ide), ide->sector_pos, ide->sector_buffer);
+                ide_read_sectors(ide, ide->sector_pos);
 
                 ide->tf->pos = 0;
 
@@ -2280,8 +2333,7 @@ ide_callback(void *priv)
                 if (ide->do_initial_read) {
                     ide->do_initial_read = 0;
                     ide->sector_pos      = 0;
-                    hdd_image_read(ide->hdd_num, ide_get_sector(ide),
-                                   ide->tf->secount ? ide->tf->secount : 256, ide->sector_buffer);
+                    ide_read_sectors(ide, ide->tf->secount ? ide->tf->secount : 256);
                 }
 
                 memcpy(ide->buffer, &ide->sector_buffer[ide->sector_pos * 512], 512);
@@ -2339,6 +2391,9 @@ ide_callback(void *priv)
                     else
                         ide->sector_pos = 256;
 
+                    ide_prefetch_wait(ide);
+                    ide->aio_valid = 0;
+
                     ret = bm->dma(ide->sector_buffer, ide->sector_pos * 512, 1, bm->priv);
 
                     if (ret == 2) {
@@ -3003,8 +3058,15 @@ ide_drive_reset(int d)
 
     ide_set_signature(ide_drives[d]);
 
-    if (ide_drives[d]->sector_buffer)
+    if (ide_drives[d]->type == IDE_HDD)
+        hdd_image_flush(ide_drives[d]->hdd_num);
+
+    if (ide_drives[d]->sector_buffer) {
+        if (ide_drives[d]->type == IDE_HDD)
+            ide_prefetch_wait(ide_drives[d]);
+        ide_drives[d]->aio_valid = 0;
         memset(ide_drives[d]->sector_buffer, 0, 256 * 512);
+    }
 
     if (ide_drives[d]->buffer)
         memset(ide_drives[d]->buffer, 0, 65536 * sizeof(uint16_t));
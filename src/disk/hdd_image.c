@@ -20,6 +20,7 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -31,6 +32,8 @@
 #include <86box/path.h>
 #include <86box/plat.h>
 #include <86box/random.h>
+#include <86box/timer.h>
+#include <86box/thread.h>
 #include <86box/hdd.h>
 #include "minivhd/minivhd.h"
 #include "minivhd/internal.h"
@@ -40,21 +43,88 @@
 #define HDD_IMAGE_HDX 2
 #define HDD_IMAGE_VHD 3
 
+#define HDD_AIO_POLL_USEC 50.0
+
+#define HDD_MMAP_CHUNK_SHIFT 20        /* Dirty tracking granularity, 1 MB. */
+#define HDD_MMAP_FLUSH_USEC  1000000.0 /* Background flush cadence. */
+
+#define HDD_VHD_FLUSH_USEC 1000000.0 /* Cadence of writing back the VHD block table. */
+
+typedef struct hdd_aio_req_t {
+    uint8_t  write;
+    uint32_t sector;
+    uint32_t count;
+    uint8_t *buffer; /* Caller's buffer for reads, private copy for writes. */
+    int      ret;
+    void   (*callback)(void *priv, int ret);
+    void    *priv;
+} hdd_aio_req_t;
+
+/* Per-image submission queue, serviced in order by its own worker thread.
+   The request counters only ever increase; a request's slot in the ring is
+   its sequence number modulo the queue depth. */
+typedef struct hdd_aio_t {
+    hdd_aio_req_t    *reqs;
+    uint32_t          depth;
+    uint32_t          max_inflight;
+    uint32_t          submitted;
+    uint32_t          executed;
+    uint32_t          retired;
+    uint8_t           id;
+    int               stop;
+
+    thread_t *thread;
+    mutex_t  *mutex;
+    event_t  *wake_ev;
+    event_t  *done_ev;
+
+    pc_timer_t timer;
+} hdd_aio_t;
+
+/* Memory-mapped view of a raw, HDI or HDX image. Writes mark 1 MB chunks
+   dirty, which are flushed to the file by a background timer and on close. */
+typedef struct hdd_mmap_t {
+    uint8_t   *data;
+    uint64_t   size;
+    uint8_t   *dirty;
+    uint32_t   chunks;
+    uint8_t    writable;
+    uint8_t    any_dirty;
+    pc_timer_t timer;
+} hdd_mmap_t;
+
 typedef struct hdd_image_t {
-    FILE     *file; /* Used for HDD_IMAGE_RAW, HDD_IMAGE_HDI, and HDD_IMAGE_HDX. */
-    MVHDMeta *vhd;  /* Used for HDD_IMAGE_VHD. */
-    uint32_t  base;
-    uint32_t  pos;
-    uint32_t  last_sector;
-    uint8_t   type; /* HDD_IMAGE_RAW, HDD_IMAGE_HDI, HDD_IMAGE_HDX, or HDD_IMAGE_VHD */
-    uint8_t   loaded;
+    FILE       *file; /* Used for HDD_IMAGE_RAW, HDD_IMAGE_HDI, and HDD_IMAGE_HDX. */
+    MVHDMeta   *vhd;  /* Used for HDD_IMAGE_VHD. */
+    hdd_aio_t  *aio;  /* Asynchronous queue, NULL if disabled. */
+    hdd_mmap_t *map;  /* Memory-mapped view, NULL if disabled. */
+    hdd_overlay_t *ovl; /* Copy-on-write overlay, NULL if none. */
+    pc_timer_t  vhd_timer; /* Writes back the cached VHD block table and bitmaps. */
+    uint8_t     vhd_dirty;
+    uint32_t    base;
+    uint32_t    pos;
+    uint32_t    last_sector;
+    uint8_t     type; /* HDD_IMAGE_RAW, HDD_IMAGE_HDI, HDD_IMAGE_HDX, or HDD_IMAGE_VHD */
+    uint8_t     loaded;
+    uint8_t     base_ro; /* Base image is opened read-only (it has an overlay). */
 } hdd_image_t;
 
 hdd_image_t hdd_images[HDD_NUM];
 
+int hdd_aio_queue_depth  = 0; /* (C) asynchronous queue depth per image, 0 = off */
+int hdd_aio_max_inflight = 8; /* (C) maximum unfinished requests per image */
+int hdd_mmap_enabled     = 0; /* (C) memory-map raw, HDI and HDX images */
+
 static char  empty_sector[512];
 static char *empty_sector_1mb;
 
+static void hdd_image_aio_start(uint8_t id);
+static void hdd_image_aio_stop(uint8_t id);
+static void hdd_image_mmap_start(uint8_t id);
+static void hdd_image_mmap_stop(uint8_t id);
+static void hdd_image_vhd_start(uint8_t id);
+static void hdd_image_vhd_stop(uint8_t id);
+
 #ifdef ENABLE_HDD_IMAGE_LOG
 int hdd_image_do_log = ENABLE_HDD_IMAGE_LOG;
 
@@ -232,8 +302,8 @@ hdd_image_init(void)
         memset(&hdd_images[i], 0, sizeof(hdd_image_t));
 }
 
-int
-hdd_image_load(int id)
+static int
+hdd_image_open(int id)
 {
     uint32_t sector_size = 512;
     uint32_t zero        = 0;
@@ -256,6 +326,10 @@ hdd_image_load(int id)
 
     hdd_images[id].base = 0;
 
+    hdd_image_aio_stop(id);
+    hdd_image_mmap_stop(id);
+    hdd_image_vhd_stop(id);
+
     if (hdd_images[id].loaded) {
         if (hdd_images[id].file) {
             fclose(hdd_images[id].file);
@@ -281,14 +355,14 @@ hdd_image_load(int id)
         memset(hdd[id].fn, 0, sizeof(hdd[id].fn));
         return 0;
     }
-    hdd_images[id].file = plat_fopen(fn, "rb+");
+    hdd_images[id].file = plat_fopen(fn, hdd_images[id].base_ro ? "rb" : "rb+");
     if (hdd_images[id].file == NULL) {
         /* Failed to open existing hard disk image */
         if (errno == ENOENT) {
             /* Failed because it does not exist,
                so try to create new file */
-            if (hdd[id].wp) {
-                hdd_image_log("A write-protected image must exist\n");
+            if (hdd[id].wp || hdd_images[id].base_ro) {
+                hdd_image_log("A write-protected or overlaid image must exist\n");
                 memset(hdd[id].fn, 0, sizeof(hdd[id].fn));
                 return 0;
             }
@@ -443,7 +517,7 @@ retry_vhd:
         } else if (is_vhd[1]) {
             fclose(hdd_images[id].file);
             hdd_images[id].file = NULL;
-            hdd_images[id].vhd  = mvhd_open(fn, (bool) 0, &vhd_error);
+            hdd_images[id].vhd  = mvhd_open(fn, (bool) hdd_images[id].base_ro, &vhd_error);
             if (hdd_images[id].vhd == NULL) {
                 if (vhd_error == MVHD_ERR_FILE)
                     fatal("hdd_image_load(): VHD: Error opening VHD file '%s': %s\n", fn, strerror(mvhd_errno));
@@ -487,39 +561,596 @@ retry_vhd:
     return ret;
 }
 
+int
+hdd_image_load(int id)
+{
+    int ret;
+
+    hdd_images[id].base_ro = !!hdd[id].overlay_fn[0];
+
+    ret = hdd_image_open(id);
+
+    if (ret && hdd_images[id].base_ro) {
+        hdd_images[id].ovl = hdd_overlay_open(hdd[id].overlay_fn, (uint64_t) hdd_images[id].last_sector + 1);
+        if (hdd_images[id].ovl == NULL) {
+            pclog("hdd_image_load(): Unable to open overlay '%s'\n", hdd[id].overlay_fn);
+            hdd_image_close(id);
+            ret = 0;
+        }
+    }
+
+    if (ret) {
+        hdd_image_vhd_start(id);
+        hdd_image_mmap_start(id);
+        /* Accesses to a mapped image are plain copies, there is nothing to
+           gain from queueing them. */
+        if (hdd_images[id].map == NULL)
+            hdd_image_aio_start(id);
+    }
+
+    return ret;
+}
+
 void
 hdd_image_seek(uint8_t id, uint32_t sector)
 {
     off64_t addr = sector;
     addr         = (uint64_t) sector << 9LL;
 
+    hdd_image_aio_drain(id);
+
     hdd_images[id].pos = sector;
-    if (hdd_images[id].type != HDD_IMAGE_VHD) {
+    if ((hdd_images[id].type != HDD_IMAGE_VHD) && (hdd_images[id].map == NULL)) {
         if (fseeko64(hdd_images[id].file, addr + hdd_images[id].base, SEEK_SET) == -1)
             fatal("hdd_image_seek(): Error seeking\n");
     }
 }
 
-void
-hdd_image_read(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
+/* Memory-mapped access. */
+static uint32_t
+hdd_image_mmap_clamp(hdd_mmap_t *map, uint64_t offset, uint32_t count)
+{
+    if (offset >= map->size)
+        return 0;
+
+    if ((offset + ((uint64_t) count << 9)) > map->size)
+        count = (uint32_t) ((map->size - offset) >> 9);
+
+    return count;
+}
+
+static void
+hdd_image_mmap_flush(uint8_t id, int wait)
+{
+    hdd_mmap_t *map = hdd_images[id].map;
+    uint64_t    start;
+    uint64_t    end;
+    uint32_t    c = 0;
+
+    if (!map->any_dirty)
+        return;
+
+    /* Flush each run of contiguous dirty chunks with a single call. */
+    while (c < map->chunks) {
+        if (!map->dirty[c]) {
+            c++;
+            continue;
+        }
+
+        start = (uint64_t) c << HDD_MMAP_CHUNK_SHIFT;
+        while ((c < map->chunks) && map->dirty[c])
+            map->dirty[c++] = 0;
+        end = (uint64_t) c << HDD_MMAP_CHUNK_SHIFT;
+        if (end > map->size)
+            end = map->size;
+
+        plat_msync_file(map->data + start, end - start, wait);
+    }
+
+    map->any_dirty = 0;
+}
+
+static void
+hdd_image_mmap_timer(void *priv)
+{
+    hdd_image_t *img = (hdd_image_t *) priv;
+
+    /* The worker may still be writing to the mapping, try again later. */
+    if ((img->aio != NULL) && (img->aio->retired != img->aio->submitted)) {
+        timer_on_auto(&img->map->timer, HDD_MMAP_FLUSH_USEC);
+        return;
+    }
+
+    hdd_image_mmap_flush((uint8_t) (img - hdd_images), 0);
+}
+
+static void
+hdd_image_mmap_start(uint8_t id)
+{
+    hdd_mmap_t *map;
+    uint64_t    size;
+
+    if (!hdd_mmap_enabled || (hdd_images[id].type == HDD_IMAGE_VHD) ||
+        (hdd_images[id].file == NULL) || (hdd_images[id].map != NULL))
+        return;
+
+    size = ((uint64_t) (hdd_images[id].last_sector + 1) << 9) + hdd_images[id].base;
+
+    map           = (hdd_mmap_t *) calloc(1, sizeof(hdd_mmap_t));
+    map->writable = !hdd[id].wp && !hdd_images[id].base_ro;
+    /* Read-only images are mapped read-only, so that the host can share the
+       pages between all instances using the same image. */
+    map->data = (uint8_t *) plat_mmap_file(hdd_images[id].file, size, map->writable);
+    if (map->data == NULL) {
+        hdd_image_log("Hard disk image %i: Unable to map image, using file I/O\n", id);
+        free(map);
+        return;
+    }
+
+    map->size   = size;
+    map->chunks = (uint32_t) ((size + (1ULL << HDD_MMAP_CHUNK_SHIFT) - 1) >> HDD_MMAP_CHUNK_SHIFT);
+    map->dirty  = (uint8_t *) calloc(map->chunks, 1);
+
+    timer_add(&map->timer, hdd_image_mmap_timer, &hdd_images[id], 0);
+
+    hdd_images[id].map = map;
+
+    hdd_image_log("Hard disk image %i: Memory-mapped (%" PRIu64 " bytes, %s)\n", id, size,
+                  map->writable ? "read/write" : "read-only");
+}
+
+static void
+hdd_image_mmap_stop(uint8_t id)
 {
-    int    non_transferred_sectors;
-    size_t num_read;
+    hdd_mmap_t *map = hdd_images[id].map;
+
+    if (map == NULL)
+        return;
+
+    timer_stop(&map->timer);
+
+    hdd_image_mmap_flush(id, 1);
+    plat_munmap_file(map->data, map->size);
+
+    free(map->dirty);
+    free(map);
+
+    hdd_images[id].map = NULL;
+}
 
-    if (hdd_images[id].type == HDD_IMAGE_VHD) {
+/* The read and write functions below may run on the asynchronous I/O worker,
+   so they neither update the position nor call fatal(); they return the
+   number of sectors transferred, or -1 on error, and hdd_image_io_done()
+   acts on that on the emulation thread. */
+static int
+hdd_image_base_read(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
+{
+    int         non_transferred_sectors;
+    hdd_mmap_t *map = hdd_images[id].map;
+    uint64_t    offset;
+
+    /* The base image was lost while committing an overlay. */
+    if (!hdd_images[id].loaded) {
+        memset(buffer, 0, count << 9);
+        return (int) count;
+    }
+
+    if (map != NULL) {
+        offset = ((uint64_t) sector << 9) + hdd_images[id].base;
+        count  = hdd_image_mmap_clamp(map, offset, count);
+
+        memcpy(buffer, map->data + offset, count << 9);
+        return (int) count;
+    } else if (hdd_images[id].type == HDD_IMAGE_VHD) {
         non_transferred_sectors = mvhd_read_sectors(hdd_images[id].vhd, sector, count, buffer);
-        hdd_images[id].pos      = sector + count - non_transferred_sectors - 1;
+        return (int) count - non_transferred_sectors;
     } else {
-        if (fseeko64(hdd_images[id].file, ((uint64_t) (sector) << 9LL) + hdd_images[id].base, SEEK_SET) == -1) {
-            fatal("Hard disk image %i: Read error during seek\n", id);
-            return;
+        if (fseeko64(hdd_images[id].file, ((uint64_t) (sector) << 9LL) + hdd_images[id].base, SEEK_SET) == -1)
+            return -1;
+
+        return (int) fread(buffer, 512, count, hdd_images[id].file);
+    }
+}
+
+static int
+hdd_image_overlay_base_read(void *priv, uint32_t sector, uint32_t count, uint8_t *buffer)
+{
+    return (hdd_image_base_read((uint8_t) (intptr_t) priv, sector, count, buffer) < 0) ? -1 : 0;
+}
+
+static int
+hdd_image_do_read(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
+{
+    if (hdd_images[id].ovl != NULL) {
+        if (hdd_overlay_read(hdd_images[id].ovl, sector, count, buffer,
+                             hdd_image_overlay_base_read, (void *) (intptr_t) id) < 0)
+            return -1;
+        return (int) count;
+    }
+
+    return hdd_image_base_read(id, sector, count, buffer);
+}
+
+/* Marks the chunks of the memory-mapped view dirty, hdd_image_io_done() arms
+   the timer that flushes them. */
+static int
+hdd_image_base_write(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
+{
+    int         non_transferred_sectors;
+    hdd_mmap_t *map = hdd_images[id].map;
+    uint64_t    offset;
+
+    if (!hdd_images[id].loaded)
+        return 0;
+
+    if ((map != NULL) && map->writable) {
+        offset = ((uint64_t) sector << 9) + hdd_images[id].base;
+        count  = hdd_image_mmap_clamp(map, offset, count);
+
+        if (count > 0) {
+            memcpy(map->data + offset, buffer, count << 9);
+
+            for (uint64_t c = offset >> HDD_MMAP_CHUNK_SHIFT;
+                 c <= ((offset + (count << 9) - 1) >> HDD_MMAP_CHUNK_SHIFT); c++)
+                map->dirty[c] = 1;
+
+            map->any_dirty = 1;
         }
 
-        num_read           = fread(buffer, 512, count, hdd_images[id].file);
-        hdd_images[id].pos = sector + num_read;
+        return (int) count;
+    } else if (hdd_images[id].type == HDD_IMAGE_VHD) {
+        non_transferred_sectors = mvhd_write_sectors(hdd_images[id].vhd, sector, count, buffer);
+        return (int) count - non_transferred_sectors;
+    } else {
+        if (fseeko64(hdd_images[id].file, ((uint64_t) (sector) << 9LL) + hdd_images[id].base, SEEK_SET) == -1)
+            return -1;
+
+        return (int) fwrite(buffer, 512, count, hdd_images[id].file);
     }
 }
 
+static int
+hdd_image_do_write(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
+{
+    if (hdd_images[id].ovl != NULL) {
+        if (hdd_overlay_write(hdd_images[id].ovl, sector, count, buffer,
+                              hdd_image_overlay_base_read, (void *) (intptr_t) id) < 0)
+            return -1;
+        return (int) count;
+    }
+
+    return hdd_image_base_write(id, sector, count, buffer);
+}
+
+/* Finish a transfer on the emulation thread. */
+static void
+hdd_image_io_done(uint8_t id, int write, uint32_t sector, int ret)
+{
+    hdd_mmap_t *map = hdd_images[id].map;
+
+    if (ret < 0) {
+        fatal("Hard disk image %i: Error %s sector %i\n", id, write ? "writing" : "reading", sector);
+        return;
+    }
+
+    hdd_images[id].pos = sector + ret;
+
+    if (write && (map != NULL) && map->any_dirty && !timer_is_on(&map->timer))
+        timer_on_auto(&map->timer, HDD_MMAP_FLUSH_USEC);
+}
+
+/* VHD images cache their block allocation table and sector bitmaps, which
+   are written back by a background timer, on reset and on close, so a host
+   crash loses at most the last second of block allocations. */
+static void
+hdd_image_vhd_timer(void *priv)
+{
+    hdd_image_t *img = (hdd_image_t *) priv;
+
+    hdd_image_flush((uint8_t) (img - hdd_images));
+}
+
+static void
+hdd_image_vhd_start(uint8_t id)
+{
+    if ((hdd_images[id].type != HDD_IMAGE_VHD) || (hdd_images[id].vhd == NULL))
+        return;
+
+    timer_add(&hdd_images[id].vhd_timer, hdd_image_vhd_timer, &hdd_images[id], 0);
+}
+
+static void
+hdd_image_vhd_stop(uint8_t id)
+{
+    /* mvhd_close() writes back whatever is still cached. */
+    timer_stop(&hdd_images[id].vhd_timer);
+    hdd_images[id].vhd_dirty = 0;
+}
+
+/* Called on the emulation thread after every write to a VHD image. */
+static void
+hdd_image_vhd_dirty(uint8_t id)
+{
+    if ((hdd_images[id].type != HDD_IMAGE_VHD) || (hdd_images[id].ovl != NULL) || hdd_images[id].vhd_dirty)
+        return;
+
+    hdd_images[id].vhd_dirty = 1;
+    timer_on_auto(&hdd_images[id].vhd_timer, HDD_VHD_FLUSH_USEC);
+}
+
+/* Write everything cached for the image back to the file. */
+void
+hdd_image_flush(uint8_t id)
+{
+    if (!hdd_images[id].loaded)
+        return;
+
+    hdd_image_aio_drain(id);
+
+    if (hdd_images[id].map != NULL)
+        hdd_image_mmap_flush(id, 1);
+    else if (hdd_images[id].vhd != NULL) {
+        if (hdd_images[id].vhd_dirty) {
+            timer_stop(&hdd_images[id].vhd_timer);
+            mvhd_flush(hdd_images[id].vhd);
+            hdd_images[id].vhd_dirty = 0;
+        }
+    } else if (hdd_images[id].file != NULL)
+        fflush(hdd_images[id].file);
+}
+
+/* Asynchronous I/O.
+
+   Each loaded image may get a queue serviced by a dedicated worker thread.
+   Requests are executed strictly in submission order, so the worker is the
+   only thread touching the image while anything is outstanding; synchronous
+   accesses from the emulation thread drain the queue first. The worker only
+   records each request's result; errors are reported, the position updated
+   and completion callbacks run on the emulation thread, either from the
+   image's poll timer or from hdd_image_aio_wait(). */
+static void
+hdd_image_aio_thread(void *priv)
+{
+    hdd_image_t   *img = (hdd_image_t *) priv;
+    hdd_aio_t     *aio = img->aio;
+    hdd_aio_req_t *req;
+    uint8_t        id  = (uint8_t) (img - hdd_images);
+    int            stop = 0;
+
+    while (1) {
+        thread_wait_event(aio->wake_ev, -1);
+        thread_reset_event(aio->wake_ev);
+
+        while (1) {
+            thread_wait_mutex(aio->mutex);
+            if (aio->executed == aio->submitted) {
+                stop = aio->stop;
+                thread_release_mutex(aio->mutex);
+                break;
+            }
+            req = &aio->reqs[aio->executed % aio->depth];
+            thread_release_mutex(aio->mutex);
+
+            if (req->write)
+                req->ret = hdd_image_do_write(id, req->sector, req->count, req->buffer);
+            else
+                req->ret = hdd_image_do_read(id, req->sector, req->count, req->buffer);
+
+            thread_wait_mutex(aio->mutex);
+            aio->executed++;
+            thread_release_mutex(aio->mutex);
+            thread_set_event(aio->done_ev);
+        }
+
+        if (stop)
+            break;
+    }
+}
+
+/* Run the callbacks of all finished requests up to (not including) seq. */
+static void
+hdd_image_aio_retire(hdd_aio_t *aio, uint32_t seq)
+{
+    hdd_aio_req_t *req;
+    uint32_t       executed;
+
+    thread_wait_mutex(aio->mutex);
+    executed = aio->executed;
+    thread_release_mutex(aio->mutex);
+
+    if ((int32_t) (seq - executed) > 0)
+        seq = executed;
+
+    while (aio->retired != seq) {
+        req = &aio->reqs[aio->retired % aio->depth];
+        aio->retired++;
+
+        hdd_image_io_done(aio->id, req->write, req->sector, req->ret);
+        if (req->write) {
+            free(req->buffer);
+            req->buffer = NULL;
+        }
+        if (req->callback)
+            req->callback(req->priv, (req->ret < 0) ? -1 : 0);
+    }
+}
+
+/* Block until the worker has executed everything before seq. */
+static void
+hdd_image_aio_wait_executed(hdd_aio_t *aio, uint32_t seq)
+{
+    while (1) {
+        thread_wait_mutex(aio->mutex);
+        if ((int32_t) (seq - aio->executed) <= 0) {
+            thread_release_mutex(aio->mutex);
+            break;
+        }
+        thread_reset_event(aio->done_ev);
+        thread_release_mutex(aio->mutex);
+
+        thread_wait_event(aio->done_ev, -1);
+    }
+}
+
+static void
+hdd_image_aio_poll(void *priv)
+{
+    hdd_aio_t *aio = (hdd_aio_t *) priv;
+
+    hdd_image_aio_retire(aio, aio->submitted);
+
+    if (aio->retired != aio->submitted)
+        timer_on_auto(&aio->timer, HDD_AIO_POLL_USEC);
+}
+
+static void
+hdd_image_aio_start(uint8_t id)
+{
+    hdd_aio_t *aio;
+
+    if ((hdd_aio_queue_depth <= 0) || (hdd_images[id].aio != NULL))
+        return;
+
+    aio = (hdd_aio_t *) calloc(1, sizeof(hdd_aio_t));
+
+    aio->id           = id;
+    aio->depth        = hdd_aio_queue_depth;
+    aio->max_inflight = hdd_aio_max_inflight;
+    if ((aio->max_inflight == 0) || (aio->max_inflight > aio->depth))
+        aio->max_inflight = aio->depth;
+    aio->reqs = (hdd_aio_req_t *) calloc(aio->depth, sizeof(hdd_aio_req_t));
+
+    aio->mutex   = thread_create_mutex();
+    aio->wake_ev = thread_create_event();
+    aio->done_ev = thread_create_event();
+
+    timer_add(&aio->timer, hdd_image_aio_poll, aio, 0);
+
+    hdd_images[id].aio = aio;
+    aio->thread        = thread_create(hdd_image_aio_thread, &hdd_images[id]);
+
+    hdd_image_log("Hard disk image %i: Asynchronous I/O enabled (depth %i, in flight %i)\n",
+                  id, aio->depth, aio->max_inflight);
+}
+
+static void
+hdd_image_aio_stop(uint8_t id)
+{
+    hdd_aio_t *aio = hdd_images[id].aio;
+
+    if (aio == NULL)
+        return;
+
+    hdd_image_aio_drain(id);
+
+    thread_wait_mutex(aio->mutex);
+    aio->stop = 1;
+    thread_release_mutex(aio->mutex);
+    thread_set_event(aio->wake_ev);
+    thread_wait(aio->thread);
+
+    timer_stop(&aio->timer);
+
+    thread_destroy_event(aio->done_ev);
+    thread_destroy_event(aio->wake_ev);
+    thread_close_mutex(aio->mutex);
+
+    free(aio->reqs);
+    free(aio);
+
+    hdd_images[id].aio = NULL;
+}
+
+uint32_t
+hdd_image_aio_submit(uint8_t id, int write, uint32_t sector, uint32_t count, uint8_t *buffer,
+                     void (*callback)(void *priv, int ret), void *priv)
+{
+    hdd_aio_t     *aio = hdd_images[id].aio;
+    hdd_aio_req_t *req;
+    uint32_t       seq;
+    int            ret;
+
+    if (write)
+        hdd_image_vhd_dirty(id);
+
+    if (aio == NULL) {
+        /* No queue, do it right now. */
+        if (write)
+            ret = hdd_image_do_write(id, sector, count, buffer);
+        else
+            ret = hdd_image_do_read(id, sector, count, buffer);
+        hdd_image_io_done(id, write, sector, ret);
+        if (callback)
+            callback(priv, (ret < 0) ? -1 : 0);
+        return 0;
+    }
+
+    /* Wait for a free ring slot and an in-flight slot. */
+    if ((aio->submitted - aio->retired) >= aio->depth) {
+        hdd_image_aio_wait_executed(aio, aio->retired + 1);
+        hdd_image_aio_retire(aio, aio->retired + 1);
+    }
+    hdd_image_aio_wait_executed(aio, aio->submitted - aio->max_inflight + 1);
+
+    req           = &aio->reqs[aio->submitted % aio->depth];
+    req->write    = !!write;
+    req->sector   = sector;
+    req->count    = count;
+    req->ret      = 0;
+    req->callback = callback;
+    req->priv     = priv;
+    if (write) {
+        req->buffer = (uint8_t *) malloc(count << 9);
+        memcpy(req->buffer, buffer, count << 9);
+    } else
+        req->buffer = buffer;
+
+    thread_wait_mutex(aio->mutex);
+    seq = ++aio->submitted;
+    thread_release_mutex(aio->mutex);
+    thread_set_event(aio->wake_ev);
+
+    if (!timer_is_on(&aio->timer))
+        timer_on_auto(&aio->timer, HDD_AIO_POLL_USEC);
+
+    return seq;
+}
+
+void
+hdd_image_aio_wait(uint8_t id, uint32_t tag)
+{
+    hdd_aio_t *aio = hdd_images[id].aio;
+
+    if ((aio == NULL) || (tag == 0))
+        return;
+
+    hdd_image_aio_wait_executed(aio, tag);
+    hdd_image_aio_retire(aio, tag);
+}
+
+/* Whether the image has a queue, without one requests run synchronously. */
+int
+hdd_image_aio_enabled(uint8_t id)
+{
+    return hdd_images[id].aio != NULL;
+}
+
+void
+hdd_image_aio_drain(uint8_t id)
+{
+    hdd_aio_t *aio = hdd_images[id].aio;
+
+    if (aio != NULL)
+        hdd_image_aio_wait(id, aio->submitted);
+}
+
+void
+hdd_image_read(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
+{
+    hdd_image_aio_drain(id);
+    hdd_image_io_done(id, 0, sector, hdd_image_do_read(id, sector, count, buffer));
+}
+
 uint32_t
 hdd_image_get_last_sector(uint8_t id)
 {
@@ -551,20 +1182,14 @@ hdd_image_read_ex(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
 void
 hdd_image_write(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
 {
-    int    non_transferred_sectors;
-    size_t num_write;
-
-    if (hdd_images[id].type == HDD_IMAGE_VHD) {
-        non_transferred_sectors = mvhd_write_sectors(hdd_images[id].vhd, sector, count, buffer);
-        hdd_images[id].pos      = sector + count - non_transferred_sectors - 1;
-    } else {
-        if (fseeko64(hdd_images[id].file, ((uint64_t) (sector) << 9LL) + hdd_images[id].base, SEEK_SET) == -1) {
-            fatal("Hard disk image %i: Write error during seek\n", id);
-            return;
-        }
-
-        num_write          = fwrite(buffer, 512, count, hdd_images[id].file);
-        hdd_images[id].pos = sector + num_write;
+    /* Writes are queued behind any outstanding requests when asynchronous
+       I/O is enabled; the data is copied, so the caller may reuse the buffer
+       right away. */
+    if (hdd_images[id].aio != NULL)
+        (void) hdd_image_aio_submit(id, 1, sector, count, buffer, NULL, NULL);
+    else {
+        hdd_image_io_done(id, 1, sector, hdd_image_do_write(id, sector, count, buffer));
+        hdd_image_vhd_dirty(id);
     }
 }
 
@@ -587,9 +1212,21 @@ hdd_image_write_ex(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
 void
 hdd_image_zero(uint8_t id, uint32_t sector, uint32_t count)
 {
-    if (hdd_images[id].type == HDD_IMAGE_VHD) {
+    hdd_image_aio_drain(id);
+
+    if (!hdd_images[id].loaded)
+        return;
+
+    if ((hdd_images[id].ovl != NULL) ||
+        ((hdd_images[id].map != NULL) && hdd_images[id].map->writable)) {
+        memset(empty_sector, 0, 512);
+
+        for (uint32_t i = 0; i < count; i++)
+            hdd_image_io_done(id, 1, sector + i, hdd_image_do_write(id, sector + i, 1, (uint8_t *) empty_sector));
+    } else if (hdd_images[id].type == HDD_IMAGE_VHD) {
         int non_transferred_sectors = mvhd_format_sectors(hdd_images[id].vhd, sector, count);
         hdd_images[id].pos          = sector + count - non_transferred_sectors - 1;
+        hdd_image_vhd_dirty(id);
     } else {
         memset(empty_sector, 0, 512);
 
@@ -642,6 +1279,13 @@ hdd_image_unload(uint8_t id, UNUSED(int fn_preserve))
     if (strlen(hdd[id].fn) == 0)
         return;
 
+    hdd_image_aio_stop(id);
+    hdd_image_mmap_stop(id);
+    hdd_image_vhd_stop(id);
+
+    hdd_overlay_close(hdd_images[id].ovl);
+    hdd_images[id].ovl = NULL;
+
     if (hdd_images[id].loaded) {
         if (hdd_images[id].file != NULL) {
             fclose(hdd_images[id].file);
@@ -663,6 +1307,13 @@ hdd_image_close(uint8_t id)
 {
     hdd_image_log("hdd_image_close(%i)\n", id);
 
+    hdd_image_aio_stop(id);
+    hdd_image_mmap_stop(id);
+    hdd_image_vhd_stop(id);
+
+    hdd_overlay_close(hdd_images[id].ovl);
+    hdd_images[id].ovl = NULL;
+
     if (!hdd_images[id].loaded)
         return;
 
@@ -677,3 +1328,104 @@ hdd_image_close(uint8_t id)
     memset(&hdd_images[id], 0, sizeof(hdd_image_t));
     hdd_images[id].loaded = 0;
 }
+
+/* Write the blocks of the overlay into the base image, and empty the overlay
+   if all of them made it to the file. Returns 0 if there is no overlay or the
+   base image could not be written, in which case the overlay is kept. */
+int
+hdd_image_overlay_commit(uint8_t id)
+{
+    hdd_overlay_t *ovl = hdd_images[id].ovl;
+    uint32_t       block_sectors;
+    uint32_t       first;
+    uint32_t       count;
+    uint8_t       *buf;
+    int            ret = 1;
+
+    if (ovl == NULL)
+        return 0;
+
+    /* Reopen the base image for writing, with the overlay detached. */
+    hdd_image_aio_stop(id);
+    hdd_image_mmap_stop(id);
+    hdd_image_vhd_stop(id);
+
+    hdd_images[id].ovl     = NULL;
+    hdd_images[id].base_ro = 0;
+    if (!hdd_image_open(id)) {
+        pclog("Hard disk image %i: Unable to reopen base image for writing\n", id);
+        ret = 0;
+    }
+
+    block_sectors = hdd_overlay_get_block_sectors(ovl);
+    buf           = (uint8_t *) malloc(block_sectors << 9);
+
+    for (uint32_t b = 0; ret && (b < hdd_overlay_get_blocks(ovl)); b++) {
+        if (!hdd_overlay_block_present(ovl, b))
+            continue;
+
+        first = b * block_sectors;
+        count = block_sectors;
+        if ((first + count) > (hdd_images[id].last_sector + 1))
+            count = hdd_images[id].last_sector + 1 - first;
+
+        if ((hdd_overlay_read_block(ovl, b, buf) < 0) ||
+            (hdd_image_base_write(id, first, count, buf) != (int) count)) {
+            pclog("Hard disk image %i: Error writing overlay block %i to base image\n", id, b);
+            ret = 0;
+        }
+    }
+
+    free(buf);
+
+    /* Make sure it all reached the file before the overlay is emptied. */
+    if (ret) {
+        if (hdd_images[id].type == HDD_IMAGE_VHD) {
+            mvhd_flush(hdd_images[id].vhd);
+            ret = !ferror(hdd_images[id].vhd->f);
+        } else
+            ret = !fflush(hdd_images[id].file) && !ferror(hdd_images[id].file);
+        if (!ret)
+            pclog("Hard disk image %i: Error flushing base image\n", id);
+    }
+
+    /* Back to a read-only base, with an empty overlay if the commit worked. */
+    hdd_images[id].base_ro = 1;
+    if (!hdd_image_open(id)) {
+        /* The changes are still in the overlay file, but without its base
+           image the disk can not be used any more; it reads as zeroes and
+           drops writes from here on. */
+        pclog("Hard disk image %i: Unable to reopen base image, detaching disk\n", id);
+        hdd_overlay_close(ovl);
+        hdd_image_close(id);
+        return 0;
+    }
+
+    hdd_images[id].ovl = ovl;
+    if (ret)
+        hdd_overlay_discard(ovl);
+
+    hdd_image_vhd_start(id);
+    hdd_image_mmap_start(id);
+    if (hdd_images[id].map == NULL)
+        hdd_image_aio_start(id);
+
+    return ret;
+}
+
+int
+hdd_image_overlay_discard(uint8_t id)
+{
+    if (hdd_images[id].ovl == NULL)
+        return 0;
+
+    hdd_image_aio_drain(id);
+
+    return hdd_overlay_discard(hdd_images[id].ovl);
+}
+
+int
+hdd_image_has_overlay(uint8_t id)
+{
+    return (hdd_images[id].ovl != NULL);
+}
@@ -0,0 +1,383 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Handling of copy-on-write hard disk overlay files.
+ *
+ *          An overlay holds every block written to a disk whose base
+ *          image is shared read-only between several machines. The file
+ *          consists of a 512-byte header, an index with one 32-bit entry
+ *          per block of the disk (0 = block is in the base image, otherwise
+ *          the number of the data block in the overlay plus one), and the
+ *          data blocks, appended in allocation order. The index is kept in
+ *          memory, so locating a sector is a single table lookup.
+ *
+ *
+ *
+ * Authors: agent, <agent@local>
+ *
+ *          Copyright 2026 agent.
+ */
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <wchar.h>
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include <86box/plat.h>
+#include <86box/hdd.h>
+
+#define HDD_OVERLAY_MAGIC        "86BoxOVL"
+#define HDD_OVERLAY_VERSION      1
+#define HDD_OVERLAY_HEADER_SIZE  512
+#define HDD_OVERLAY_BLOCK_SECTS  128 /* 64 kB blocks. */
+#define HDD_OVERLAY_ALIGN        4096
+
+#pragma pack(push, 1)
+typedef struct hdd_overlay_header_t {
+    char     magic[8];
+    uint32_t version;
+    uint32_t block_sectors;
+    uint32_t blocks;
+    uint32_t reserved;
+    uint64_t sectors;
+    uint64_t data_offset;
+} hdd_overlay_header_t;
+#pragma pack(pop)
+
+struct hdd_overlay_t {
+    char      fn[1024];
+    FILE     *fp;
+    uint32_t *index;
+    uint32_t  blocks;
+    uint32_t  block_sectors;
+    uint32_t  allocated;
+    uint64_t  sectors;
+    uint64_t  data_offset;
+    uint8_t  *block_buf;
+};
+
+#ifdef ENABLE_HDD_OVERLAY_LOG
+int hdd_overlay_do_log = ENABLE_HDD_OVERLAY_LOG;
+
+static void
+hdd_overlay_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (hdd_overlay_do_log) {
+        va_start(ap, fmt);
+        pclog_ex(fmt, ap);
+        va_end(ap);
+    }
+}
+#else
+#    define hdd_overlay_log(fmt, ...)
+#endif
+
+static uint64_t
+hdd_overlay_block_offset(hdd_overlay_t *ovl, uint32_t data_block)
+{
+    return ovl->data_offset + ((uint64_t) data_block * ovl->block_sectors * 512);
+}
+
+/* Write a fresh header and an empty index, dropping any data blocks. */
+static int
+hdd_overlay_format(hdd_overlay_t *ovl)
+{
+    hdd_overlay_header_t hdr;
+    uint8_t              pad[HDD_OVERLAY_HEADER_SIZE - sizeof(hdd_overlay_header_t)];
+    uint64_t             pos;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, HDD_OVERLAY_MAGIC, 8);
+    hdr.version       = HDD_OVERLAY_VERSION;
+    hdr.block_sectors = ovl->block_sectors;
+    hdr.blocks        = ovl->blocks;
+    hdr.sectors       = ovl->sectors;
+    hdr.data_offset   = ovl->data_offset;
+
+    memset(pad, 0, sizeof(pad));
+    memset(ovl->index, 0, ovl->blocks * sizeof(uint32_t));
+    ovl->allocated = 0;
+
+    if ((fseeko64(ovl->fp, 0, SEEK_SET) == -1) ||
+        (fwrite(&hdr, 1, sizeof(hdr), ovl->fp) != sizeof(hdr)) ||
+        (fwrite(pad, 1, sizeof(pad), ovl->fp) != sizeof(pad)) ||
+        (fwrite(ovl->index, sizeof(uint32_t), ovl->blocks, ovl->fp) != ovl->blocks))
+        return 0;
+
+    /* Pad the index up to the first data block. */
+    pos = HDD_OVERLAY_HEADER_SIZE + ((uint64_t) ovl->blocks * sizeof(uint32_t));
+    while (pos < ovl->data_offset) {
+        fputc(0, ovl->fp);
+        pos++;
+    }
+
+    fflush(ovl->fp);
+
+    return 1;
+}
+
+hdd_overlay_t *
+hdd_overlay_open(const char *fn, uint64_t sectors)
+{
+    hdd_overlay_t       *ovl;
+    hdd_overlay_header_t hdr;
+    int64_t              size;
+    uint64_t             file_blocks = 0;
+
+    ovl = (hdd_overlay_t *) calloc(1, sizeof(hdd_overlay_t));
+    strncpy(ovl->fn, fn, sizeof(ovl->fn) - 1);
+
+    ovl->fp = plat_fopen(fn, "rb+");
+    if (ovl->fp != NULL) {
+        if ((fread(&hdr, 1, sizeof(hdr), ovl->fp) != sizeof(hdr)) ||
+            memcmp(hdr.magic, HDD_OVERLAY_MAGIC, 8) || (hdr.version != HDD_OVERLAY_VERSION) ||
+            (hdr.sectors != sectors) || (hdr.block_sectors == 0) ||
+            (hdr.blocks != ((sectors + hdr.block_sectors - 1) / hdr.block_sectors)) ||
+            (hdr.data_offset < (HDD_OVERLAY_HEADER_SIZE + ((uint64_t) hdr.blocks * sizeof(uint32_t))))) {
+            hdd_overlay_log("Overlay %s: Invalid header or size mismatch\n", fn);
+            goto fail;
+        }
+
+        ovl->block_sectors = hdr.block_sectors;
+        ovl->blocks        = hdr.blocks;
+        ovl->sectors       = hdr.sectors;
+        ovl->data_offset   = hdr.data_offset;
+        ovl->index         = (uint32_t *) calloc(ovl->blocks, sizeof(uint32_t));
+
+        if ((fseeko64(ovl->fp, HDD_OVERLAY_HEADER_SIZE, SEEK_SET) == -1) ||
+            (fread(ovl->index, sizeof(uint32_t), ovl->blocks, ovl->fp) != ovl->blocks)) {
+            hdd_overlay_log("Overlay %s: Truncated index\n", fn);
+            goto fail;
+        }
+
+        /* Every data block the index points to has to be in the file. */
+        if (fseeko64(ovl->fp, 0, SEEK_END) == -1)
+            goto fail;
+        size = ftello64(ovl->fp);
+        if (size > (int64_t) ovl->data_offset)
+            file_blocks = ((uint64_t) size - ovl->data_offset) / ((uint64_t) ovl->block_sectors * 512);
+
+        for (uint32_t b = 0; b < ovl->blocks; b++) {
+            if (ovl->index[b] > file_blocks) {
+                hdd_overlay_log("Overlay %s: Block %u points past the end of the file\n", fn, b);
+                goto fail;
+            }
+            if (ovl->index[b] > ovl->allocated)
+                ovl->allocated = ovl->index[b];
+        }
+    } else {
+        /* Creating an overlay only writes the header and the index, so a new
+           machine can start from a shared base image right away. */
+        ovl->fp = plat_fopen(fn, "wb+");
+        if (ovl->fp == NULL) {
+            free(ovl);
+            return NULL;
+        }
+
+        ovl->block_sectors = HDD_OVERLAY_BLOCK_SECTS;
+        ovl->sectors       = sectors;
+        ovl->blocks        = (uint32_t) ((sectors + ovl->block_sectors - 1) / ovl->block_sectors);
+        ovl->data_offset   = HDD_OVERLAY_HEADER_SIZE + ((uint64_t) ovl->blocks * sizeof(uint32_t));
+        ovl->data_offset   = (ovl->data_offset + HDD_OVERLAY_ALIGN - 1) & ~((uint64_t) HDD_OVERLAY_ALIGN - 1);
+        ovl->index         = (uint32_t *) calloc(ovl->blocks, sizeof(uint32_t));
+
+        if (!hdd_overlay_format(ovl))
+            fatal("hdd_overlay_open(): Error creating %s\n", fn);
+    }
+
+    ovl->block_buf = (uint8_t *) malloc(ovl->block_sectors * 512);
+
+    hdd_overlay_log("Overlay %s: %u blocks of %u sectors, %u allocated\n", fn,
+                    ovl->blocks, ovl->block_sectors, ovl->allocated);
+
+    return ovl;
+
+fail:
+    fclose(ovl->fp);
+    free(ovl->index);
+    free(ovl);
+    return NULL;
+}
+
+void
+hdd_overlay_close(hdd_overlay_t *ovl)
+{
+    if (ovl == NULL)
+        return;
+
+    fclose(ovl->fp);
+    free(ovl->block_buf);
+    free(ovl->index);
+    free(ovl);
+}
+
+uint32_t
+hdd_overlay_get_blocks(hdd_overlay_t *ovl)
+{
+    return ovl->blocks;
+}
+
+uint32_t
+hdd_overlay_get_block_sectors(hdd_overlay_t *ovl)
+{
+    return ovl->block_sectors;
+}
+
+int
+hdd_overlay_block_present(hdd_overlay_t *ovl, uint32_t block)
+{
+    return (block < ovl->blocks) && (ovl->index[block] != 0);
+}
+
+/* Read a run of sectors that lies within a single block present in the
+   overlay. Returns 0 on success, -1 on error. */
+static int
+hdd_overlay_read_run(hdd_overlay_t *ovl, uint32_t block, uint32_t offset, uint32_t count, uint8_t *buffer)
+{
+    uint64_t addr = hdd_overlay_block_offset(ovl, ovl->index[block] - 1) + ((uint64_t) offset << 9);
+
+    if ((fseeko64(ovl->fp, addr, SEEK_SET) == -1) || (fread(buffer, 512, count, ovl->fp) != count)) {
+        hdd_overlay_log("hdd_overlay_read(): Error reading block %i\n", block);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* The I/O functions below may run on an asynchronous I/O worker, so they
+   return 0 on success and -1 on error instead of calling fatal(), which the
+   caller reports from the emulation thread. base_read returns the same. */
+int
+hdd_overlay_read(hdd_overlay_t *ovl, uint32_t sector, uint32_t count, uint8_t *buffer,
+                 int (*base_read)(void *priv, uint32_t sector, uint32_t count, uint8_t *buffer),
+                 void *priv)
+{
+    uint32_t block;
+    uint32_t offset;
+    uint32_t run;
+    uint32_t base_start = 0;
+    uint32_t base_count = 0;
+
+    while (count > 0) {
+        block  = sector / ovl->block_sectors;
+        offset = sector % ovl->block_sectors;
+        run    = ovl->block_sectors - offset;
+        if (run > count)
+            run = count;
+
+        if (hdd_overlay_block_present(ovl, block)) {
+            if (base_count > 0) {
+                if (base_read(priv, base_start, base_count, buffer - (base_count << 9)) < 0)
+                    return -1;
+                base_count = 0;
+            }
+            if (hdd_overlay_read_run(ovl, block, offset, run, buffer) < 0)
+                return -1;
+        } else {
+            /* Coalesce consecutive runs from the base image. */
+            if (base_count == 0)
+                base_start = sector;
+            base_count += run;
+        }
+
+        sector += run;
+        count -= run;
+        buffer += (run << 9);
+    }
+
+    if ((base_count > 0) && (base_read(priv, base_start, base_count, buffer - (base_count << 9)) < 0))
+        return -1;
+
+    return 0;
+}
+
+int
+hdd_overlay_write(hdd_overlay_t *ovl, uint32_t sector, uint32_t count, uint8_t *buffer,
+                  int (*base_read)(void *priv, uint32_t sector, uint32_t count, uint8_t *buffer),
+                  void *priv)
+{
+    uint32_t block;
+    uint32_t offset;
+    uint32_t run;
+    uint32_t first;
+    uint32_t n;
+    uint64_t addr;
+
+    while (count > 0) {
+        block  = sector / ovl->block_sectors;
+        offset = sector % ovl->block_sectors;
+        run    = ovl->block_sectors - offset;
+        if (run > count)
+            run = count;
+
+        if (block >= ovl->blocks)
+            break;
+
+        if (!ovl->index[block]) {
+            /* First write to this block: copy it from the base image, merge
+               in the new data, append it, then publish it in the index. */
+            first = block * ovl->block_sectors;
+            n     = ovl->block_sectors;
+            if ((first + n) > ovl->sectors)
+                n = (uint32_t) (ovl->sectors - first);
+
+            if ((run < n) && (base_read(priv, first, n, ovl->block_buf) < 0))
+                return -1;
+            memcpy(ovl->block_buf + (offset << 9), buffer, run << 9);
+
+            addr = hdd_overlay_block_offset(ovl, ovl->allocated);
+            if ((fseeko64(ovl->fp, addr, SEEK_SET) == -1) ||
+                (fwrite(ovl->block_buf, 512, ovl->block_sectors, ovl->fp) != ovl->block_sectors)) {
+                hdd_overlay_log("hdd_overlay_write(): Error writing block %i\n", block);
+                return -1;
+            }
+
+            ovl->index[block] = ++ovl->allocated;
+            if ((fseeko64(ovl->fp, HDD_OVERLAY_HEADER_SIZE + ((uint64_t) block << 2), SEEK_SET) == -1) ||
+                (fwrite(&ovl->index[block], sizeof(uint32_t), 1, ovl->fp) != 1)) {
+                hdd_overlay_log("hdd_overlay_write(): Error writing index of block %i\n", block);
+                return -1;
+            }
+        } else {
+            addr = hdd_overlay_block_offset(ovl, ovl->index[block] - 1) + ((uint64_t) offset << 9);
+            if ((fseeko64(ovl->fp, addr, SEEK_SET) == -1) ||
+                (fwrite(buffer, 512, run, ovl->fp) != run)) {
+                hdd_overlay_log("hdd_overlay_write(): Error writing block %i\n", block);
+                return -1;
+            }
+        }
+
+        sector += run;
+        count -= run;
+        buffer += (run << 9);
+    }
+
+    return 0;
+}
+
+int
+hdd_overlay_read_block(hdd_overlay_t *ovl, uint32_t block, uint8_t *buffer)
+{
+    return hdd_overlay_read_run(ovl, block, 0, ovl->block_sectors, buffer);
+}
+
+int
+hdd_overlay_discard(hdd_overlay_t *ovl)
+{
+    /* Recreate the file, so that it shrinks back down to the empty index. */
+    fclose(ovl->fp);
+    ovl->fp = plat_fopen(ovl->fn, "wb+");
+    if (ovl->fp == NULL)
+        fatal("hdd_overlay_discard(): Error recreating %s\n", ovl->fn);
+
+    return hdd_overlay_format(ovl);
+}
@@ -61,10 +61,24 @@
 #define MVHD_START_TS          946684800
 
 
+#define MVHD_BITMAP_CACHE_SIZE 16
+
+
+typedef struct MVHDBitmapCacheEntry {
+    uint8_t* bitmap;
+    int      block;
+    bool     dirty;
+    uint32_t last_use;
+} MVHDBitmapCacheEntry;
+
 typedef struct MVHDSectorBitmap {
-    uint8_t* curr_bitmap;
-    int      sector_count;
-    int      curr_block;
+    uint8_t*             curr_bitmap;
+    int                  sector_count;
+    int                  curr_block;
+    uint8_t*             cache_data;
+    MVHDBitmapCacheEntry cache[MVHD_BITMAP_CACHE_SIZE];
+    int                  curr_entry;
+    uint32_t             use_counter;
 } MVHDSectorBitmap;
 
 typedef struct MVHDFooter {
@@ -120,6 +134,8 @@ struct MVHDMeta {
     MVHDFooter       footer;
     MVHDSparseHeader sparse;
     uint32_t*        block_offset;
+    int              bat_dirty_first;
+    int              bat_dirty_last;
     int              sect_per_block;
     MVHDSectorBitmap bitmap;
     int (*read_sectors)(struct MVHDMeta*, uint32_t, int, void*);
@@ -389,6 +405,8 @@ int mvhd_sparse_diff_write(struct MVHDMeta* vhdm, uint32_t offset, int num_secto
  */
 int mvhd_noop_write(struct MVHDMeta* vhdm, uint32_t offset, int num_sectors, void* in_buff);
 
+void mvhd_flush_cache(struct MVHDMeta* vhdm);
+
 /**
  * \brief Save the contents of a VHD footer from a buffer to a struct
  * 
@@ -194,13 +194,28 @@ calc_sparse_values(MVHDMeta* vhdm)
 static int
 init_sector_bitmap(MVHDMeta* vhdm, MVHDError* err)
 {
-    vhdm->bitmap.curr_bitmap = calloc(vhdm->bitmap.sector_count, MVHD_SECTOR_SIZE);
-    if (vhdm->bitmap.curr_bitmap == NULL) {
+    size_t bm_size = (size_t) vhdm->bitmap.sector_count * MVHD_SECTOR_SIZE;
+
+    vhdm->bitmap.cache_data = calloc(MVHD_BITMAP_CACHE_SIZE, bm_size);
+    if (vhdm->bitmap.cache_data == NULL) {
         *err = MVHD_ERR_MEM;
         return -1;
     }
 
+    for (int i = 0; i < MVHD_BITMAP_CACHE_SIZE; i++) {
+        vhdm->bitmap.cache[i].bitmap = vhdm->bitmap.cache_data + (i * bm_size);
+        vhdm->bitmap.cache[i].block = -1;
+        vhdm->bitmap.cache[i].dirty = false;
+        vhdm->bitmap.cache[i].last_use = 0;
+    }
+
+    vhdm->bitmap.curr_entry = 0;
+    vhdm->bitmap.curr_bitmap = vhdm->bitmap.cache[0].bitmap;
     vhdm->bitmap.curr_block = -1;
+    vhdm->bitmap.use_counter = 0;
+
+    vhdm->bat_dirty_first = -1;
+    vhdm->bat_dirty_last = -1;
 
     return 0;
 }
@@ -595,7 +610,8 @@ cleanup_format_buff:
     vhdm->format_buffer.zero_data = NULL;
 
 cleanup_bitmap:
-    free(vhdm->bitmap.curr_bitmap);
+    free(vhdm->bitmap.cache_data);
+    vhdm->bitmap.cache_data = NULL;
     vhdm->bitmap.curr_bitmap = NULL;
 
 cleanup_bat:
@@ -624,14 +640,17 @@ mvhd_close(MVHDMeta* vhdm)
     if (vhdm->parent != NULL)
         mvhd_close(vhdm->parent);
 
+    mvhd_flush_cache(vhdm);
+
     fclose(vhdm->f);
 
     if (vhdm->block_offset != NULL) {
         free(vhdm->block_offset);
         vhdm->block_offset = NULL;
     }
-    if (vhdm->bitmap.curr_bitmap != NULL) {
-        free(vhdm->bitmap.curr_bitmap);
+    if (vhdm->bitmap.cache_data != NULL) {
+        free(vhdm->bitmap.cache_data);
+        vhdm->bitmap.cache_data = NULL;
         vhdm->bitmap.curr_bitmap = NULL;
     }
     if (vhdm->format_buffer.zero_data != NULL) {
@@ -643,6 +662,17 @@ mvhd_close(MVHDMeta* vhdm)
 }
 
 
+MVHDAPI void
+mvhd_flush(MVHDMeta* vhdm)
+{
+    if (vhdm == NULL)
+        return;
+
+    mvhd_flush_cache(vhdm);
+    fflush(vhdm->f);
+}
+
+
 MVHDAPI int
 mvhd_diff_update_par_timestamp(MVHDMeta* vhdm, int* err)
 {
@@ -259,6 +259,16 @@ MVHDAPI MVHDMeta* mvhd_create_ex(MVHDCreationOptions options, int* err);
  */
 MVHDAPI void mvhd_close(MVHDMeta* vhdm);
 
+/**
+ * \brief Write any cached sector bitmaps and BAT entries to the image file
+ *
+ * Sector bitmaps and BAT entries are written back lazily. They are always
+ * written when the image is closed, but a caller may flush them earlier.
+ *
+ * \param [in] vhdm MiniVHD data structure to flush
+ */
+MVHDAPI void mvhd_flush(MVHDMeta* vhdm);
+
 /**
  * \brief Calculate hard disk geometry from a provided size
  *
@@ -56,9 +56,9 @@
  *
  * http://www.mathcs.emory.edu/~cheung/Courses/255/Syllabus/1-C-intro/bit-array.html
  */
-#define VHD_SETBIT(A,k)     ( A[(k>>3)] |= (0x80 >> (k&7)) )
-#define VHD_CLEARBIT(A,k)   ( A[(k>>3)] &= ~(0x80 >> (k&7)) )
-#define VHD_TESTBIT(A,k)    ( A[(k>>3)] & (0x80 >> (k&7)) )
+#define VHD_SETBIT(A,k)     ( A[((k)>>3)] |= (0x80 >> ((k)&7)) )
+#define VHD_CLEARBIT(A,k)   ( A[((k)>>3)] &= ~(0x80 >> ((k)&7)) )
+#define VHD_TESTBIT(A,k)    ( A[((k)>>3)] & (0x80 >> ((k)&7)) )
 
 /**
  * \brief Check that we will not be overflowing buffers
@@ -92,7 +92,30 @@ mvhd_write_empty_sectors(FILE *f, int sector_count)
 }
 
 /**
- * \brief Read the sector bitmap for a block.
+ * \brief Write a cached sector bitmap back to file, if it has been modified
+ *
+ * \param [in] vhdm MiniVHD data structure
+ * \param [in] entry The bitmap cache entry to write back
+ */
+static void
+write_sect_bitmap(MVHDMeta *vhdm, MVHDBitmapCacheEntry *entry)
+{
+    if (entry->dirty && (entry->block >= 0)) {
+        int64_t abs_offset = (int64_t)vhdm->block_offset[entry->block] * MVHD_SECTOR_SIZE;
+        mvhd_fseeko64(vhdm->f, abs_offset, SEEK_SET);
+        fwrite(entry->bitmap, MVHD_SECTOR_SIZE, vhdm->bitmap.sector_count, vhdm->f);
+    }
+
+    entry->dirty = false;
+}
+
+/**
+ * \brief Make the sector bitmap for a block the current one.
+ *
+ * Recently used sector bitmaps are kept in a small cache, so that
+ * alternating between blocks (or between the layers of a differencing
+ * VHD) does not re-read them from file every time. On a miss, the least
+ * recently used entry is written back if needed and replaced.
  *
  * If the block is sparse, the sector bitmap in memory will be
  * zeroed. Otherwise, the sector bitmap is read from the VHD file.
@@ -103,44 +126,102 @@ mvhd_write_empty_sectors(FILE *f, int sector_count)
 static void
 read_sect_bitmap(MVHDMeta *vhdm, int blk)
 {
+    MVHDBitmapCacheEntry *entry;
+    int                   victim = 0;
+
+    for (int i = 0; i < MVHD_BITMAP_CACHE_SIZE; i++) {
+        entry = &vhdm->bitmap.cache[i];
+        if (entry->block == blk) {
+            victim = i;
+            goto hit;
+        }
+
+        if (entry->last_use < vhdm->bitmap.cache[victim].last_use)
+            victim = i;
+    }
+
+    entry = &vhdm->bitmap.cache[victim];
+    write_sect_bitmap(vhdm, entry);
+
     if (vhdm->block_offset[blk] != MVHD_SPARSE_BLK) {
         mvhd_fseeko64(vhdm->f, (uint64_t)vhdm->block_offset[blk] * MVHD_SECTOR_SIZE, SEEK_SET);
-        (void) !fread(vhdm->bitmap.curr_bitmap, vhdm->bitmap.sector_count * MVHD_SECTOR_SIZE, 1, vhdm->f);
+        (void) !fread(entry->bitmap, vhdm->bitmap.sector_count * MVHD_SECTOR_SIZE, 1, vhdm->f);
     } else
-        memset(vhdm->bitmap.curr_bitmap, 0, vhdm->bitmap.sector_count * MVHD_SECTOR_SIZE);
+        memset(entry->bitmap, 0, vhdm->bitmap.sector_count * MVHD_SECTOR_SIZE);
 
+    entry->block = blk;
+
+hit:
+    vhdm->bitmap.cache[victim].last_use = ++vhdm->bitmap.use_counter;
+    vhdm->bitmap.curr_entry = victim;
+    vhdm->bitmap.curr_bitmap = vhdm->bitmap.cache[victim].bitmap;
     vhdm->bitmap.curr_block = blk;
 }
 
 /**
- * \brief Write the current sector bitmap in memory to file
+ * \brief Write the modified range of the BAT from memory into file
+ *
+ * BAT entries are only marked dirty when blocks are created, and are
+ * written back with a single write covering all of them.
  *
  * \param [in] vhdm MiniVHD data structure
  */
 static void
-write_curr_sect_bitmap(MVHDMeta* vhdm)
+write_bat(MVHDMeta *vhdm)
 {
-    if (vhdm->bitmap.curr_block >= 0) {
-        int64_t abs_offset = (int64_t)vhdm->block_offset[vhdm->bitmap.curr_block] * MVHD_SECTOR_SIZE;
-        mvhd_fseeko64(vhdm->f, abs_offset, SEEK_SET);
-        fwrite(vhdm->bitmap.curr_bitmap, MVHD_SECTOR_SIZE, vhdm->bitmap.sector_count, vhdm->f);
+    int       count;
+    uint32_t *be_offsets;
+
+    if (vhdm->bat_dirty_first < 0)
+        return;
+
+    count = vhdm->bat_dirty_last - vhdm->bat_dirty_first + 1;
+    be_offsets = malloc(count * sizeof *be_offsets);
+    if (be_offsets != NULL) {
+        for (int i = 0; i < count; i++)
+            be_offsets[i] = mvhd_to_be32(vhdm->block_offset[vhdm->bat_dirty_first + i]);
+
+        mvhd_fseeko64(vhdm->f, vhdm->sparse.bat_offset + ((uint64_t)vhdm->bat_dirty_first * sizeof *be_offsets), SEEK_SET);
+        fwrite(be_offsets, sizeof *be_offsets, count, vhdm->f);
+        free(be_offsets);
+    } else {
+        /* Fall back to writing the entries one by one */
+        for (int i = vhdm->bat_dirty_first; i <= vhdm->bat_dirty_last; i++) {
+            uint32_t offset = mvhd_to_be32(vhdm->block_offset[i]);
+            mvhd_fseeko64(vhdm->f, vhdm->sparse.bat_offset + ((uint64_t)i * sizeof offset), SEEK_SET);
+            fwrite(&offset, sizeof offset, 1, vhdm->f);
+        }
     }
+
+    vhdm->bat_dirty_first = -1;
+    vhdm->bat_dirty_last = -1;
 }
 
 /**
- * \brief Write block offset from memory into file
+ * \brief Mark a BAT entry as modified, to be written by write_bat()
  *
  * \param [in] vhdm MiniVHD data structure
- * \param [in] blk The block for which to write the offset for
+ * \param [in] blk The block for which the offset has changed
  */
 static void
-write_bat_entry(MVHDMeta *vhdm, int blk)
+mark_bat_entry(MVHDMeta *vhdm, int blk)
 {
-    uint64_t table_offset = vhdm->sparse.bat_offset + ((uint64_t)blk * sizeof *vhdm->block_offset);
-    uint32_t offset = mvhd_to_be32(vhdm->block_offset[blk]);
+    if ((vhdm->bat_dirty_first < 0) || (blk < vhdm->bat_dirty_first))
+        vhdm->bat_dirty_first = blk;
+    if (blk > vhdm->bat_dirty_last)
+        vhdm->bat_dirty_last = blk;
+}
+
+void
+mvhd_flush_cache(MVHDMeta *vhdm)
+{
+    if (vhdm->bitmap.cache_data == NULL)
+        return;
 
-    mvhd_fseeko64(vhdm->f, table_offset, SEEK_SET);
-    fwrite(&offset, sizeof offset, 1, vhdm->f);
+    for (int i = 0; i < MVHD_BITMAP_CACHE_SIZE; i++)
+        write_sect_bitmap(vhdm, &vhdm->bitmap.cache[i]);
+
+    write_bat(vhdm);
 }
 
 /**
@@ -196,7 +277,7 @@ create_block(MVHDMeta *vhdm, int blk)
 
     /* We no longer have a sparse block. Update that BAT! */
     vhdm->block_offset[blk] = sect_offset;
-    write_bat_entry(vhdm, blk);
+    mark_bat_entry(vhdm, blk);
 }
 
 int
@@ -228,38 +309,68 @@ mvhd_sparse_read(MVHDMeta *vhdm, uint32_t offset, int num_sectors, void *out_buf
     int64_t addr = 0ULL;
     uint32_t s = 0;
     uint32_t ls = 0;
+    uint32_t run = 0;
     int blk = 0;
-    int prev_blk = -1;
     int sib = 0;
+    int set = 0;
     ls = offset + transfer_sectors;
 
-    for (s = offset; s < ls; s++) {
+    for (s = offset; s < ls; s += run) {
         blk = s / vhdm->sect_per_block;
         sib = s % vhdm->sect_per_block;
-        if (blk != prev_blk) {
-            prev_blk = blk;
-            if (vhdm->bitmap.curr_block != blk) {
-                read_sect_bitmap(vhdm, blk);
-                mvhd_fseeko64(vhdm->f, (uint64_t)sib * MVHD_SECTOR_SIZE, SEEK_CUR);
-            } else {
-                addr = (((int64_t) vhdm->block_offset[blk]) + vhdm->bitmap.sector_count + sib) *
-                       MVHD_SECTOR_SIZE;
-                mvhd_fseeko64(vhdm->f, addr, SEEK_SET);
-            }
+        if (vhdm->bitmap.curr_block != blk)
+            read_sect_bitmap(vhdm, blk);
+
+        /* Gather the run of sectors in this block that are all present or all absent */
+        set = !!VHD_TESTBIT(vhdm->bitmap.curr_bitmap, sib);
+        for (run = 1; ((s + run) < ls) && ((sib + run) < (uint32_t) vhdm->sect_per_block); run++) {
+            if (!!VHD_TESTBIT(vhdm->bitmap.curr_bitmap, sib + run) != set)
+                break;
         }
 
-        if (VHD_TESTBIT(vhdm->bitmap.curr_bitmap, sib))
-            (void) !fread(buff, MVHD_SECTOR_SIZE, 1, vhdm->f);
-        else {
-            memset(buff, 0, MVHD_SECTOR_SIZE);
-            mvhd_fseeko64(vhdm->f, MVHD_SECTOR_SIZE, SEEK_CUR);
-        }
-        buff += MVHD_SECTOR_SIZE;
+        if (set) {
+            addr = (((int64_t) vhdm->block_offset[blk]) + vhdm->bitmap.sector_count + sib) *
+                   MVHD_SECTOR_SIZE;
+            mvhd_fseeko64(vhdm->f, addr, SEEK_SET);
+            (void) !fread(buff, MVHD_SECTOR_SIZE, run, vhdm->f);
+        } else
+            memset(buff, 0, run * MVHD_SECTOR_SIZE);
+
+        buff += run * MVHD_SECTOR_SIZE;
     }
 
     return truncated_sectors;
 }
 
+/**
+ * \brief Find the image in a differencing chain which holds a given sector
+ *
+ * \param [in] vhdm MiniVHD data structure at the top of the chain
+ * \param [in] s The sector to look up
+ *
+ * \return The first image in the chain that is not differencing, or in which the sector is present
+ */
+static MVHDMeta *
+diff_sector_owner(MVHDMeta *vhdm, uint32_t s)
+{
+    int blk = 0;
+    int sib = 0;
+
+    while (vhdm->footer.disk_type == MVHD_TYPE_DIFF) {
+        blk = s / vhdm->sect_per_block;
+        sib = s % vhdm->sect_per_block;
+        if (vhdm->bitmap.curr_block != blk)
+            read_sect_bitmap(vhdm, blk);
+
+        if (VHD_TESTBIT(vhdm->bitmap.curr_bitmap, sib))
+            break;
+
+        vhdm = vhdm->parent;
+    }
+
+    return vhdm;
+}
+
 int
 mvhd_diff_read(MVHDMeta *vhdm, uint32_t offset, int num_sectors, void *out_buff)
 {
@@ -273,32 +384,27 @@ mvhd_diff_read(MVHDMeta *vhdm, uint32_t offset, int num_sectors, void *out_buff)
     MVHDMeta *curr_vhdm = vhdm;
     uint32_t s = 0;
     uint32_t ls = 0;
-    int blk = 0;
-    int sib = 0;
+    uint32_t run = 0;
     ls = offset + transfer_sectors;
 
-    for (s = offset; s < ls; s++) {
-        while (curr_vhdm->footer.disk_type == MVHD_TYPE_DIFF) {
-            blk = s / curr_vhdm->sect_per_block;
-            sib = s % curr_vhdm->sect_per_block;
-            if (curr_vhdm->bitmap.curr_block != blk) {
-                read_sect_bitmap(curr_vhdm, blk);
-            }
-            if (!VHD_TESTBIT(curr_vhdm->bitmap.curr_bitmap, sib)) {
-                curr_vhdm = curr_vhdm->parent;
-            } else { break; }
+    for (s = offset; s < ls; s += run) {
+        curr_vhdm = diff_sector_owner(vhdm, s);
+
+        /* Extend the run for as long as the same image holds the sectors */
+        for (run = 1; (s + run) < ls; run++) {
+            if (diff_sector_owner(vhdm, s + run) != curr_vhdm)
+                break;
         }
 
         /* We handle actual sector reading using the fixed or sparse functions,
            as a differencing VHD is also a sparse VHD */
         if ((curr_vhdm->footer.disk_type == MVHD_TYPE_DIFF) ||
             (curr_vhdm->footer.disk_type == MVHD_TYPE_DYNAMIC))
-            mvhd_sparse_read(curr_vhdm, s, 1, buff);
+            mvhd_sparse_read(curr_vhdm, s, run, buff);
         else
-            mvhd_fixed_read(curr_vhdm, s, 1, buff);
+            mvhd_fixed_read(curr_vhdm, s, run, buff);
 
-        curr_vhdm = vhdm;
-        buff += MVHD_SECTOR_SIZE;
+        buff += run * MVHD_SECTOR_SIZE;
     }
 
     return truncated_sectors;
@@ -334,48 +440,41 @@ mvhd_sparse_diff_write(MVHDMeta *vhdm, uint32_t offset, int num_sectors, void *i
     int64_t addr = 0ULL;
     uint32_t s = 0;
     uint32_t ls = 0;
+    uint32_t run = 0;
     int blk = 0;
-    int prev_blk = -1;
     int sib = 0;
     ls = offset + transfer_sectors;
 
     if (offset < total_sectors) {
-        for (s = offset; s < ls; s++) {
+        for (s = offset; s < ls; s += run) {
             blk = s / vhdm->sect_per_block;
             sib = s % vhdm->sect_per_block;
-            if (vhdm->bitmap.curr_block != blk && prev_blk >= 0) {
-                /* Write the sector bitmap for the previous block, before we replace it. */
-                write_curr_sect_bitmap(vhdm);
-            }
-
-            if (vhdm->block_offset[blk] == MVHD_SPARSE_BLK) {
-                /* "read" the sector bitmap first, before creating a new block, as the bitmap will be
-                   zero either way */
+            run = vhdm->sect_per_block - sib;
+            if (run > (ls - s))
+                run = ls - s;
+
+            /* "read" the sector bitmap first, before creating a new block, as the bitmap will be
+               zero either way */
+            if (vhdm->bitmap.curr_block != blk)
                 read_sect_bitmap(vhdm, blk);
+
+            if (vhdm->block_offset[blk] == MVHD_SPARSE_BLK)
                 create_block(vhdm, blk);
-            }
-
-            if (blk != prev_blk) {
-                if (vhdm->bitmap.curr_block != blk) {
-                    read_sect_bitmap(vhdm, blk);
-                    mvhd_fseeko64(vhdm->f, (uint64_t)sib * MVHD_SECTOR_SIZE, SEEK_CUR);
-                } else {
-                    addr = (((int64_t) vhdm->block_offset[blk]) + vhdm->bitmap.sector_count + sib) *
-                           MVHD_SECTOR_SIZE;
-                    mvhd_fseeko64(vhdm->f, addr, SEEK_SET);
-                }
-                prev_blk = blk;
-            }
-
-            fwrite(buff, MVHD_SECTOR_SIZE, 1, vhdm->f);
-            VHD_SETBIT(vhdm->bitmap.curr_bitmap, sib);
-            buff += MVHD_SECTOR_SIZE;
+
+            addr = (((int64_t) vhdm->block_offset[blk]) + vhdm->bitmap.sector_count + sib) *
+                   MVHD_SECTOR_SIZE;
+            mvhd_fseeko64(vhdm->f, addr, SEEK_SET);
+            fwrite(buff, MVHD_SECTOR_SIZE, run, vhdm->f);
+
+            /* The sector bitmap is written back when it leaves the cache, or on flush. */
+            for (uint32_t i = 0; i < run; i++)
+                VHD_SETBIT(vhdm->bitmap.curr_bitmap, sib + i);
+            vhdm->bitmap.cache[vhdm->bitmap.curr_entry].dirty = true;
+
+            buff += run * MVHD_SECTOR_SIZE;
         }
     }
 
-    /* And write the sector bitmap for the last block we visited to disk */
-    write_curr_sect_bitmap(vhdm);
-
     return truncated_sectors;
 }
 
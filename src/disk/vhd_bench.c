@@ -0,0 +1,252 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Standalone benchmark for MiniVHD.
+ *
+ *          Creates a dynamic VHD and a differencing VHD on top of it in
+ *          the given directory, times sequential and random 4K reads and
+ *          writes on both, and checks that every read returns the data
+ *          last written, including after both images have been closed
+ *          and reopened. Exits with 1 on any I/O error or mismatch.
+ *
+ *          Usage: vhd_bench <absolute directory> [MB]
+ *
+ *
+ *
+ * Authors: agent, <agent@local>
+ *
+ *          Copyright 2026 agent.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "minivhd/minivhd.h"
+
+#define BENCH_MB      64
+#define BENCH_SECTORS 8 /* 4K per request */
+#define BENCH_SIZE    (BENCH_SECTORS * 512)
+
+enum {
+    PHASE_SEQ_WRITE = 0,
+    PHASE_SEQ_READ,
+    PHASE_RAND_WRITE,
+    PHASE_RAND_READ,
+    PHASE_VERIFY
+};
+
+static const char *const phase_names[] = { "seq write", "seq read", "rand write", "rand read", "verify" };
+
+/* The dynamic image starts empty, so it is filled sequentially first. The
+   differencing image is measured the way an overlay is used, with scattered
+   writes over a populated parent, and is verified while it still holds a mix
+   of its own and its parent's sectors. Each image is closed and reopened
+   before the verify phase. */
+static const int dynamic_phases[] = { PHASE_SEQ_WRITE, PHASE_SEQ_READ, PHASE_RAND_WRITE, PHASE_RAND_READ, PHASE_VERIFY };
+static const int diff_phases[]    = { PHASE_SEQ_READ, PHASE_RAND_WRITE, PHASE_RAND_READ, PHASE_VERIFY, PHASE_SEQ_WRITE };
+
+static uint8_t *chunk_gen; /* Generation last written to each 4K chunk, 0 if never written. */
+static uint32_t n_chunks;
+static uint8_t  next_gen = 1;
+static uint32_t seed     = 0x56d6b0;
+static int      errors;
+
+static uint64_t
+bench_time_us(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ((uint64_t) ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+static uint32_t
+bench_rand(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    return seed;
+}
+
+/* The contents of a chunk are derived from its number and generation, so
+   that any read can be checked without keeping a copy of the disk. */
+static void
+bench_fill(uint8_t *buf, uint32_t chunk, uint8_t gen)
+{
+    uint32_t v = (chunk * 0x9e3779b1) ^ (gen * 0x85ebca6b) ^ 1;
+
+    if (!gen) {
+        memset(buf, 0, BENCH_SIZE);
+        return;
+    }
+
+    for (int i = 0; i < BENCH_SIZE; i += 4) {
+        v ^= v << 13;
+        v ^= v >> 17;
+        v ^= v << 5;
+        memcpy(&buf[i], &v, 4);
+    }
+}
+
+/* Runs one phase over the whole image and returns the time taken in
+   microseconds. Writes are flushed before the clock stops. */
+static uint64_t
+bench_phase(MVHDMeta *vhd, const char *type, int phase)
+{
+    uint8_t  buf[BENCH_SIZE];
+    uint8_t  expect[BENCH_SIZE];
+    int      write  = (phase == PHASE_SEQ_WRITE) || (phase == PHASE_RAND_WRITE);
+    int      random = (phase == PHASE_RAND_WRITE) || (phase == PHASE_RAND_READ);
+    uint8_t  gen    = write ? next_gen++ : 0;
+    uint32_t chunk;
+    uint64_t start  = bench_time_us();
+
+    for (uint32_t i = 0; i < n_chunks; i++) {
+        chunk = random ? (bench_rand() % n_chunks) : i;
+
+        if (write) {
+            chunk_gen[chunk] = gen;
+            bench_fill(buf, chunk, gen);
+            if (mvhd_write_sectors(vhd, chunk * BENCH_SECTORS, BENCH_SECTORS, buf)) {
+                printf("  %s: %s failed at sector %u\n", type, phase_names[phase], chunk * BENCH_SECTORS);
+                errors++;
+                break;
+            }
+        } else {
+            if (mvhd_read_sectors(vhd, chunk * BENCH_SECTORS, BENCH_SECTORS, buf)) {
+                printf("  %s: %s failed at sector %u\n", type, phase_names[phase], chunk * BENCH_SECTORS);
+                errors++;
+                break;
+            }
+            bench_fill(expect, chunk, chunk_gen[chunk]);
+            if (memcmp(buf, expect, BENCH_SIZE)) {
+                if (errors < 16)
+                    printf("  %s: %s mismatch at sector %u\n", type, phase_names[phase], chunk * BENCH_SECTORS);
+                errors++;
+            }
+        }
+    }
+
+    if (write)
+        mvhd_flush(vhd);
+
+    return bench_time_us() - start;
+}
+
+static void
+bench_report(const char *type, int phase, uint64_t us)
+{
+    double mb = ((double) n_chunks * BENCH_SIZE) / (1024.0 * 1024.0);
+
+    printf("%-8s %-10s %10.1f %10.1f\n", type, phase_names[phase], us / 1000.0,
+           us ? (mb * 1000000.0 / us) : 0.0);
+}
+
+static MVHDMeta *
+bench_create(int type, char *path, char *parent_path, uint64_t size)
+{
+    MVHDCreationOptions options;
+    MVHDMeta           *vhd;
+    int                 err = 0;
+
+    memset(&options, 0, sizeof(options));
+    options.type          = type;
+    options.path          = path;
+    options.parent_path   = parent_path;
+    options.size_in_bytes = size;
+
+    vhd = mvhd_create_ex(options, &err);
+    if (vhd == NULL)
+        printf("Unable to create %s: %s\n", path, mvhd_strerr(err));
+
+    return vhd;
+}
+
+/* Runs the given phases, reopening the image before verifying it. Returns
+   the image, or NULL if it could not be reopened. */
+static MVHDMeta *
+bench_image(MVHDMeta *vhd, const char *type, const char *path, const int *phases, int n_phases)
+{
+    int err = 0;
+
+    for (int i = 0; i < n_phases; i++) {
+        if (phases[i] == PHASE_VERIFY) {
+            mvhd_close(vhd);
+            vhd = mvhd_open(path, 0, &err);
+            if (vhd == NULL) {
+                printf("Unable to reopen %s: %s\n", path, mvhd_strerr(err));
+                errors++;
+                return NULL;
+            }
+        }
+
+        bench_report(type, phases[i], bench_phase(vhd, type, phases[i]));
+    }
+
+    return vhd;
+}
+
+int
+main(int argc, char *argv[])
+{
+    char      base_path[1024];
+    char      diff_path[1024];
+    MVHDMeta *vhd;
+    int       mb = BENCH_MB;
+
+    if (argc < 2) {
+        printf("Usage: %s <absolute directory> [MB]\n", argv[0]);
+        return 2;
+    }
+    if (argc > 2)
+        mb = atoi(argv[2]);
+    if (mb <= 0)
+        mb = 1;
+
+    snprintf(base_path, sizeof(base_path), "%s/vhd_bench_base.vhd", argv[1]);
+    snprintf(diff_path, sizeof(diff_path), "%s/vhd_bench_diff.vhd", argv[1]);
+
+    vhd = bench_create(MVHD_TYPE_DYNAMIC, base_path, NULL, (uint64_t) mb << 20);
+    if (vhd == NULL)
+        return 2;
+
+    /* The geometry may round the size down. */
+    n_chunks  = (uint32_t) (mvhd_get_current_size(vhd) / BENCH_SIZE);
+    chunk_gen = calloc(n_chunks, 1);
+
+    printf("%u 4K requests per phase, times in ms\n\n", n_chunks);
+    printf("%-8s %-10s %10s %10s\n", "image", "phase", "time", "MB/s");
+
+    vhd = bench_image(vhd, "dynamic", base_path, dynamic_phases, sizeof(dynamic_phases) / sizeof(dynamic_phases[0]));
+    if (vhd != NULL) {
+        mvhd_close(vhd);
+
+        vhd = bench_create(MVHD_TYPE_DIFF, diff_path, base_path, 0);
+        if (vhd != NULL)
+            vhd = bench_image(vhd, "diff", diff_path, diff_phases, sizeof(diff_phases) / sizeof(diff_phases[0]));
+        else
+            errors++;
+        if (vhd != NULL)
+            mvhd_close(vhd);
+    }
+
+    remove(diff_path);
+    remove(base_path);
+    free(chunk_gen);
+
+    if (errors) {
+        printf("\n%i errors\n", errors);
+        return 1;
+    }
+
+    return 0;
+}
@@ -1842,20 +1842,41 @@ dma_mode(int channel)
 }
 
 /* DMA Bus Master Page Read/Write */
+/* Bytes of whole transfers from addr up to the end of its 4k page, at most
+   left, so they can be handed to a block handler in one go. 0 if the first
+   transfer straddles the page boundary. */
+static uint32_t
+dma_bm_run(uint32_t addr, uint32_t left, int TransferSize)
+{
+    uint32_t run = 0x1000 - (addr & 0xfff);
+
+    if (run > left)
+        run = left;
+
+    return run & ~(TransferSize - 1);
+}
+
 void
 dma_bm_read(uint32_t PhysAddress, uint8_t *DataRead, uint32_t TotalSize, int TransferSize)
 {
     uint32_t n;
     uint32_t n2;
+    uint32_t run;
     uint8_t  bytes[4] = { 0, 0, 0, 0 };
 
     n  = TotalSize & ~(TransferSize - 1);
     n2 = TotalSize - n;
 
     /* Do the divisible block, if there is one. */
-    if (n) {
-        for (uint32_t i = 0; i < n; i += TransferSize)
+    for (uint32_t i = 0; i < n; i += run) {
+        run = dma_bm_run(PhysAddress + i, n - i, TransferSize);
+        if (!run) {
+            run = TransferSize;
             mem_read_phys((void *) &(DataRead[i]), PhysAddress + i, TransferSize);
+        } else if (!mem_read_phys_block(&(DataRead[i]), PhysAddress + i, run, TransferSize)) {
+            for (uint32_t j = i; j < (i + run); j += TransferSize)
+                mem_read_phys((void *) &(DataRead[j]), PhysAddress + j, TransferSize);
+        }
     }
 
     /* Do the non-divisible block, if there is one. */
@@ -1870,15 +1891,22 @@ dma_bm_write(uint32_t PhysAddress, const uint8_t *DataWrite, uint32_t TotalSize,
 {
     uint32_t n;
     uint32_t n2;
+    uint32_t run;
     uint8_t  bytes[4] = { 0, 0, 0, 0 };
 
     n  = TotalSize & ~(TransferSize - 1);
     n2 = TotalSize - n;
 
     /* Do the divisible block, if there is one. */
-    if (n) {
-        for (uint32_t i = 0; i < n; i += TransferSize)
+    for (uint32_t i = 0; i < n; i += run) {
+        run = dma_bm_run(PhysAddress + i, n - i, TransferSize);
+        if (!run) {
+            run = TransferSize;
             mem_write_phys((void *) &(DataWrite[i]), PhysAddress + i, TransferSize);
+        } else if (!mem_write_phys_block(&(DataWrite[i]), PhysAddress + i, run, TransferSize)) {
+            for (uint32_t j = i; j < (i + run); j += TransferSize)
+                mem_write_phys((void *) &(DataWrite[j]), PhysAddress + j, TransferSize);
+        }
     }
 
     /* Do the non-divisible block, if there is one. */
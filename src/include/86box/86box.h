@@ -141,6 +141,9 @@ extern uint32_t mem_size;                   /* (C) memory size (Installed on sys
 extern uint32_t isa_mem_size;               /* (C) memory size (ISA Memory Cards) */
 extern int      cpu;                        /* (C) cpu type */
 extern int      cpu_use_dynarec;            /* (C) cpu uses/needs Dyna */
+extern int      cpu_dynarec_blocks;         /* (C) dynarec block pool size */
+extern int      cpu_dynarec_async;          /* (C) compile dynarec blocks on a worker thread */
+extern int      cpu_dynarec_ir_disable;     /* (C) dynarec IR optimisation passes to skip */
 extern int      fpu_type;                   /* (C) fpu type */
 extern int      fpu_softfloat;              /* (C) fpu uses softfloat */
 extern int      time_sync;                  /* (C) enable time sync */
@@ -106,6 +106,12 @@ typedef struct ide_s {
     uint16_t *buffer;
     uint8_t  *sector_buffer;
 
+    /* Asynchronous read-ahead into sector_buffer. */
+    uint32_t aio_tag;
+    uint32_t aio_sector;
+    uint32_t aio_count;
+    int      aio_valid;
+
     pc_timer_t timer;
 
     /* Task file. */
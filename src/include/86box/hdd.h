@@ -158,6 +158,7 @@ typedef struct hard_disk_t {
 
     char fn[1024];         /* Name of current image file */
     char vhd_parent[1041]; /* Differential VHD parent file */
+    char overlay_fn[1024]; /* Copy-on-write overlay file, base is read-only */
 
     uint32_t seek_pos;
     uint32_t seek_len;
@@ -190,6 +191,10 @@ typedef struct hard_disk_t {
 extern hard_disk_t  hdd[HDD_NUM];
 extern unsigned int hdd_table[128][3];
 
+extern int hdd_aio_queue_depth;
+extern int hdd_aio_max_inflight;
+extern int hdd_mmap_enabled;
+
 extern int   hdd_init(void);
 extern int   hdd_string_to_bus(char *str, int cdrom);
 extern char *hdd_bus_to_string(int bus, int cdrom);
@@ -211,6 +216,37 @@ extern void     hdd_image_unload(uint8_t id, int fn_preserve);
 extern void     hdd_image_close(uint8_t id);
 extern void     hdd_image_calc_chs(uint32_t *c, uint32_t *h, uint32_t *s, uint32_t size);
 
+/* Asynchronous I/O. hdd_image_aio_submit() returns a tag to wait on, or 0 if
+   the request was completed (and its callback run) synchronously. Callbacks
+   run on the emulation thread and get 0, or -1 if the transfer failed. */
+extern uint32_t hdd_image_aio_submit(uint8_t id, int write, uint32_t sector, uint32_t count, uint8_t *buffer,
+                                     void (*callback)(void *priv, int ret), void *priv);
+extern void     hdd_image_aio_wait(uint8_t id, uint32_t tag);
+extern void     hdd_image_aio_drain(uint8_t id);
+extern int      hdd_image_aio_enabled(uint8_t id);
+
+extern void     hdd_image_flush(uint8_t id);
+
+extern int      hdd_image_overlay_commit(uint8_t id);
+extern int      hdd_image_overlay_discard(uint8_t id);
+extern int      hdd_image_has_overlay(uint8_t id);
+
+typedef struct hdd_overlay_t hdd_overlay_t;
+
+extern hdd_overlay_t *hdd_overlay_open(const char *fn, uint64_t sectors);
+extern void           hdd_overlay_close(hdd_overlay_t *ovl);
+extern uint32_t       hdd_overlay_get_blocks(hdd_overlay_t *ovl);
+extern uint32_t       hdd_overlay_get_block_sectors(hdd_overlay_t *ovl);
+extern int            hdd_overlay_block_present(hdd_overlay_t *ovl, uint32_t block);
+extern int            hdd_overlay_read(hdd_overlay_t *ovl, uint32_t sector, uint32_t count, uint8_t *buffer,
+                                       int (*base_read)(void *priv, uint32_t sector, uint32_t count, uint8_t *buffer),
+                                       void *priv);
+extern int            hdd_overlay_write(hdd_overlay_t *ovl, uint32_t sector, uint32_t count, uint8_t *buffer,
+                                        int (*base_read)(void *priv, uint32_t sector, uint32_t count, uint8_t *buffer),
+                                        void *priv);
+extern int            hdd_overlay_read_block(hdd_overlay_t *ovl, uint32_t block, uint8_t *buffer);
+extern int            hdd_overlay_discard(hdd_overlay_t *ovl);
+
 extern int image_is_hdi(const char *s);
 extern int image_is_hdx(const char *s, int check_signature);
 extern int image_is_vhd(const char *s, int check_signature);
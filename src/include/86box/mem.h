@@ -188,6 +188,11 @@ typedef struct _mem_mapping_ {
     void (*write_w)(uint32_t addr, uint16_t val, void *priv);
     void (*write_l)(uint32_t addr, uint32_t val, void *priv);
 
+    /* Optional, for runs of len / size accesses of size bytes at ascending
+       addresses from addr, never crossing a 4k page. */
+    void (*read_block)(uint32_t addr, uint8_t *buf, uint32_t len, int size, void *priv);
+    void (*write_block)(uint32_t addr, const uint8_t *buf, uint32_t len, int size, void *priv);
+
     uint8_t *exec;
 
     uint32_t flags;
@@ -236,6 +241,18 @@ page_in_evict_list(page_t *page)
 }
 void page_remove_from_evict_list(page_t *page);
 void page_add_to_evict_list(page_t *page);
+
+/*Small direct mapped cache of readlookup2/writelookup2 entries, probed by the
+  memory access routines of the x86-64 and ARM64 backends before falling back
+  to the full tables. An entry is only valid while the lookup2 entry for its
+  page is, and always holds the same addend.*/
+#    define MEM_TLB_SIZE 256
+#    define MEM_TLB_INV  0xffffffff
+
+typedef struct mem_tlb_t {
+    uint32_t  tag; /*Virtual page number, or MEM_TLB_INV*/
+    uintptr_t addend;
+} mem_tlb_t;
 #else
 typedef struct _page_ {
     void (*write_b)(uint32_t addr, uint8_t val, struct _page_ *page);
@@ -271,6 +288,10 @@ extern int        readlnext;
 extern int        writelookup[256];
 extern uintptr_t *writelookup2;
 extern int        writelnext;
+#ifdef USE_NEW_DYNAREC
+extern mem_tlb_t  read_tlb[MEM_TLB_SIZE];
+extern mem_tlb_t  write_tlb[MEM_TLB_SIZE];
+#endif
 extern uint32_t   ram_mapped_addr[64];
 extern uint8_t    page_ff[4096];
 
@@ -299,8 +320,11 @@ extern int writelnum;
 
 extern int memspeed[11];
 
-extern int     mmu_perm;
-extern uint8_t high_page; /* if a high (> 4 gb) page was detected */
+extern int      mmu_perm;
+extern uint32_t mmu_flushes_sec;
+extern uint32_t mmu_refills_sec;
+extern uint32_t mmu_global_kept_sec;
+extern uint8_t  high_page; /* if a high (> 4 gb) page was detected */
 
 extern uint8_t *_mem_exec[MEM_MAPPINGS_NO];
 
@@ -357,6 +381,8 @@ extern uint64_t mmutranslatereal(uint32_t addr, int rw);
 extern uint32_t mmutranslatereal32(uint32_t addr, int rw);
 extern void     addreadlookup(uint32_t virt, uint32_t phys);
 extern void     addwritelookup(uint32_t virt, uint32_t phys);
+extern uint32_t mem_movs_bulk(uint32_t src, uint32_t dest, uint32_t count, int size);
+extern uint32_t mem_stos_bulk(uint32_t dest, uint32_t count, int size, uint32_t val);
 
 extern void mem_mapping_set(mem_mapping_t *,
                             uint32_t base,
@@ -396,6 +422,10 @@ extern void mem_mapping_set_write_handler(mem_mapping_t *,
                                           void (*write_w)(uint32_t addr, uint16_t val, void *priv),
                                           void (*write_l)(uint32_t addr, uint32_t val, void *priv));
 
+extern void mem_mapping_set_block_handler(mem_mapping_t *,
+                                          void (*read_block)(uint32_t addr, uint8_t *buf, uint32_t len, int size, void *priv),
+                                          void (*write_block)(uint32_t addr, const uint8_t *buf, uint32_t len, int size, void *priv));
+
 extern void mem_mapping_set_p(mem_mapping_t *, void *priv);
 
 extern void mem_mapping_set_addr(mem_mapping_t *,
@@ -417,6 +447,8 @@ extern void     mem_writeb_phys(uint32_t addr, uint8_t val);
 extern void     mem_writew_phys(uint32_t addr, uint16_t val);
 extern void     mem_writel_phys(uint32_t addr, uint32_t val);
 extern void     mem_write_phys(void *src, uint32_t addr, int tranfer_size);
+extern int      mem_read_phys_block(void *dest, uint32_t addr, uint32_t len, int transfer_size);
+extern int      mem_write_phys_block(const void *src, uint32_t addr, uint32_t len, int transfer_size);
 
 extern uint8_t  mem_read_ram(uint32_t addr, void *priv);
 extern uint16_t mem_read_ramw(uint32_t addr, void *priv);
@@ -446,7 +478,9 @@ extern void mem_flush_write_page(uint32_t addr, uint32_t virt);
 extern void mem_reset_page_blocks(void);
 
 extern void flushmmucache(void);
+extern void flushmmucache_nonglobal(void);
 extern void flushmmucache_nopc(void);
+extern void mem_tlb_stats_update(void);
 
 extern void mem_debug_check_addr(uint32_t addr, int write);
 
@@ -50,8 +50,8 @@ typedef struct pc_timer_t {
     void (*callback)(void *priv);
     void *priv;
 
-    struct pc_timer_t *prev;
-    struct pc_timer_t *next;
+    uint32_t heap_pos; /* Position in the timer heap plus one, 0 if not queued. */
+    uint64_t seq;      /* Enable order, used to break timestamp ties. */
 } pc_timer_t;
 
 #ifdef __cplusplus
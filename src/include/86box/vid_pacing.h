@@ -0,0 +1,67 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Definitions for the display frame pacing monitor.
+ *
+ *
+ *
+ * Authors: agent, <agent@local>
+ *
+ *          Copyright 2026 agent.
+ */
+#ifndef VIDEO_PACING_H
+#define VIDEO_PACING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Latency stages of a frame, in microseconds. */
+enum {
+    VIDEO_PACING_VSYNC_BLIT = 0, /* guest vsync to handing the frame to the blit thread */
+    VIDEO_PACING_BLIT_DONE,      /* blit thread picking it up to finishing it */
+    VIDEO_PACING_DONE_PRESENT,   /* blit thread finishing it to the renderer presenting it */
+    VIDEO_PACING_TOTAL,          /* guest vsync to present */
+    VIDEO_PACING_INTERVAL,       /* time between the presents of two new frames */
+    VIDEO_PACING_STAGES
+};
+
+typedef struct video_pacing_latency_t {
+    uint32_t p50;
+    uint32_t p95;
+    uint32_t p99;
+    uint32_t max;
+} video_pacing_latency_t;
+
+/* Statistics of a monitor over the last second. */
+typedef struct video_pacing_stats_t {
+    uint32_t               blits;      /* frames the video card blitted */
+    uint32_t               presented;  /* new frames the renderer presented */
+    uint32_t               dropped;    /* frames that were never presented */
+    uint32_t               duplicated; /* presents that showed no new frame */
+    video_pacing_latency_t latency[VIDEO_PACING_STAGES];
+} video_pacing_stats_t;
+
+extern void video_pacing_init(void);
+extern void video_pacing_close(void);
+
+extern void video_pacing_vsync(int monitor_index);
+extern void video_pacing_blit(int monitor_index);
+extern void video_pacing_blit_done(int monitor_index);
+extern void video_pacing_present(int monitor_index);
+
+extern void video_pacing_update(void);
+extern void video_pacing_get_stats(int monitor_index, video_pacing_stats_t *stats);
+extern int  video_pacing_format_json(char *buf, size_t size);
+extern int  video_pacing_format_overlay(int monitor_index, char *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*VIDEO_PACING_H*/
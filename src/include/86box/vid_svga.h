@@ -289,6 +289,18 @@ typedef struct svga_t {
     /* Return a 32 bpp color from a 15/16 bpp color. */
     uint32_t (*conv_16to32)(struct svga_t *svga, uint16_t color, uint8_t bpp);
 
+    /* Span conversion worker, and whether the line being rendered may hand
+       its spans to it. */
+    void *span_worker;
+    int   span_defer;
+
+    /* Target buffer rows drawn since the last blit, and whether they are
+       all that changed in the frame being blitted. */
+    int      dirty_top;
+    int      dirty_bottom;
+    int      dirty_valid;
+    uint32_t dirty_overscan_color;
+
     void *  dev8514;
     void *  ext8514;
     void *  clock_gen8514;
@@ -331,6 +343,8 @@ extern int  svga_init(const device_t *info, svga_t *svga, void *priv, int memsiz
 extern void svga_recalctimings(svga_t *svga);
 extern void svga_close(svga_t *svga);
 
+extern uint32_t svga_conv_16to32(struct svga_t *svga, uint16_t color, uint8_t bpp);
+
 uint8_t  svga_read(uint32_t addr, void *priv);
 uint16_t svga_readw(uint32_t addr, void *priv);
 uint32_t svga_readl(uint32_t addr, void *priv);
@@ -345,6 +359,10 @@ void     svga_write_linear(uint32_t addr, uint8_t val, void *priv);
 void     svga_writeb_linear(uint32_t addr, uint8_t val, void *priv);
 void     svga_writew_linear(uint32_t addr, uint16_t val, void *priv);
 void     svga_writel_linear(uint32_t addr, uint32_t val, void *priv);
+void     svga_read_block_linear(uint32_t addr, uint8_t *buf, uint32_t len, int size, void *priv);
+void     svga_write_block_linear(uint32_t addr, const uint8_t *buf, uint32_t len, int size, void *priv);
+void     svga_vram_read_block(svga_t *svga, uint32_t addr, uint8_t *buf, uint32_t len);
+void     svga_vram_write_block(svga_t *svga, uint32_t addr, const uint8_t *buf, uint32_t len);
 
 void svga_add_status_info(char *s, int max_len, void *priv);
 
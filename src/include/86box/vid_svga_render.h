@@ -89,4 +89,24 @@ extern void ibm8514_render_RGBA8888(svga_t *svga);
 
 extern void (*svga_render)(svga_t *svga);
 
+extern void (*svga_span_pal8)(uint32_t *p, const uint8_t *src, int count, const uint32_t *map, uint8_t mask);
+extern void (*svga_span_15to32)(uint32_t *p, const uint8_t *src, int count);
+extern void (*svga_span_16to32)(uint32_t *p, const uint8_t *src, int count);
+extern void (*svga_span_24to32)(uint32_t *p, const uint8_t *src, int count);
+
+enum {
+    SVGA_SPAN_PAL8 = 0,
+    SVGA_SPAN_15TO32,
+    SVGA_SPAN_16TO32,
+    SVGA_SPAN_24TO32
+};
+
+extern void svga_span_init_generic(void);
+extern void svga_span_init(void);
+extern void svga_span_draw(svga_t *svga, int type, uint32_t *p, const uint8_t *src, int count);
+
+extern void svga_span_worker_start(svga_t *svga);
+extern void svga_span_worker_sync(svga_t *svga);
+extern void svga_span_worker_stop(svga_t *svga);
+
 #endif /*VID_SVGA_RENDER_H*/
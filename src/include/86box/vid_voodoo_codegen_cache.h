@@ -0,0 +1,314 @@
+/*Block cache shared by the Voodoo pixel pipeline recompilers.
+
+  Blocks are keyed on all of the state that voodoo_generate() bakes into the
+  generated code, found through a per render thread hash table and replaced
+  in LRU order. Optionally, the keys of the cached blocks are saved on close
+  and recompiled on the next start, so the common pipeline states of a game
+  do not have to be recompiled mid-frame again.
+
+  The including recompiler must define BLOCK_NUM, BLOCK_SIZE and LOD_MASK.*/
+
+#ifndef VIDEO_VOODOO_CODEGEN_CACHE_H
+#define VIDEO_VOODOO_CODEGEN_CACHE_H
+
+#define BLOCK_HASH_SIZE   128
+#define BLOCK_HASH_MASK   (BLOCK_HASH_SIZE - 1)
+
+#define JIT_CACHE_FILE    "voodoo_jit.bin"
+#define JIT_CACHE_MAGIC   0x54494a56 /*VJIT*/
+#define JIT_CACHE_VERSION 2
+
+/*All fields are 32-bit so the key has no padding and can be compared and
+  hashed as raw memory.*/
+typedef struct voodoo_jit_key_t {
+    uint32_t xdir;
+    uint32_t alphaMode;
+    uint32_t fbzMode;
+    uint32_t fogMode;
+    uint32_t fbzColorPath;
+    uint32_t textureMode[2];
+    uint32_t tLOD[2];
+    uint32_t tDetail[2];
+    uint32_t trexInit1;
+    uint32_t tmuConfig;
+    uint32_t col_tiled;
+    uint32_t aux_tiled;
+    uint32_t fb_col_tiled;
+    uint32_t fb_aux_tiled;
+} voodoo_jit_key_t;
+
+typedef struct voodoo_x86_data_t {
+    uint8_t          code_block[BLOCK_SIZE];
+    voodoo_jit_key_t key;
+    int              valid;
+    int              hash_next;
+    uint32_t         last_use;
+} voodoo_x86_data_t;
+
+typedef struct voodoo_jit_thread_t {
+    int      hash[BLOCK_HASH_SIZE];
+    int      last_block;
+    uint32_t use_counter;
+    uint64_t hits;
+    uint64_t misses;
+} voodoo_jit_thread_t;
+
+static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo_params_t *params, voodoo_state_t *state, int depthop);
+
+static inline void
+voodoo_jit_make_key(voodoo_jit_key_t *key, voodoo_t *voodoo, voodoo_params_t *params, voodoo_state_t *state)
+{
+    key->xdir         = state->xdir;
+    key->alphaMode    = params->alphaMode;
+    key->fbzMode      = params->fbzMode;
+    key->fogMode      = params->fogMode;
+    key->fbzColorPath = params->fbzColorPath;
+    for (uint8_t c = 0; c < 2; c++) {
+        key->textureMode[c] = params->textureMode[c];
+        key->tLOD[c]        = params->tLOD[c] & LOD_MASK;
+        key->tDetail[c]     = params->detail_max[c] | (params->detail_bias[c] << 8) | (params->detail_scale[c] << 14);
+    }
+    key->trexInit1 = voodoo->trexInit1[0] & (1 << 18);
+    key->tmuConfig = key->trexInit1 ? voodoo->tmuConfig : 0;
+    /*The color and aux buffers are addressed by separate code paths*/
+    key->col_tiled    = params->col_tiled ? 1 : 0;
+    key->aux_tiled    = params->aux_tiled ? 1 : 0;
+    key->fb_col_tiled = voodoo->col_tiled ? 1 : 0;
+    key->fb_aux_tiled = voodoo->aux_tiled ? 1 : 0;
+}
+
+static inline int
+voodoo_jit_hash(const voodoo_jit_key_t *key)
+{
+    const uint32_t *p = (const uint32_t *) key;
+    uint32_t        h = 0x811c9dc5;
+
+    for (size_t c = 0; c < sizeof(voodoo_jit_key_t) / sizeof(uint32_t); c++)
+        h = (h ^ p[c]) * 0x01000193;
+
+    return (h ^ (h >> 16)) & BLOCK_HASH_MASK;
+}
+
+static void
+voodoo_jit_unlink(voodoo_jit_thread_t *jit, voodoo_x86_data_t *blocks, int b)
+{
+    int *p = &jit->hash[voodoo_jit_hash(&blocks[b].key)];
+
+    while (*p != -1) {
+        if (*p == b) {
+            *p = blocks[b].hash_next;
+            return;
+        }
+        p = &blocks[*p].hash_next;
+    }
+}
+
+static void *
+voodoo_jit_compile(voodoo_t *voodoo, voodoo_params_t *params, voodoo_state_t *state, int odd_even, const voodoo_jit_key_t *key)
+{
+    voodoo_jit_thread_t *jit    = &((voodoo_jit_thread_t *) voodoo->codegen_jit)[odd_even];
+    voodoo_x86_data_t   *blocks = &((voodoo_x86_data_t *) voodoo->codegen_data)[odd_even * BLOCK_NUM];
+    voodoo_x86_data_t   *data;
+    int                  victim = 0;
+    int                  h;
+
+    /*Use a free block if there is one, otherwise the least recently used*/
+    for (int c = 0; c < BLOCK_NUM; c++) {
+        if (!blocks[c].valid) {
+            victim = c;
+            break;
+        }
+        if ((uint32_t) (jit->use_counter - blocks[c].last_use) > (uint32_t) (jit->use_counter - blocks[victim].last_use))
+            victim = c;
+    }
+
+    data = &blocks[victim];
+    if (data->valid)
+        voodoo_jit_unlink(jit, blocks, victim);
+
+    voodoo_generate(data->code_block, voodoo, params, state, depth_op);
+
+    h               = voodoo_jit_hash(key);
+    data->key       = *key;
+    data->valid     = 1;
+    data->last_use  = ++jit->use_counter;
+    data->hash_next = jit->hash[h];
+    jit->hash[h]    = victim;
+    jit->last_block = victim;
+
+    return data->code_block;
+}
+
+int voodoo_recomp = 0;
+
+static inline void *
+voodoo_get_block(voodoo_t *voodoo, voodoo_params_t *params, voodoo_state_t *state, int odd_even)
+{
+    voodoo_jit_thread_t *jit    = &((voodoo_jit_thread_t *) voodoo->codegen_jit)[odd_even];
+    voodoo_x86_data_t   *blocks = &((voodoo_x86_data_t *) voodoo->codegen_data)[odd_even * BLOCK_NUM];
+    voodoo_x86_data_t   *data;
+    voodoo_jit_key_t     key;
+
+    voodoo_jit_make_key(&key, voodoo, params, state);
+
+    /*Consecutive triangles usually share their pipeline state*/
+    data = &blocks[jit->last_block];
+    if (data->valid && !memcmp(&data->key, &key, sizeof(voodoo_jit_key_t))) {
+        jit->hits++;
+        data->last_use = ++jit->use_counter;
+        return data->code_block;
+    }
+
+    for (int b = jit->hash[voodoo_jit_hash(&key)]; b != -1; b = blocks[b].hash_next) {
+        data = &blocks[b];
+        if (!memcmp(&data->key, &key, sizeof(voodoo_jit_key_t))) {
+            jit->hits++;
+            jit->last_block = b;
+            data->last_use  = ++jit->use_counter;
+            return data->code_block;
+        }
+    }
+
+    voodoo_recomp++;
+    jit->misses++;
+
+    return voodoo_jit_compile(voodoo, params, state, odd_even, &key);
+}
+
+static void
+voodoo_jit_load(voodoo_t *voodoo)
+{
+    char              fn[1024];
+    FILE             *fp;
+    uint32_t          header[3];
+    voodoo_jit_key_t  key;
+    voodoo_params_t  *params;
+    voodoo_state_t   *state;
+    uint32_t          trexInit1 = voodoo->trexInit1[0];
+    uint32_t          tmuConfig = voodoo->tmuConfig;
+    int               col_tiled = voodoo->col_tiled;
+    int               aux_tiled = voodoo->aux_tiled;
+
+    path_append_filename(fn, usr_path, JIT_CACHE_FILE);
+    fp = plat_fopen(fn, "rb");
+    if (fp == NULL)
+        return;
+
+    if ((fread(header, 1, sizeof(header), fp) != sizeof(header)) || (header[0] != JIT_CACHE_MAGIC) || (header[1] != JIT_CACHE_VERSION) || (header[2] > BLOCK_NUM)) {
+        fclose(fp);
+        return;
+    }
+
+    params = calloc(1, sizeof(voodoo_params_t));
+    state  = calloc(1, sizeof(voodoo_state_t));
+
+    for (uint32_t c = 0; c < header[2]; c++) {
+        if (fread(&key, 1, sizeof(key), fp) != sizeof(key))
+            break;
+
+        state->xdir          = (int) key.xdir;
+        params->alphaMode    = key.alphaMode;
+        params->fbzMode      = key.fbzMode;
+        params->fogMode      = key.fogMode;
+        params->fbzColorPath = key.fbzColorPath;
+        for (uint8_t tmu = 0; tmu < 2; tmu++) {
+            params->textureMode[tmu]  = key.textureMode[tmu];
+            params->tLOD[tmu]         = key.tLOD[tmu];
+            params->detail_max[tmu]   = key.tDetail[tmu] & 0xff;
+            params->detail_bias[tmu]  = (key.tDetail[tmu] >> 8) & 0x3f;
+            params->detail_scale[tmu] = (key.tDetail[tmu] >> 14) & 7;
+        }
+        params->col_tiled    = key.col_tiled;
+        params->aux_tiled    = key.aux_tiled;
+        voodoo->trexInit1[0] = (trexInit1 & ~(1 << 18)) | (key.trexInit1 & (1 << 18));
+        voodoo->tmuConfig    = key.tmuConfig;
+        voodoo->col_tiled    = key.fb_col_tiled;
+        voodoo->aux_tiled    = key.fb_aux_tiled;
+
+        /*Rebuild the key so it matches what voodoo_get_block() will look up*/
+        voodoo_jit_make_key(&key, voodoo, params, state);
+        for (int t = 0; t < voodoo->render_threads; t++)
+            voodoo_jit_compile(voodoo, params, state, t, &key);
+    }
+
+    voodoo->trexInit1[0] = trexInit1;
+    voodoo->tmuConfig    = tmuConfig;
+    voodoo->col_tiled    = col_tiled;
+    voodoo->aux_tiled    = aux_tiled;
+
+    free(state);
+    free(params);
+    fclose(fp);
+}
+
+static void
+voodoo_jit_save(voodoo_t *voodoo)
+{
+    char               fn[1024];
+    FILE              *fp;
+    uint32_t           header[3];
+    voodoo_jit_key_t  *keys   = malloc(sizeof(voodoo_jit_key_t) * BLOCK_NUM);
+    voodoo_x86_data_t *blocks = voodoo->codegen_data;
+    int                nr     = 0;
+
+    for (int c = 0; c < (BLOCK_NUM * voodoo->render_threads) && nr < BLOCK_NUM; c++) {
+        int d;
+
+        if (!blocks[c].valid)
+            continue;
+        for (d = 0; d < nr; d++) {
+            if (!memcmp(&keys[d], &blocks[c].key, sizeof(voodoo_jit_key_t)))
+                break;
+        }
+        if (d == nr)
+            keys[nr++] = blocks[c].key;
+    }
+
+    path_append_filename(fn, usr_path, JIT_CACHE_FILE);
+    fp = plat_fopen(fn, "wb");
+    if (fp != NULL) {
+        header[0] = JIT_CACHE_MAGIC;
+        header[1] = JIT_CACHE_VERSION;
+        header[2] = nr;
+        fwrite(header, 1, sizeof(header), fp);
+        fwrite(keys, 1, sizeof(voodoo_jit_key_t) * nr, fp);
+        fclose(fp);
+    }
+
+    free(keys);
+}
+
+static void
+voodoo_jit_init(voodoo_t *voodoo)
+{
+    voodoo_jit_thread_t *jit;
+
+    voodoo->codegen_data = plat_mmap(sizeof(voodoo_x86_data_t) * BLOCK_NUM * voodoo->render_threads, 1);
+    voodoo->codegen_jit  = calloc(voodoo->render_threads, sizeof(voodoo_jit_thread_t));
+
+    jit = voodoo->codegen_jit;
+    for (int c = 0; c < voodoo->render_threads; c++) {
+        for (int d = 0; d < BLOCK_HASH_SIZE; d++)
+            jit[c].hash[d] = -1;
+    }
+}
+
+static void
+voodoo_jit_close(voodoo_t *voodoo)
+{
+    voodoo_jit_thread_t *jit = voodoo->codegen_jit;
+
+    if (voodoo->use_recompiler && voodoo->jit_warm_start)
+        voodoo_jit_save(voodoo);
+
+    for (int c = 0; c < voodoo->render_threads; c++) {
+        voodoo->jit_hit_count += jit[c].hits;
+        voodoo->jit_miss_count += jit[c].misses;
+    }
+
+    free(voodoo->codegen_jit);
+    voodoo->codegen_jit = NULL;
+    plat_munmap(voodoo->codegen_data, sizeof(voodoo_x86_data_t) * BLOCK_NUM * voodoo->render_threads);
+}
+
+#endif /*VIDEO_VOODOO_CODEGEN_CACHE_H*/
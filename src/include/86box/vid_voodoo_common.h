@@ -30,7 +30,11 @@
 
 #define TEX_DIRTY_SHIFT 10
 
-#define TEX_CACHE_MAX   64
+#define VOODOO_MAX_RENDER_THREADS 16
+
+#define TEX_CACHE_MAX   1024
+#define TEX_CACHE_DEF   128
+#define TEX_HASH_SIZE   2048
 
 #ifdef __cplusplus
 #    include <atomic>
@@ -234,14 +238,31 @@ typedef struct texture_t {
     uint32_t   base;
     uint32_t   tLOD;
     atomic_int refcount;
-    atomic_int refcount_r[4];
+    atomic_int refcount_r[VOODOO_MAX_RENDER_THREADS];
     int        is16;
     uint32_t   palette_checksum;
     uint32_t   addr_start[4];
     uint32_t   addr_end[4];
     uint32_t  *data;
+    int        hash_next;
+    int        lru_prev;
+    int        lru_next;
 } texture_t;
 
+/*Each cached texture covers up to four address ranges, each of which may wrap
+  around the end of texture memory and so need two nodes.*/
+#define TEX_RANGES_PER_ENTRY 8
+
+typedef struct texture_range_t {
+    uint32_t start;
+    uint32_t end; /*exclusive*/
+    uint32_t max_end;
+    uint32_t prio;
+    int      left;
+    int      right;
+    int      in_tree;
+} texture_range_t;
+
 typedef struct vert_t {
     float sVx;
     float sVy;
@@ -362,25 +383,24 @@ typedef struct voodoo_t {
     int    ncc_dirty[2];
 
     thread_t *fifo_thread;
-    thread_t *render_thread[4];
+    thread_t *render_thread[VOODOO_MAX_RENDER_THREADS];
     event_t  *wake_fifo_thread;
     event_t  *wake_main_thread;
     event_t  *fifo_not_full_event;
-    event_t  *render_not_full_event[4];
-    event_t  *wake_render_thread[4];
+    event_t  *render_not_full_event[VOODOO_MAX_RENDER_THREADS];
+    event_t  *wake_render_thread[VOODOO_MAX_RENDER_THREADS];
 
     int voodoo_busy;
-    int render_voodoo_busy[4];
+    int render_voodoo_busy[VOODOO_MAX_RENDER_THREADS];
 
     int render_threads;
-    int odd_even_mask;
 
-    int pixel_count[4];
-    int texel_count[4];
+    int pixel_count[VOODOO_MAX_RENDER_THREADS];
+    int texel_count[VOODOO_MAX_RENDER_THREADS];
     int tri_count;
     int frame_count;
-    int pixel_count_old[4];
-    int texel_count_old[4];
+    int pixel_count_old[VOODOO_MAX_RENDER_THREADS];
+    int texel_count_old[VOODOO_MAX_RENDER_THREADS];
     int wr_count;
     int rd_count;
     int tex_count;
@@ -410,7 +430,7 @@ typedef struct voodoo_t {
     atomic_int   cmd_written_fifo;
 
     voodoo_params_t params_buffer[PARAM_SIZE];
-    atomic_int      params_read_idx[4];
+    atomic_int      params_read_idx[VOODOO_MAX_RENDER_THREADS];
     atomic_int      params_write_idx;
 
     uint32_t   cmdfifo_base;
@@ -642,27 +662,47 @@ typedef struct voodoo_t {
     uint8_t  thefilterb[256][256];
     uint16_t purpleline[256][3];
 
-    texture_t texture_cache[2][TEX_CACHE_MAX];
-    uint8_t   texture_present[2][16384];
-    int       texture_last_removed;
+    texture_t *texture_cache[2];
+    int        texture_cache_size;
+    int        texture_hash[2][TEX_HASH_SIZE];
+    int        texture_lru_head[2];
+    int        texture_lru_tail[2];
+    uint16_t   texture_present[2][16384];
+
+    texture_range_t *texture_ranges[2];
+    int              texture_range_root[2];
+    uint32_t         texture_range_seed;
+    int             *texture_evict_list;
+
+    uint64_t tex_evict_count;
+    uint64_t tex_replace_count;
+    uint64_t tex_wait_count;
 
     uint32_t palette_checksum[2];
-    int      palette_dirty[2];
 
     uint64_t time;
-    int      render_time[4];
+    int      render_time[VOODOO_MAX_RENDER_THREADS];
 
     int      force_blit_count;
     int      can_blit;
     mutex_t *force_blit_mutex;
 
-    int   use_recompiler;
-    void *codegen_data;
+    int      use_recompiler;
+    int      jit_warm_start;
+    void    *codegen_data;
+    void    *codegen_jit;
+    uint64_t jit_hit_count;
+    uint64_t jit_miss_count;
 
     struct voodoo_set_t *set;
 
     uint8_t fifo_thread_run;
-    uint8_t render_thread_run[4];
+    uint8_t render_thread_run[VOODOO_MAX_RENDER_THREADS];
+
+    struct voodoo_render_ctx_t {
+        struct voodoo_t *voodoo;
+        int              index;
+    } render_ctx[VOODOO_MAX_RENDER_THREADS];
 
     uint8_t *vram;
     uint8_t *changedvram;
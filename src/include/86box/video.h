@@ -146,6 +146,9 @@ extern monitor_settings_t monitor_settings[MONITORS_NUM];
 extern atomic_bool        doresize_monitors[MONITORS_NUM];
 extern int                monitor_index_global;
 extern int                show_second_monitors;
+extern int                video_render_worker;
+extern int                video_pacing;
+extern int                video_pacing_overlay;
 extern int                video_fullscreen_scale_maximized;
 
 typedef rgb_t PALETTE[256];
@@ -253,6 +256,8 @@ extern void video_blit_memtoscreen_8(int x, int y, int w, int h);
 extern void video_blend_monitor(int x, int y, int monitor_index);
 extern void video_process_8_monitor(int x, int y, int monitor_index);
 extern void video_blit_memtoscreen_monitor(int x, int y, int w, int h, int monitor_index);
+extern void video_blit_memtoscreen_dirty_monitor(int x, int y, int w, int h, int dirty_y, int dirty_h, int monitor_index);
+extern void video_blit_get_dirty_monitor(int monitor_index, int *dirty_y, int *dirty_h);
 extern void video_blit_complete_monitor(int monitor_index);
 extern void video_wait_for_blit_monitor(int monitor_index);
 extern void video_wait_for_buffer_monitor(int monitor_index);
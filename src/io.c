@@ -55,9 +55,33 @@ typedef struct {
     void     *priv;
 } io_trap_t;
 
-int   initialized = 0;
-io_t *io[NPORTS];
-io_t *io_last[NPORTS];
+/* Compiled per-port dispatch. For each access width, if exactly one handler
+   answers an access at this port (with no narrower handlers that would have
+   to be merged in), the handler and its private data are cached here so the
+   access is a single indirect call. Otherwise the function pointer is NULL
+   and the full chain in io[] is walked. */
+typedef struct {
+    uint8_t (*inb)(uint16_t addr, void *priv);
+    uint16_t (*inw)(uint16_t addr, void *priv);
+    uint32_t (*inl)(uint16_t addr, void *priv);
+
+    void (*outb)(uint16_t addr, uint8_t val, void *priv);
+    void (*outw)(uint16_t addr, uint16_t val, void *priv);
+    void (*outl)(uint16_t addr, uint32_t val, void *priv);
+
+    void *inb_priv;
+    void *inw_priv;
+    void *inl_priv;
+
+    void *outb_priv;
+    void *outw_priv;
+    void *outl_priv;
+} io_dispatch_t;
+
+int           initialized = 0;
+io_t         *io[NPORTS];
+io_t         *io_last[NPORTS];
+io_dispatch_t io_disp[NPORTS];
 
 #ifdef ENABLE_IO_LOG
 int io_do_log = ENABLE_IO_LOG;
@@ -77,6 +101,120 @@ io_log(const char *fmt, ...)
 #    define io_log(fmt, ...)
 #endif
 
+/* Does any handler at port answer byte accesses that a wider access has to
+   merge in? */
+static int
+io_has_narrow_in(uint16_t port, int width)
+{
+    for (io_t *p = io[port]; p; p = p->next) {
+        if ((width > 1) && p->inb && !p->inw && ((width == 2) || !p->inl))
+            return 1;
+        if ((width > 2) && p->inw && !p->inl)
+            return 1;
+    }
+
+    return 0;
+}
+
+static int
+io_has_narrow_out(uint16_t port, int width)
+{
+    for (io_t *p = io[port]; p; p = p->next) {
+        if ((width > 1) && p->outb && !p->outw && ((width == 2) || !p->outl))
+            return 1;
+        if ((width > 2) && p->outw && !p->outl)
+            return 1;
+    }
+
+    return 0;
+}
+
+/* Rebuild the compiled dispatch entry for a single port. */
+static void
+io_dispatch_update(uint16_t port)
+{
+    io_dispatch_t *d = &io_disp[port];
+    io_t          *inb_p  = NULL;
+    io_t          *inw_p  = NULL;
+    io_t          *inl_p  = NULL;
+    io_t          *outb_p = NULL;
+    io_t          *outw_p = NULL;
+    io_t          *outl_p = NULL;
+    int            inb_n  = 0;
+    int            inw_n  = 0;
+    int            inl_n  = 0;
+    int            outb_n = 0;
+    int            outw_n = 0;
+    int            outl_n = 0;
+
+    memset(d, 0, sizeof(io_dispatch_t));
+
+    for (io_t *p = io[port]; p; p = p->next) {
+        if (p->inb) {
+            inb_p = p;
+            inb_n++;
+        }
+        if (p->inw) {
+            inw_p = p;
+            inw_n++;
+        }
+        if (p->inl) {
+            inl_p = p;
+            inl_n++;
+        }
+        if (p->outb) {
+            outb_p = p;
+            outb_n++;
+        }
+        if (p->outw) {
+            outw_p = p;
+            outw_n++;
+        }
+        if (p->outl) {
+            outl_p = p;
+            outl_n++;
+        }
+    }
+
+    if (inb_n == 1) {
+        d->inb      = inb_p->inb;
+        d->inb_priv = inb_p->priv;
+    }
+    if (outb_n == 1) {
+        d->outb      = outb_p->outb;
+        d->outb_priv = outb_p->priv;
+    }
+
+    if ((inw_n == 1) && !io_has_narrow_in(port, 2) && !io_has_narrow_in(port + 1, 2)) {
+        d->inw      = inw_p->inw;
+        d->inw_priv = inw_p->priv;
+    }
+    if ((outw_n == 1) && !io_has_narrow_out(port, 2) && !io_has_narrow_out(port + 1, 2)) {
+        d->outw      = outw_p->outw;
+        d->outw_priv = outw_p->priv;
+    }
+
+    if ((inl_n == 1) && !io_has_narrow_in(port, 4) && !io_has_narrow_in(port + 1, 4) &&
+        !io_has_narrow_in(port + 2, 4) && !io_has_narrow_in(port + 3, 4)) {
+        d->inl      = inl_p->inl;
+        d->inl_priv = inl_p->priv;
+    }
+    if ((outl_n == 1) && !io_has_narrow_out(port, 4) && !io_has_narrow_out(port + 1, 4) &&
+        !io_has_narrow_out(port + 2, 4) && !io_has_narrow_out(port + 3, 4)) {
+        d->outl      = outl_p->outl;
+        d->outl_priv = outl_p->priv;
+    }
+}
+
+/* Rebuild the dispatch entries for every port whose word or dword accesses
+   can reach a port in the range. */
+static void
+io_dispatch_update_range(uint16_t base, int size)
+{
+    for (int c = -3; c < size; c++)
+        io_dispatch_update((uint16_t) (base + c));
+}
+
 void
 io_init(void)
 {
@@ -106,6 +244,8 @@ io_init(void)
         /* io[c] should be NULL. */
         io[c] = io_last[c] = NULL;
     }
+
+    memset(io_disp, 0, sizeof(io_disp));
 }
 
 void
@@ -146,6 +286,8 @@ io_sethandler_common(uint16_t base, int size,
 
         io_last[base + c] = q;
     }
+
+    io_dispatch_update_range(base, size);
 }
 
 void
@@ -183,6 +325,8 @@ io_removehandler_common(uint16_t base, int size,
             p = q;
         }
     }
+
+    io_dispatch_update_range(base, size);
 }
 
 void
@@ -357,6 +501,12 @@ inb(uint16_t port)
         found = 1;
 #ifdef ENABLE_IO_LOG
         qfound = 1;
+#endif
+    } else if (io_disp[port].inb) {
+        ret   = io_disp[port].inb(port, io_disp[port].inb_priv);
+        found = 1;
+#ifdef ENABLE_IO_LOG
+        qfound = 1;
 #endif
     } else {
         p = io[port];
@@ -421,6 +571,12 @@ outb(uint16_t port, uint8_t val)
         found = 1;
 #ifdef ENABLE_IO_LOG
         qfound = 1;
+#endif
+    } else if (io_disp[port].outb) {
+        io_disp[port].outb(port, val, io_disp[port].outb_priv);
+        found = 1;
+#ifdef ENABLE_IO_LOG
+        qfound = 1;
 #endif
     } else {
         p = io[port];
@@ -477,6 +633,12 @@ inw(uint16_t port)
         found = 2;
 #ifdef ENABLE_IO_LOG
         qfound = 1;
+#endif
+    } else if (io_disp[port].inw) {
+        ret   = io_disp[port].inw(port, io_disp[port].inw_priv);
+        found = 2;
+#ifdef ENABLE_IO_LOG
+        qfound = 1;
 #endif
     } else {
         p = io[port];
@@ -553,6 +715,12 @@ outw(uint16_t port, uint16_t val)
         found = 2;
 #ifdef ENABLE_IO_LOG
         qfound = 1;
+#endif
+    } else if (io_disp[port].outw) {
+        io_disp[port].outw(port, val, io_disp[port].outw_priv);
+        found = 2;
+#ifdef ENABLE_IO_LOG
+        qfound = 1;
 #endif
     } else {
         p = io[port];
@@ -625,6 +793,12 @@ inl(uint16_t port)
         found = 4;
 #ifdef ENABLE_IO_LOG
         qfound = 1;
+#endif
+    } else if (io_disp[port].inl) {
+        ret   = io_disp[port].inl(port, io_disp[port].inl_priv);
+        found = 4;
+#ifdef ENABLE_IO_LOG
+        qfound = 1;
 #endif
     } else {
         p = io[port];
@@ -733,6 +907,12 @@ outl(uint16_t port, uint32_t val)
         found = 4;
 #ifdef ENABLE_IO_LOG
         qfound = 1;
+#endif
+    } else if (io_disp[port].outl) {
+        io_disp[port].outl(port, val, io_disp[port].outl_priv);
+        found = 4;
+#ifdef ENABLE_IO_LOG
+        qfound = 1;
 #endif
     } else {
         p = io[port];
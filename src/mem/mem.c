@@ -110,12 +110,51 @@ int mem_a20_state = 0;
 int mmuflush = 0;
 int mmu_perm = 4;
 
+/* Software TLB statistics, sampled once per second by mem_tlb_stats_update(). */
+static uint32_t mmu_refills         = 0;
+static uint32_t mmu_global_kept     = 0;
+static int      mmu_flushes_last    = 0;
+uint32_t        mmu_flushes_sec     = 0;
+uint32_t        mmu_refills_sec     = 0;
+uint32_t        mmu_global_kept_sec = 0;
+
+/* Page of the last translation through a global (G bit set) page table
+   entry, 0xffffffff if it was not global. Picked up by addreadlookup() and
+   addwritelookup() so CR3 loads can keep the entries. */
+static uint32_t mmu_global_page = 0xffffffff;
+static uint8_t  readlookup_global[256];
+static uint8_t  writelookup_global[256];
+
 #ifdef USE_NEW_DYNAREC
 uint64_t *byte_dirty_mask;
 uint64_t *byte_code_present_mask;
 
 uint32_t purgable_page_list_head = 0;
 int      purgeable_page_count    = 0;
+
+mem_tlb_t read_tlb[MEM_TLB_SIZE];
+mem_tlb_t write_tlb[MEM_TLB_SIZE];
+
+static __inline void
+mem_tlb_set(mem_tlb_t *tlb, uint32_t page, uintptr_t addend)
+{
+    mem_tlb_t *entry = &tlb[page & (MEM_TLB_SIZE - 1)];
+
+    entry->tag    = page;
+    entry->addend = addend;
+}
+
+static __inline void
+mem_tlb_invalidate(mem_tlb_t *tlb, uint32_t page)
+{
+    mem_tlb_t *entry = &tlb[page & (MEM_TLB_SIZE - 1)];
+
+    if (entry->tag == page)
+        entry->tag = MEM_TLB_INV;
+}
+#else
+#    define mem_tlb_set(tlb, page, addend)
+#    define mem_tlb_invalidate(tlb, page)
 #endif
 
 uint8_t high_page = 0; /* if a high (> 4 gb) page was detected */
@@ -192,29 +231,53 @@ resetreadlookup(void)
     memset(writelookup2, 0xff, (1 << 20) * sizeof(uintptr_t));
     memset(writelookupp, 0x04, (1 << 20) * sizeof(uint8_t));
 
+#ifdef USE_NEW_DYNAREC
+    for (uint16_t c = 0; c < MEM_TLB_SIZE; c++) {
+        read_tlb[c].tag  = MEM_TLB_INV;
+        write_tlb[c].tag = MEM_TLB_INV;
+    }
+#endif
+
     readlnext  = 0;
     writelnext = 0;
     pccache    = 0xffffffff;
     high_page  = 0;
 }
 
-void
-flushmmucache(void)
+static void
+flushmmucache_lookups(int keep_global)
 {
     for (uint16_t c = 0; c < 256; c++) {
         if (readlookup[c] != (int) 0xffffffff) {
-            readlookup2[readlookup[c]] = LOOKUP_INV;
-            readlookupp[readlookup[c]] = 4;
-            readlookup[c]              = 0xffffffff;
+            if (keep_global && readlookup_global[c])
+                mmu_global_kept++;
+            else {
+                mem_tlb_invalidate(read_tlb, readlookup[c]);
+                readlookup2[readlookup[c]] = LOOKUP_INV;
+                readlookupp[readlookup[c]] = 4;
+                readlookup[c]              = 0xffffffff;
+            }
         }
         if (writelookup[c] != (int) 0xffffffff) {
-            page_lookup[writelookup[c]]  = NULL;
-            page_lookupp[writelookup[c]] = 4;
-            writelookup2[writelookup[c]] = LOOKUP_INV;
-            writelookupp[writelookup[c]] = 4;
-            writelookup[c]               = 0xffffffff;
+            if (keep_global && writelookup_global[c])
+                mmu_global_kept++;
+            else {
+                page_lookup[writelookup[c]]  = NULL;
+                page_lookupp[writelookup[c]] = 4;
+                mem_tlb_invalidate(write_tlb, writelookup[c]);
+                writelookup2[writelookup[c]] = LOOKUP_INV;
+                writelookupp[writelookup[c]] = 4;
+                writelookup[c]               = 0xffffffff;
+            }
         }
     }
+    mmu_global_page = 0xffffffff;
+}
+
+void
+flushmmucache(void)
+{
+    flushmmucache_lookups(0);
     mmuflush++;
 
     pccache  = (uint32_t) 0xffffffff;
@@ -225,23 +288,47 @@ flushmmucache(void)
 #endif
 }
 
+/* Flush the page lookups on a CR3 load. With CR4.PGE set, translations made
+   through global pages survive, as they do in a real TLB. */
 void
-flushmmucache_nopc(void)
+flushmmucache_nonglobal(void)
 {
-    for (uint16_t c = 0; c < 256; c++) {
-        if (readlookup[c] != (int) 0xffffffff) {
-            readlookup2[readlookup[c]] = LOOKUP_INV;
-            readlookupp[readlookup[c]] = 4;
-            readlookup[c]              = 0xffffffff;
-        }
-        if (writelookup[c] != (int) 0xffffffff) {
-            page_lookup[writelookup[c]]  = NULL;
-            page_lookupp[writelookup[c]] = 4;
-            writelookup2[writelookup[c]] = LOOKUP_INV;
-            writelookupp[writelookup[c]] = 4;
-            writelookup[c]               = 0xffffffff;
-        }
+    if (!(cr4 & CR4_PGE)) {
+        flushmmucache();
+        return;
     }
+
+    flushmmucache_lookups(1);
+    mmuflush++;
+
+    pccache  = (uint32_t) 0xffffffff;
+    pccache2 = (uint8_t *) 0xffffffff;
+
+#ifdef USE_DYNAREC
+    codegen_flush();
+#endif
+}
+
+void
+flushmmucache_nopc(void)
+{
+    flushmmucache_lookups(0);
+}
+
+/* Called once per second to sample the software TLB statistics. */
+void
+mem_tlb_stats_update(void)
+{
+    mmu_flushes_sec     = (uint32_t) mmuflush - (uint32_t) mmu_flushes_last;
+    mmu_refills_sec     = mmu_refills;
+    mmu_global_kept_sec = mmu_global_kept;
+
+    if (mmu_flushes_sec || mmu_refills_sec)
+        mem_log("TLB: %u flushes, %u refills, %u global entries kept\n", mmu_flushes_sec, mmu_refills_sec, mmu_global_kept_sec);
+
+    mmu_flushes_last = mmuflush;
+    mmu_refills      = 0;
+    mmu_global_kept  = 0;
 }
 
 void
@@ -267,6 +354,7 @@ mem_flush_write_page(uint32_t addr, uint32_t virt)
 #endif
 
             if (writelookup2[writelookup[c]] == target || page_lookup[writelookup[c]] == page_target) {
+                mem_tlb_invalidate(write_tlb, writelookup[c]);
                 writelookup2[writelookup[c]] = LOOKUP_INV;
                 page_lookup[writelookup[c]]  = NULL;
                 writelookup[c]               = 0xffffffff;
@@ -280,6 +368,15 @@ mem_flush_write_page(uint32_t addr, uint32_t virt)
 #define rammap(x)                ((uint32_t *) (_mem_exec[(x) >> MEM_GRANULARITY_BITS]))[((x) >> 2) & MEM_GRANULARITY_QMASK]
 #define rammap64(x)              ((uint64_t *) (_mem_exec[(x) >> MEM_GRANULARITY_BITS]))[((x) >> 3) & MEM_GRANULARITY_PMASK]
 
+static __inline void
+mmu_set_global(uint32_t addr, uint64_t pte)
+{
+    if ((cr4 & CR4_PGE) && (pte & 0x100))
+        mmu_global_page = addr >> 12;
+    else
+        mmu_global_page = 0xffffffff;
+}
+
 static __inline uint64_t
 mmutranslatereal_normal(uint32_t addr, int rw)
 {
@@ -321,6 +418,7 @@ mmutranslatereal_normal(uint32_t addr, int rw)
         }
 
         mmu_perm = temp & 4;
+        mmu_set_global(addr, temp);
         rammap(addr2) |= (rw ? 0x60 : 0x20);
 
         return (temp & ~0x3fffff) + (addr & 0x3fffff);
@@ -341,6 +439,7 @@ mmutranslatereal_normal(uint32_t addr, int rw)
     }
 
     mmu_perm = temp & 4;
+    mmu_set_global(addr, temp);
     rammap(addr2) |= 0x20;
     rammap((temp2 & ~0xfff) + ((addr >> 10) & 0xffc)) |= (rw ? 0x60 : 0x20);
 
@@ -405,6 +504,7 @@ mmutranslatereal_pae(uint32_t addr, int rw)
             return 0xffffffffffffffffULL;
         }
         mmu_perm = temp & 4;
+        mmu_set_global(addr, temp);
         rammap64(addr3) |= (rw ? 0x60 : 0x20);
 
         return ((temp & ~0x1fffffULL) + (addr & 0x1fffffULL)) & 0x000000ffffffffffULL;
@@ -426,6 +526,7 @@ mmutranslatereal_pae(uint32_t addr, int rw)
     }
 
     mmu_perm = temp & 4;
+    mmu_set_global(addr, temp);
     rammap64(addr3) |= 0x20;
     rammap64(addr4) |= (rw ? 0x60 : 0x20);
 
@@ -584,6 +685,7 @@ addreadlookup(uint32_t virt, uint32_t phys)
     if (readlookup[readlnext] != (int) 0xffffffff) {
         if ((readlookup[readlnext] == ((es + DI) >> 12)) || (readlookup[readlnext] == ((es + EDI) >> 12)))
             uncached = 1;
+        mem_tlb_invalidate(read_tlb, readlookup[readlnext]);
         readlookup2[readlookup[readlnext]] = LOOKUP_INV;
     }
 
@@ -598,9 +700,12 @@ addreadlookup(uint32_t virt, uint32_t phys)
         readlookup2[virt >> 12] = (uintptr_t) &ram[a];
 #endif
     readlookupp[virt >> 12] = mmu_perm;
+    mem_tlb_set(read_tlb, virt >> 12, readlookup2[virt >> 12]);
 
-    readlookup[readlnext++] = virt >> 12;
+    readlookup_global[readlnext] = (cr0 >> 31) && ((virt >> 12) == mmu_global_page);
+    readlookup[readlnext++]      = virt >> 12;
     readlnext &= (cachesize - 1);
+    mmu_refills++;
 
     cycles -= 9;
 }
@@ -620,6 +725,7 @@ addwritelookup(uint32_t virt, uint32_t phys)
 
     if (writelookup[writelnext] != -1) {
         page_lookup[writelookup[writelnext]]  = NULL;
+        mem_tlb_invalidate(write_tlb, writelookup[writelnext]);
         writelookup2[writelookup[writelnext]] = LOOKUP_INV;
     }
 
@@ -649,15 +755,152 @@ addwritelookup(uint32_t virt, uint32_t phys)
         else
             writelookup2[virt >> 12] = (uintptr_t) &ram[a];
 #endif
+        mem_tlb_set(write_tlb, virt >> 12, writelookup2[virt >> 12]);
     }
     writelookupp[virt >> 12] = mmu_perm;
 
-    writelookup[writelnext++] = virt >> 12;
+    writelookup_global[writelnext] = (cr0 >> 31) && ((virt >> 12) == mmu_global_page);
+    writelookup[writelnext++]      = virt >> 12;
     writelnext &= (cachesize - 1);
+    mmu_refills++;
 
     cycles -= 9;
 }
 
+/* Looks up the mapping behind linear address virt for a bulk string access,
+   returns it if it has a block handler for the access and no RAM behind it,
+   NULL otherwise. The translation is the one the first element would do, so
+   a page fault is raised here on the same element as on the normal path. */
+static mem_mapping_t *
+mem_block_mapping(uint32_t virt, int write, uint32_t *phys)
+{
+    mem_mapping_t *map;
+    uint64_t       a = virt;
+
+    if (write && page_lookup[virt >> 12] && page_lookup[virt >> 12]->write_b)
+        return NULL;
+
+    if (cr0 >> 31) {
+        a = mmutranslatereal(virt, write);
+        if (a > 0xffffffffULL)
+            return NULL;
+    }
+    a &= rammask;
+
+    map = write ? write_mapping[a >> MEM_GRANULARITY_BITS] : read_mapping[a >> MEM_GRANULARITY_BITS];
+    if ((map == NULL) || (map->exec != NULL) || ((write ? (void *) map->write_block : (void *) map->read_block) == NULL))
+        return NULL;
+
+    *phys = (uint32_t) a;
+    return map;
+}
+
+/* Bulk copy for REP MOVS: copies up to count elements of size bytes from
+   linear address src to dest, stopping at the end of either page. RAM pages
+   are only handled if already in readlookup2/writelookup2, which are plain
+   RAM and, for writes, have no code on them, so there are no dirty masks to
+   update - the same as the single element fast path. Other pages are handled
+   if their mapping has a block handler. Returns the number of elements
+   copied, 0 if the caller has to fall back to the per element path. */
+uint32_t
+mem_movs_bulk(uint32_t src, uint32_t dest, uint32_t count, int size)
+{
+    uint32_t       src_left  = (0x1000 - (src & 0xfff)) / size;
+    uint32_t       dest_left = (0x1000 - (dest & 0xfff)) / size;
+    mem_mapping_t *src_map   = NULL;
+    mem_mapping_t *dest_map  = NULL;
+    uint32_t       src_phys  = 0;
+    uint32_t       dest_phys = 0;
+    uint8_t        buf[0x1000];
+    const uint8_t *s;
+    uint8_t       *d;
+
+    if (count > src_left)
+        count = src_left;
+    if (count > dest_left)
+        count = dest_left;
+    if (!count)
+        return 0;
+
+    if (readlookup2[src >> 12] == (uintptr_t) LOOKUP_INV) {
+        src_map = mem_block_mapping(src, 0, &src_phys);
+        if (src_map == NULL)
+            return 0;
+    }
+    if (writelookup2[dest >> 12] == (uintptr_t) LOOKUP_INV) {
+        dest_map = mem_block_mapping(dest, 1, &dest_phys);
+        if ((dest_map == NULL) || (dest_map == src_map))
+            return 0;
+    }
+
+    if (src_map != NULL) {
+        src_map->read_block(src_phys, buf, count * size, size, src_map->priv);
+        s = buf;
+    } else
+        s = (const uint8_t *) (readlookup2[src >> 12] + src);
+
+    if (dest_map != NULL) {
+        dest_map->write_block(dest_phys, s, count * size, size, dest_map->priv);
+        return count;
+    }
+
+    d = (uint8_t *) (writelookup2[dest >> 12] + dest);
+
+    /* Copying one element at a time repeats the data when the destination
+       starts inside the source, memmove() would not. */
+    if ((s != buf) && (d > s) && (d < (s + count * size)))
+        return 0;
+
+    memmove(d, s, count * size);
+    mmu_perm = writelookupp[dest >> 12];
+
+    return count;
+}
+
+/* Bulk fill for REP STOS, with the same restrictions as mem_movs_bulk(). */
+uint32_t
+mem_stos_bulk(uint32_t dest, uint32_t count, int size, uint32_t val)
+{
+    uint32_t       dest_left = (0x1000 - (dest & 0xfff)) / size;
+    mem_mapping_t *dest_map  = NULL;
+    uint32_t       dest_phys = 0;
+    uint8_t        buf[0x1000];
+    uint32_t       len;
+    uint32_t       done;
+    uint8_t       *d;
+
+    if (count > dest_left)
+        count = dest_left;
+    if (!count)
+        return 0;
+
+    if (writelookup2[dest >> 12] == (uintptr_t) LOOKUP_INV) {
+        dest_map = mem_block_mapping(dest, 1, &dest_phys);
+        if (dest_map == NULL)
+            return 0;
+        d = buf;
+    } else
+        d = (uint8_t *) (writelookup2[dest >> 12] + dest);
+
+    len = count * size;
+
+    if ((size == 1) || ((size == 2) && ((val & 0xff) == ((val >> 8) & 0xff))) || (val == ((val & 0xff) * 0x01010101)))
+        memset(d, val & 0xff, len);
+    else {
+        /* Store one element, then keep doubling the filled span. */
+        memcpy(d, &val, size);
+        for (done = size; done < len; done += done)
+            memcpy(d + done, d, ((len - done) < done) ? (len - done) : done);
+    }
+
+    if (dest_map != NULL)
+        dest_map->write_block(dest_phys, buf, len, size, dest_map->priv);
+    else
+        mmu_perm = writelookupp[dest >> 12];
+
+    return count;
+}
+
 uint8_t *
 getpccache(uint32_t a)
 {
@@ -1810,6 +2053,37 @@ mem_write_phys(void *src, uint32_t addr, int transfer_size)
     }
 }
 
+/* Hand a run of transfer_size accesses within one 4k page to the block
+   handler of the bus mapping behind it. Returns 0 if there is none, in which
+   case the caller has to do the accesses one by one. */
+int
+mem_read_phys_block(void *dest, uint32_t addr, uint32_t len, int transfer_size)
+{
+    mem_mapping_t *map = read_mapping_bus[addr >> MEM_GRANULARITY_BITS];
+
+    if ((map == NULL) || (map->exec != NULL) || (map->read_block == NULL))
+        return 0;
+
+    mem_logical_addr = 0xffffffff;
+    map->read_block(addr, (uint8_t *) dest, len, transfer_size, map->priv);
+
+    return 1;
+}
+
+int
+mem_write_phys_block(const void *src, uint32_t addr, uint32_t len, int transfer_size)
+{
+    mem_mapping_t *map = write_mapping_bus[addr >> MEM_GRANULARITY_BITS];
+
+    if ((map == NULL) || (map->exec != NULL) || (map->write_block == NULL))
+        return 0;
+
+    mem_logical_addr = 0xffffffff;
+    map->write_block(addr, (const uint8_t *) src, len, transfer_size, map->priv);
+
+    return 1;
+}
+
 uint8_t
 mem_read_ram(uint32_t addr, UNUSED(void *priv))
 {
@@ -2478,6 +2752,9 @@ mem_mapping_set(mem_mapping_t *map,
     map->flags   = fl;
     map->priv    = priv;
     map->next    = NULL;
+
+    map->read_block  = NULL;
+    map->write_block = NULL;
     mem_log("mem_mapping_add(): Linked list structure: %08X -> %08X -> %08X\n", map->prev, map, map->next);
 
     /* If the mapping is disabled, there is no need to recalc anything. */
@@ -2553,9 +2830,22 @@ mem_mapping_set_handler(mem_mapping_t *map,
     map->write_w = write_w;
     map->write_l = write_l;
 
+    /* The block handlers belong to the old single access handlers. */
+    map->read_block  = NULL;
+    map->write_block = NULL;
+
     mem_mapping_recalc(map->base, map->size);
 }
 
+void
+mem_mapping_set_block_handler(mem_mapping_t *map,
+                              void (*read_block)(uint32_t addr, uint8_t *buf, uint32_t len, int size, void *priv),
+                              void (*write_block)(uint32_t addr, const uint8_t *buf, uint32_t len, int size, void *priv))
+{
+    map->read_block  = read_block;
+    map->write_block = write_block;
+}
+
 void
 mem_mapping_set_write_handler(mem_mapping_t *map,
                               void (*write_b)(uint32_t addr, uint8_t val, void *priv),
@@ -2566,6 +2856,8 @@ mem_mapping_set_write_handler(mem_mapping_t *map,
     map->write_w = write_w;
     map->write_l = write_l;
 
+    map->write_block = NULL;
+
     mem_mapping_recalc(map->base, map->size);
 }
 
@@ -31,6 +31,7 @@ extern "C" {
 #include <86box/86box.h>
 #include <86box/plat.h>
 #include <86box/video.h>
+#include <86box/vid_pacing.h>
 }
 
 void
@@ -175,6 +176,9 @@ HardwareRenderer::paintGL()
     m_texture->bind();
     m_texture->setMinMagFilters(video_filter_method ? QOpenGLTexture::Linear : QOpenGLTexture::Nearest, video_filter_method ? QOpenGLTexture::Linear : QOpenGLTexture::Nearest);
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+    /* QOpenGLWindow swaps right after this returns. */
+    video_pacing_present(r_monitor_index);
 }
 
 void
@@ -54,6 +54,7 @@ extern "C" {
 #include <86box/cartridge.h>
 #include <86box/fdd.h>
 #include <86box/fdd_86f.h>
+#include <86box/hdd.h>
 #include <86box/cdrom.h>
 #include <86box/scsi_device.h>
 #include <86box/zip.h>
@@ -228,6 +229,18 @@ MediaMenu::refresh(QMenu *parentMenu)
         netMenus[i] = menu;
         nicUpdateMenu(i);
     });
+
+    hddMenus.clear();
+    for (int i = 0; i < HDD_NUM; i++) {
+        if (!hdd_is_valid(i) || (hdd[i].overlay_fn[0] == 0x00))
+            continue;
+
+        auto *menu = parentMenu->addMenu("");
+        menu->addAction(tr("&Commit changes to base image"), [this, i]() { hddOverlayCommit(i); });
+        menu->addAction(tr("&Discard changes"), [this, i]() { hddOverlayDiscard(i); });
+        hddMenus[i] = menu;
+        hddUpdateMenu(i);
+    }
     parentMenu->addAction(tr("Clear image history"), [this]() { clearImageHistory(); });
 }
 
@@ -1176,3 +1189,42 @@ mo_reload(uint8_t id)
     MediaMenu::ptr->moReloadPrev(id);
 }
 }
+
+void
+MediaMenu::hddOverlayCommit(int i)
+{
+    if (QMessageBox::question(parentWidget, tr("Commit changes"),
+                              tr("Are you sure you want to write all changes in the overlay to the base image?"))
+        != QMessageBox::Yes)
+        return;
+
+    plat_pause(1);
+    if (hdd_image_overlay_commit(i) == 0)
+        QMessageBox::critical(parentWidget, tr("Unable to commit changes"), tr("Make sure the base image is writable and there is enough free disk space. The changes have been kept in the overlay."));
+    plat_pause(0);
+}
+
+void
+MediaMenu::hddOverlayDiscard(int i)
+{
+    if (QMessageBox::question(parentWidget, tr("Discard changes"),
+                              tr("Are you sure you want to discard all changes since the last commit? The guest may need to be restarted."))
+        != QMessageBox::Yes)
+        return;
+
+    plat_pause(1);
+    if (hdd_image_overlay_discard(i) == 0)
+        QMessageBox::critical(parentWidget, tr("Unable to discard changes"), tr("Make sure the overlay file is writable"));
+    plat_pause(0);
+}
+
+void
+MediaMenu::hddUpdateMenu(int i)
+{
+    if (!hddMenus.contains(i))
+        return;
+
+    QFileInfo fi(hdd[i].overlay_fn);
+    hddMenus[i]->setTitle(QString::asprintf(tr("Hard disk %02i overlay: %s").toUtf8().constData(), i + 1,
+                                            fi.fileName().toUtf8().constData()));
+}
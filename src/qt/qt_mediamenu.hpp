@@ -71,6 +71,10 @@ public:
     void nicDisconnect(int i);
     void nicUpdateMenu(int i);
 
+    void hddOverlayCommit(int i);
+    void hddOverlayDiscard(int i);
+    void hddUpdateMenu(int i);
+
 public slots:
     void cdromUpdateUi(int i);
 
@@ -87,6 +91,7 @@ private:
     QMap<int, QMenu *> zipMenus;
     QMap<int, QMenu *> moMenus;
     QMap<int, QMenu *> netMenus;
+    QMap<int, QMenu *> hddMenus;
 
     QString                 getMediaOpenDirectory();
     ui::MediaHistoryManager mhm;
@@ -27,6 +27,12 @@
 #include "qt_opengloptionsdialog.hpp"
 #include "qt_openglrenderer.hpp"
 
+#include <minitrace/minitrace.h>
+
+extern "C" {
+#include <86box/vid_pacing.h>
+}
+
 #ifndef GL_MAP_PERSISTENT_BIT
 #    define GL_MAP_PERSISTENT_BIT 0x0040
 #endif
@@ -223,6 +229,13 @@ OpenGLRenderer::finalize()
 
     context->makeCurrent(this);
 
+    for (auto &fence : fences) {
+        if (fence) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+
     if (hasBufferStorage)
         glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
 
@@ -261,6 +274,13 @@ OpenGLRenderer::initializeExtensions()
             glBufferStorage = (PFNGLBUFFERSTORAGEEXTPROC_LOCAL) context->getProcAddress("glBufferStorage");
     }
 #endif
+
+    auto version = context->format().version();
+
+    if (context->isOpenGLES())
+        hasSync = version.first >= 3;
+    else
+        hasSync = (version >= qMakePair(3, 2)) || context->hasExtension("GL_ARB_sync");
 }
 
 void
@@ -378,8 +398,13 @@ OpenGLRenderer::applyShader(const OpenGLShaderPass &shader)
 void
 OpenGLRenderer::render()
 {
+    MTR_BEGIN("video", "opengl_present");
+
     context->makeCurrent(this);
 
+    for (int i = 0; i < BUFFERCOUNT; i++)
+        releaseBuffer(i, false);
+
     if (options->filter() != currentFilter)
         applyOptions();
 
@@ -390,8 +415,11 @@ OpenGLRenderer::render()
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
     context->swapBuffers(this);
+    video_pacing_present(r_monitor_index);
 
     frameCounter = (frameCounter + 1) & 1023;
+
+    MTR_END("video", "opengl_present");
 }
 
 void
@@ -426,11 +454,34 @@ OpenGLRenderer::getBuffers()
     return buffers;
 }
 
+/* Hand a persistent buffer back to the blitter once the GPU has finished
+   reading it, optionally waiting for that. */
 void
-OpenGLRenderer::onBlit(int buf_idx, int x, int y, int w, int h)
+OpenGLRenderer::releaseBuffer(int buf_idx, bool wait)
 {
-    if (notReady())
+    GLenum res;
+
+    if (!fences[buf_idx])
+        return;
+
+    res = glClientWaitSync(fences[buf_idx], wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000 : 0);
+    if (res == GL_TIMEOUT_EXPIRED)
+        return;
+
+    glDeleteSync(fences[buf_idx]);
+    fences[buf_idx] = nullptr;
+    buf_usage[buf_idx].clear();
+}
+
+void
+OpenGLRenderer::onBlit(int buf_idx, int x, int y, int w, int h, int dirty_y, int dirty_h)
+{
+    if (notReady()) {
+        fullUpload = true;
         return;
+    }
+
+    MTR_BEGIN("video", "opengl_upload");
 
     context->makeCurrent(this);
 
@@ -449,19 +500,47 @@ OpenGLRenderer::onBlit(int buf_idx, int x, int y, int w, int h)
         glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
         glTexImage2D(GL_TEXTURE_2D, 0, (GLenum) QOpenGLTexture::RGBA8_UNorm, source.width(), source.height(), 0, (GLenum) QOpenGLTexture::BGRA, (GLenum) QOpenGLTexture::UInt32_RGBA8_Rev, NULL);
         glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBufferID);
+
+        fullUpload = true;
+    }
+
+    /* The texture holds the previous frame, only the rows that changed
+       since then have to be uploaded. */
+    if (fullUpload) {
+        dirty_y    = 0;
+        dirty_h    = h;
+        fullUpload = false;
     }
 
-    if (!hasBufferStorage)
-        glBufferSubData(GL_PIXEL_UNPACK_BUFFER, BUFFERBYTES * buf_idx, h * ROW_LENGTH * sizeof(uint32_t) + (y * ROW_LENGTH * sizeof(uint32_t)), (uint8_t *) unpackBuffer + BUFFERBYTES * buf_idx);
+    if (dirty_h > 0) {
+        const int offset = BUFFERPIXELS * buf_idx + (y + dirty_y) * ROW_LENGTH;
 
-    glPixelStorei(GL_UNPACK_SKIP_PIXELS, BUFFERPIXELS * buf_idx + y * ROW_LENGTH + x);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, ROW_LENGTH);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, (GLenum) QOpenGLTexture::BGRA, (GLenum) QOpenGLTexture::UInt32_RGBA8_Rev, NULL);
+        if (!hasBufferStorage)
+            glBufferSubData(GL_PIXEL_UNPACK_BUFFER, offset * sizeof(uint32_t), dirty_h * ROW_LENGTH * sizeof(uint32_t), (uint32_t *) unpackBuffer + offset);
 
-    /* TODO: check if fence sync is implementable here and still has any benefit. */
-    glFinish();
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, offset + x);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, ROW_LENGTH);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, dirty_y, w, dirty_h, (GLenum) QOpenGLTexture::BGRA, (GLenum) QOpenGLTexture::UInt32_RGBA8_Rev, NULL);
 
-    buf_usage[buf_idx].clear();
+        /* The blitter writes straight into the persistent buffer, so it may
+           only have it back once the upload from it is done. Fence it rather
+           than stalling here, the other buffers take the next frames. */
+        if (hasBufferStorage && hasSync) {
+            fences[buf_idx] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+        } else
+            glFinish();
+    }
+
+    if (!fences[buf_idx])
+        buf_usage[buf_idx].clear();
+
+    /* Keep the buffer the next blit goes to free, so that at most two
+       uploads are ever in flight and a blit is never dropped for want of
+       one. That upload is two frames old and normally long done. */
+    releaseBuffer((buf_idx + 1) % BUFFERCOUNT, true);
+
+    MTR_END("video", "opengl_upload");
 
     if (options->renderBehavior() == OpenGLOptions::SyncWithVideo)
         render();
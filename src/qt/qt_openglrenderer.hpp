@@ -63,7 +63,7 @@ signals:
     void errorInitializing();
 
 public slots:
-    void onBlit(int buf_idx, int x, int y, int w, int h);
+    void onBlit(int buf_idx, int x, int y, int w, int h, int dirty_y, int dirty_h);
 
 protected:
     void exposeEvent(QExposeEvent *event) override;
@@ -92,6 +92,12 @@ private:
     GLuint textureID      = 0;
     int    frameCounter   = 0;
 
+    /* Set when the texture missed a blit and has to be uploaded in full. */
+    bool fullUpload = true;
+
+    /* Fences for the uploads still reading from each persistent buffer. */
+    GLsync fences[BUFFERCOUNT] = {};
+
     OpenGLOptions::FilterType currentFilter;
 
     void *unpackBuffer = nullptr;
@@ -102,9 +108,12 @@ private:
     void applyOptions();
     void applyShader(const OpenGLShaderPass &shader);
     bool notReady() const { return !isInitialized || isFinalized; }
+    void releaseBuffer(int buf_idx, bool wait);
 
     /* GL_ARB_buffer_storage */
     bool hasBufferStorage = false;
+    /* GL_ARB_sync */
+    bool hasSync = false;
 #ifndef NO_BUFFER_STORAGE
     PFNGLBUFFERSTORAGEEXTPROC_LOCAL glBufferStorage = nullptr;
 #endif
@@ -96,6 +96,7 @@ extern "C" {
 #        define NOMINMAX
 #    endif
 #    include <windows.h>
+#    include <io.h>
 #    include <86box/win.h>
 #else
 #    include <strings.h>
@@ -185,6 +186,12 @@ plat_timer_read(void)
     return elapsed_timer.elapsed();
 }
 
+uint64_t
+plat_get_micro_ticks(void)
+{
+    return elapsed_timer.nsecsElapsed() / 1000;
+}
+
 FILE *
 plat_fopen(const char *path, const char *mode)
 {
@@ -373,6 +380,50 @@ plat_munmap(void *ptr, size_t size)
 #endif
 }
 
+void *
+plat_mmap_file(FILE *fp, uint64_t size, int writable)
+{
+    if ((size == 0) || (size != (uint64_t) (size_t) size))
+        return nullptr;
+
+    fflush(fp);
+#if defined Q_OS_WINDOWS
+    HANDLE file = (HANDLE) _get_osfhandle(_fileno(fp));
+    HANDLE map  = CreateFileMappingW(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+                                     (DWORD) (size >> 32), (DWORD) size, NULL);
+    if (map == NULL)
+        return nullptr;
+
+    void *ret = MapViewOfFile(map, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, (SIZE_T) size);
+    /* The view keeps the mapping object alive. */
+    CloseHandle(map);
+    return ret;
+#else
+    void *ret = mmap(0, (size_t) size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fileno(fp), 0);
+    return (ret == MAP_FAILED) ? nullptr : ret;
+#endif
+}
+
+void
+plat_munmap_file(void *ptr, uint64_t size)
+{
+#if defined Q_OS_WINDOWS
+    UnmapViewOfFile(ptr);
+#else
+    munmap(ptr, (size_t) size);
+#endif
+}
+
+void
+plat_msync_file(void *ptr, uint64_t size, int wait)
+{
+#if defined Q_OS_WINDOWS
+    FlushViewOfFile(ptr, (SIZE_T) size);
+#else
+    msync(ptr, (size_t) size, wait ? MS_SYNC : MS_ASYNC);
+#endif
+}
+
 void
 plat_pause(int p)
 {
@@ -33,11 +33,14 @@
 
 #include "evdev_mouse.hpp"
 
+#include <algorithm>
 #include <atomic>
 #include <stdexcept>
 
 #include <QScreen>
 #include <QMessageBox>
+#include <QImage>
+#include <QPainter>
 
 #ifdef __APPLE__
 #    include <CoreGraphics/CoreGraphics.h>
@@ -48,6 +51,7 @@ extern "C" {
 #include <86box/config.h>
 #include <86box/plat.h>
 #include <86box/video.h>
+#include <86box/vid_pacing.h>
 #include <86box/mouse.h>
 }
 
@@ -297,6 +301,11 @@ RendererStack::switchRenderer(Renderer renderer)
 void
 RendererStack::createRenderer(Renderer renderer)
 {
+    /* The new renderer's buffers start out with nothing in them. */
+    bufDirty.clear();
+    rendererDirty = { 0, 2048 };
+    overlayRows   = 0;
+
     switch (renderer) {
         default:
         case Renderer::Software:
@@ -405,10 +414,59 @@ RendererStack::createRenderer(Renderer renderer)
     }
 }
 
+static void
+addDirtyRows(std::pair<int, int> &rows, int first, int last)
+{
+    rows.first  = std::min(rows.first, first);
+    rows.second = std::max(rows.second, last);
+}
+
+/* Draws the frame pacing statistics over the top rows of the frame in an
+   image buffer, returns the number of rows covered. */
+static int
+drawPacingOverlay(uint8_t *bits, int bytesPerRow, int x, int y, int w, int h, int monitor_index)
+{
+    char text[256];
+
+    video_pacing_format_overlay(monitor_index, text, sizeof(text));
+
+    QImage   image(bits + (y * bytesPerRow) + (x * 4), w, h, bytesPerRow, QImage::Format_RGB32);
+    QPainter painter(&image);
+    QFont    font = painter.font();
+    font.setPixelSize(12);
+    painter.setFont(font);
+
+    int rows = std::min(painter.fontMetrics().height() + 4, h);
+    painter.fillRect(0, 0, w, rows, Qt::black);
+    painter.setPen(Qt::white);
+    painter.drawText(QRect(4, 0, w - 8, rows), Qt::AlignLeft | Qt::AlignVCenter, QString::fromUtf8(text));
+
+    return rows;
+}
+
 // called from blitter thread
 void
 RendererStack::blit(int x, int y, int w, int h)
 {
+    int dirty_y;
+    int dirty_h;
+
+    /* Every buffer, and the renderer, has to catch up on the rows of each
+       frame, including the frames that end up being dropped. */
+    video_blit_get_dirty_monitor(m_monitor_index, &dirty_y, &dirty_h);
+    if (QRect(x, y, w, h) != dirtyRect) {
+        dirtyRect = QRect(x, y, w, h);
+        dirty_y   = 0;
+        dirty_h   = 2048;
+    }
+    if (bufDirty.size() != imagebufs.size())
+        bufDirty.assign(imagebufs.size(), { 0, 2048 });
+    if (dirty_h > 0) {
+        for (auto &rows : bufDirty)
+            addDirtyRows(rows, dirty_y, dirty_y + dirty_h);
+        addDirtyRows(rendererDirty, dirty_y, dirty_y + dirty_h);
+    }
+
     if ((x < 0) || (y < 0) || (w <= 0) || (h <= 0) ||
         (w > 2048) || (h > 2048) ||
         (monitors[m_monitor_index].target_buffer == NULL) || imagebufs.empty() ||
@@ -421,16 +479,34 @@ RendererStack::blit(int x, int y, int w, int h)
     sw = this->w = w;
     sh = this->h       = h;
     uint8_t *imagebits = std::get<uint8_t *>(imagebufs[currentBuf]);
-    for (int y1 = y; y1 < (y + h); y1++) {
+    int      first     = std::max(bufDirty[currentBuf].first, y);
+    int      last      = std::min(bufDirty[currentBuf].second, y + h);
+    for (int y1 = first; y1 < last; y1++) {
         auto scanline = imagebits + (y1 * rendererWindow->getBytesPerRow()) + (x * 4);
         video_copy(scanline, &(monitors[m_monitor_index].target_buffer->line[y1][x]), w * 4);
     }
+    bufDirty[currentBuf] = { 2048, 0 };
 
     if (monitors[m_monitor_index].mon_screenshots) {
         video_screenshot_monitor((uint32_t *) imagebits, x, y, 2048, m_monitor_index);
     }
     video_blit_complete_monitor(m_monitor_index);
-    emit blitToRenderer(currentBuf, sx, sy, sw, sh);
+
+    /* The overlay is drawn over the copy, after the screenshot, so the rows
+       it covers have to be copied and uploaded again once it goes away. */
+    if (overlayRows > 0)
+        addDirtyRows(rendererDirty, y, y + overlayRows);
+    overlayRows = 0;
+    if (video_pacing && video_pacing_overlay) {
+        overlayRows = drawPacingOverlay(imagebits, rendererWindow->getBytesPerRow(), x, y, w, h, m_monitor_index);
+        addDirtyRows(bufDirty[currentBuf], y, y + overlayRows);
+        addDirtyRows(rendererDirty, y, y + overlayRows);
+    }
+
+    first         = std::max(rendererDirty.first, y);
+    last          = std::min(rendererDirty.second, y + h);
+    rendererDirty = { 2048, 0 };
+    emit blitToRenderer(currentBuf, sx, sy, sw, sh, first - y, std::max(last - first, 0));
     currentBuf = (currentBuf + 1) % imagebufs.size();
 }
 
@@ -7,9 +7,11 @@
 #include <QStackedWidget>
 #include <QWidget>
 #include <QCursor>
+#include <QRect>
 
 #include <atomic>
 #include <memory>
+#include <utility>
 #include <tuple>
 #include <vector>
 
@@ -79,7 +81,9 @@ public:
     void (*mouse_exit_func)()                   = nullptr;
 
 signals:
-    void blitToRenderer(int buf_idx, int x, int y, int w, int h);
+    /* dirty_y and dirty_h are the rows of the blit that changed since the
+       previous one, relative to y. */
+    void blitToRenderer(int buf_idx, int x, int y, int w, int h, int dirty_y, int dirty_h);
     void rendererChanged();
 
 public slots:
@@ -105,6 +109,14 @@ private:
 
     std::vector<std::tuple<uint8_t *, std::atomic_flag *>> imagebufs;
 
+    /* Target buffer rows, as [first, last), not yet copied into each image
+       buffer and not yet handed to the renderer. */
+    std::vector<std::pair<int, int>> bufDirty;
+    std::pair<int, int>              rendererDirty { 0, 2048 };
+    QRect                            dirtyRect;
+    /* Rows at the top of the last frame covered by the pacing overlay. */
+    int overlayRows = 0;
+
     RendererCommon          *rendererWindow { nullptr };
     std::unique_ptr<QWidget> current;
 };
@@ -25,6 +25,7 @@
 extern "C" {
 #include <86box/86box.h>
 #include <86box/video.h>
+#include <86box/vid_pacing.h>
 }
 
 SoftwareRenderer::SoftwareRenderer(QWidget *parent)
@@ -113,6 +114,7 @@ SoftwareRenderer::onPaint(QPaintDevice *device)
 #endif
     painter.setCompositionMode(QPainter::CompositionMode_Plus);
     painter.drawImage(destination, *images[cur_image], source);
+    video_pacing_present(r_monitor_index);
 }
 
 std::vector<std::tuple<uint8_t *, std::atomic_flag *>>
@@ -39,6 +39,7 @@
 
 extern "C" {
 #    include <86box/86box.h>
+#    include <86box/vid_pacing.h>
 }
 
 // Use a triangle strip to get a quad.
@@ -144,6 +145,8 @@ VulkanRenderer2::createTexture()
             return false;
 
         m_texStagingPending = true;
+        m_texDirtyFirst     = 0;
+        m_texDirtyLast      = img.height();
     }
 
     VkImageViewCreateInfo viewInfo;
@@ -363,17 +366,27 @@ VulkanRenderer2::ensureTexture()
             m_texStagingTransferLayout = true;
         }
 
-        VkImageCopy copyInfo;
-        memset(&copyInfo, 0, sizeof(copyInfo));
-        copyInfo.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        copyInfo.srcSubresource.layerCount = 1;
-        copyInfo.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        copyInfo.dstSubresource.layerCount = 1;
-        copyInfo.extent.width              = m_texSize.width();
-        copyInfo.extent.height             = m_texSize.height();
-        copyInfo.extent.depth              = 1;
-        m_devFuncs->vkCmdCopyImage(cb, m_texStaging, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                                   m_texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyInfo);
+        /* The texture keeps its contents between frames, so only the rows
+           blitted since the last copy have to be copied. */
+        m_texDirtyFirst = qMax(m_texDirtyFirst, 0);
+        m_texDirtyLast  = qMin(m_texDirtyLast, m_texSize.height());
+        if (m_texDirtyFirst < m_texDirtyLast) {
+            VkImageCopy copyInfo;
+            memset(&copyInfo, 0, sizeof(copyInfo));
+            copyInfo.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            copyInfo.srcSubresource.layerCount = 1;
+            copyInfo.srcOffset.y               = m_texDirtyFirst;
+            copyInfo.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            copyInfo.dstSubresource.layerCount = 1;
+            copyInfo.dstOffset.y               = m_texDirtyFirst;
+            copyInfo.extent.width              = m_texSize.width();
+            copyInfo.extent.height             = m_texDirtyLast - m_texDirtyFirst;
+            copyInfo.extent.depth              = 1;
+            m_devFuncs->vkCmdCopyImage(cb, m_texStaging, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                       m_texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyInfo);
+        }
+        m_texDirtyFirst = m_texSize.height();
+        m_texDirtyLast  = 0;
 
         barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
         barrier.newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -388,6 +401,13 @@ VulkanRenderer2::ensureTexture()
     }
 }
 
+void
+VulkanRenderer2::addDirtyRows(int first, int last)
+{
+    m_texDirtyFirst = qMin(m_texDirtyFirst, first);
+    m_texDirtyLast  = qMax(m_texDirtyLast, last);
+}
+
 void
 VulkanRenderer2::updateSamplers()
 {
@@ -1007,6 +1027,8 @@ VulkanRenderer2::startNextFrame()
     }
 
     m_window->frameReady();
+    if (qobject_cast<VulkanWindowRenderer *>(m_window))
+        video_pacing_present(qobject_cast<VulkanWindowRenderer *>(m_window)->r_monitor_index);
     m_window->requestUpdate(); // render continuously, throttled by the presentation rate
 }
 #endif
@@ -51,6 +51,9 @@ public:
 
     void startNextFrame() override;
 
+    /* Rows first to last - 1 of the staging image need copying again. */
+    void addDirtyRows(int first, int last);
+
 private:
     VkShaderModule createShader(const QString &name);
     bool           createTexture();
@@ -87,6 +90,8 @@ private:
     bool           m_texStagingTransferLayout = false;
     QSize          m_texSize;
     VkFormat       m_texFormat;
+    int            m_texDirtyFirst            = 0;
+    int            m_texDirtyLast             = 2048;
 
     QMatrix4x4 m_proj;
 };
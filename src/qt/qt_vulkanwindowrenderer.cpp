@@ -829,10 +829,12 @@ VulkanWindowRenderer::event(QEvent *event)
 }
 
 void
-VulkanWindowRenderer::onBlit(int buf_idx, int x, int y, int w, int h)
+VulkanWindowRenderer::onBlit(int buf_idx, int x, int y, int w, int h, int dirty_y, int dirty_h)
 {
     auto origSource = source;
     source.setRect(x, y, w, h);
+    if (renderer && (dirty_h > 0))
+        renderer->addDirtyRows(y + dirty_y, y + dirty_y + dirty_h);
     if (isExposed())
         requestUpdate();
     buf_usage[0].clear();
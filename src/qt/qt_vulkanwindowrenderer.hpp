@@ -14,7 +14,7 @@ class VulkanWindowRenderer : public QVulkanWindow, public RendererCommon {
 public:
     VulkanWindowRenderer(QWidget *parent);
 public slots:
-    void onBlit(int buf_idx, int x, int y, int w, int h);
+    void onBlit(int buf_idx, int x, int y, int w, int h, int dirty_y, int dirty_h);
 signals:
     void rendererInitialized();
     void errorInitializing();
@@ -33,7 +33,7 @@ private:
     friend class VulkanRendererEmu;
     friend class VulkanRenderer2;
 
-    VulkanRenderer2 *renderer;
+    VulkanRenderer2 *renderer = nullptr;
 };
 #endif
 
@@ -726,12 +726,12 @@ scsi_disk_blocks(scsi_disk_t *dev, int32_t *len, UNUSED(int first_batch), int ou
 
     *len = dev->requested_blocks << 9;
 
-    for (int i = 0; i < dev->requested_blocks; i++) {
-        if (out)
-            hdd_image_write(dev->id, dev->sector_pos + i, 1, dev->temp_buffer + (i << 9));
-        else
-            hdd_image_read(dev->id, dev->sector_pos + i, 1, dev->temp_buffer + (i << 9));
-    }
+    /* Transfer the whole run as one request; with asynchronous I/O enabled,
+       writes are queued and do not stall the emulation thread. */
+    if (out)
+        hdd_image_write(dev->id, dev->sector_pos, dev->requested_blocks, dev->temp_buffer);
+    else
+        hdd_image_read(dev->id, dev->sector_pos, dev->requested_blocks, dev->temp_buffer);
 
     scsi_disk_log("%s %i bytes of blocks...\n", out ? "Written" : "Read", *len);
 
@@ -790,6 +790,8 @@ scsi_disk_reset(scsi_common_t *sc)
 {
     scsi_disk_t *dev = (scsi_disk_t *) sc;
 
+    hdd_image_flush(dev->id);
+
     scsi_disk_rezero(dev);
     dev->tf->status         = 0;
     dev->callback           = 0.0;
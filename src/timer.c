@@ -1,87 +1,175 @@
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
 #include <86box/86box.h>
 #include <86box/timer.h>
+#ifdef ENABLE_TIMER_TRACE
+#    include <86box/path.h>
+#    include <86box/plat.h>
+#endif
 
 uint64_t TIMER_USEC;
 uint32_t timer_target;
 
-/*Enabled timers are stored in a linked list, with the first timer to expire at
-  the head.*/
-pc_timer_t *timer_head = NULL;
+#ifdef ENABLE_TIMER_TRACE
+/*Trace of every timer operation, written to timer_trace.txt in the user
+  directory, for replaying with the timer benchmark (timer_bench.c). One
+  record per line, timers are identified by address and all numbers are in
+  hexadecimal:
+    P <tsc>         timer_process() called at TSC tsc
+    F <timer>       timer expired in timer_process()...
+    C               ...and its callback has returned
+    E <timer> <ts>  timer enabled with 32:32 timestamp ts
+    D <timer>       timer disabled
+    T <tsc> <new>   timer_set_new_tsc() from TSC tsc to new
+    R               timer_close()*/
+static FILE *timer_trace_fp = NULL;
+
+#    define timer_trace(...)                          \
+        do {                                          \
+            if (timer_trace_fp)                       \
+                fprintf(timer_trace_fp, __VA_ARGS__); \
+        } while (0)
+#else
+#    define timer_trace(...)
+#endif
+
+/*Enabled timers are stored in a binary min-heap, with the first timer to
+  expire at the root. Each timer records its own heap position (plus one, so
+  that zero means "not queued"), which makes removal of an arbitrary timer
+  O(log n) as well.*/
+static pc_timer_t **timer_heap      = NULL;
+static uint32_t     timer_heap_size = 0;
+static uint32_t     timer_heap_max  = 0;
+
+/*Sequence number used to break ties between timers with equal timestamps;
+  the most recently enabled timer runs first, as it did with the old sorted
+  list.*/
+static uint64_t timer_seq = 0;
 
 /* Are we initialized? */
 int timer_inited = 0;
 
 static void timer_advance_ex(pc_timer_t *timer, int start);
 
+/*True if timer a must run before timer b*/
+static __inline int
+timer_heap_before(pc_timer_t *a, pc_timer_t *b)
+{
+    int64_t diff = (int64_t) (a->ts.ts64 - b->ts.ts64);
+
+    if (diff != 0)
+        return diff < 0;
+
+    return a->seq > b->seq;
+}
+
+static __inline void
+timer_heap_place(pc_timer_t *timer, uint32_t pos)
+{
+    timer_heap[pos] = timer;
+    timer->heap_pos = pos + 1;
+}
+
+static void
+timer_heap_sift_up(uint32_t pos)
+{
+    pc_timer_t *timer = timer_heap[pos];
+
+    while (pos > 0) {
+        uint32_t parent = (pos - 1) >> 1;
+
+        if (!timer_heap_before(timer, timer_heap[parent]))
+            break;
+
+        timer_heap_place(timer_heap[parent], pos);
+        pos = parent;
+    }
+
+    timer_heap_place(timer, pos);
+}
+
+static void
+timer_heap_sift_down(uint32_t pos)
+{
+    pc_timer_t *timer = timer_heap[pos];
+
+    while (1) {
+        uint32_t child = (pos << 1) + 1;
+
+        if (child >= timer_heap_size)
+            break;
+
+        if (((child + 1) < timer_heap_size) && timer_heap_before(timer_heap[child + 1], timer_heap[child]))
+            child++;
+
+        if (!timer_heap_before(timer_heap[child], timer))
+            break;
+
+        timer_heap_place(timer_heap[child], pos);
+        pos = child;
+    }
+
+    timer_heap_place(timer, pos);
+}
+
+static void
+timer_heap_remove(pc_timer_t *timer)
+{
+    uint32_t    pos  = timer->heap_pos - 1;
+    pc_timer_t *last = timer_heap[--timer_heap_size];
+
+    timer->heap_pos = 0;
+
+    if (last == timer)
+        return;
+
+    timer_heap_place(last, pos);
+    if ((pos > 0) && timer_heap_before(last, timer_heap[(pos - 1) >> 1]))
+        timer_heap_sift_up(pos);
+    else
+        timer_heap_sift_down(pos);
+}
+
+static __inline void
+timer_update_target(void)
+{
+    if (timer_heap_size)
+        timer_target = timer_heap[0]->ts.ts32.integer;
+}
+
 void
 timer_enable(pc_timer_t *timer)
 {
-    pc_timer_t *timer_node = timer_head;
-    int ret = 0;
-
     if (!timer_inited || (timer == NULL))
         return;
 
     if (timer->flags & TIMER_ENABLED)
         timer_disable(timer);
 
-    if (timer->next || timer->prev)
-        fatal("timer_enable - timer->next\n");
-
-    /*List currently empty - add to head*/
-    if (!timer_head) {
-        timer_head  = timer;
-        timer->next = timer->prev = NULL;
-        timer_target              = timer_head->ts.ts32.integer;
-        ret = 1;
-    } else if (TIMER_LESS_THAN(timer, timer_head)) {
-        timer->next      = timer_head;
-        timer->prev      = NULL;
-        timer_head->prev = timer;
-        timer_head       = timer;
-        timer_target     = timer_head->ts.ts32.integer;
-        ret = 1;
-    } else if (!timer_head->next) {
-        timer_head->next = timer;
-        timer->prev      = timer_head;
-        ret = 1;
-    }
+    if (timer->heap_pos)
+        fatal("timer_enable - timer->heap_pos\n");
 
-    if (ret == 0) {
-        pc_timer_t *prev = timer_head;
-        timer_node       = timer_head->next;
-
-        while (1) {
-            /*Timer expires before timer_node. Add to list in front of timer_node*/
-            if (TIMER_LESS_THAN(timer, timer_node)) {
-                timer->next      = timer_node;
-                timer->prev      = prev;
-                timer_node->prev = timer;
-                prev->next       = timer;
-                ret = 1;
-                break;
-            }
-
-            /*timer_node is last in the list. Add timer to end of list*/
-            if (!timer_node->next) {
-                timer_node->next = timer;
-                timer->prev      = timer_node;
-                ret = 1;
-                break;
-            }
-
-            prev       = timer_node;
-            timer_node = timer_node->next;
-        }
+    if (timer_heap_size == timer_heap_max) {
+        timer_heap_max = timer_heap_max ? (timer_heap_max << 1) : 64;
+        timer_heap     = (pc_timer_t **) realloc(timer_heap, timer_heap_max * sizeof(pc_timer_t *));
+        if (timer_heap == NULL)
+            fatal("timer_enable - out of memory\n");
     }
 
-    /* Do not mark it as enabled if it has failed every single condition. */
-    if (ret == 1)
-        timer->flags |= TIMER_ENABLED;
+    timer->seq = timer_seq++;
+    timer_heap_place(timer, timer_heap_size++);
+    timer_heap_sift_up(timer_heap_size - 1);
+
+    timer->flags |= TIMER_ENABLED;
+
+    timer_trace("E %p %" PRIx64 "\n", (void *) timer, timer->ts.ts64);
+
+    if (timer_heap[0] == timer)
+        timer_target = timer->ts.ts32.integer;
 }
 
 void
@@ -90,19 +178,15 @@ timer_disable(pc_timer_t *timer)
     if (!timer_inited || (timer == NULL) || !(timer->flags & TIMER_ENABLED))
         return;
 
-    if (!timer->next && !timer->prev && timer != timer_head)
-        fatal("timer_disable - !timer->next\n");
+    if (!timer->heap_pos)
+        fatal("timer_disable - !timer->heap_pos\n");
 
     timer->flags &= ~TIMER_ENABLED;
     timer->in_callback = 0;
 
-    if (timer->prev)
-        timer->prev->next = timer->next;
-    else
-        timer_head = timer->next;
-    if (timer->next)
-        timer->next->prev = timer->prev;
-    timer->prev = timer->next = NULL;
+    timer_trace("D %p\n", (void *) timer);
+
+    timer_heap_remove(timer);
 }
 
 void
@@ -110,20 +194,20 @@ timer_process(void)
 {
     pc_timer_t *timer;
 
-    if (!timer_head)
+    if (!timer_heap_size)
         return;
 
-    while (1) {
-        timer = timer_head;
+    timer_trace("P %" PRIx64 "\n", tsc);
+
+    while (timer_heap_size) {
+        timer = timer_heap[0];
 
         if (!TIMER_LESS_THAN_VAL(timer, (uint32_t) tsc))
             break;
 
-        timer_head = timer->next;
-        if (timer_head)
-            timer_head->prev = NULL;
+        timer_trace("F %p\n", (void *) timer);
 
-        timer->next = timer->prev = NULL;
+        timer_heap_remove(timer);
         timer->flags &= ~TIMER_ENABLED;
 
         if (timer->flags & TIMER_SPLIT)
@@ -137,34 +221,45 @@ timer_process(void)
             timer->callback(timer->priv);
             timer->in_callback = 0;
         }
+
+        timer_trace("C\n");
     }
 
-    timer_target = timer_head->ts.ts32.integer;
+    timer_update_target();
 }
 
 void
 timer_close(void)
 {
-    pc_timer_t *t = timer_head;
-    pc_timer_t *r;
-
-    /* Set all timers' prev and next to NULL so it is assured that
-       timers that are not in malloc'd structs don't keep pointing
-       to timers that may be in malloc'd structs. */
-    while (t != NULL) {
-        r       = t;
-        r->prev = r->next = NULL;
-        t                 = r->next;
-    }
+    /* Clear all timers' heap positions so it is assured that timers
+       that are not in malloc'd structs don't look queued after reset. */
+    for (uint32_t c = 0; c < timer_heap_size; c++)
+        timer_heap[c]->heap_pos = 0;
 
-    timer_head = NULL;
+    timer_heap_size = 0;
+    timer_seq       = 0;
 
     timer_inited = 0;
+
+#ifdef ENABLE_TIMER_TRACE
+    timer_trace("R\n");
+    if (timer_trace_fp)
+        fflush(timer_trace_fp);
+#endif
 }
 
 void
 timer_init(void)
 {
+#ifdef ENABLE_TIMER_TRACE
+    char fn[1024];
+
+    if (timer_trace_fp == NULL) {
+        path_append_filename(fn, usr_path, "timer_trace.txt");
+        timer_trace_fp = plat_fopen(fn, "w");
+    }
+#endif
+
     timer_target = 0ULL;
     tsc          = 0;
 
@@ -180,7 +275,7 @@ timer_add(pc_timer_t *timer, void (*callback)(void *priv), void *priv, int start
     timer->in_callback = 0;
     timer->priv        = priv;
     timer->flags       = 0;
-    timer->prev        = timer->next = NULL;
+    timer->heap_pos    = 0;
     if (start_timer)
         timer_set_delay_u64(timer, 0);
 }
@@ -264,20 +359,26 @@ timer_set_new_tsc(uint64_t new_tsc)
         update_tsc();
 #endif
 
-    if (!timer_head) {
+    timer_trace("T %" PRIx64 " %" PRIx64 "\n", tsc, new_tsc);
+
+    if (!timer_heap_size) {
         tsc = new_tsc;
         return;
     }
 
-    timer = timer_head;
-    timer_target = new_tsc + (int32_t)(timer_get_ts_int(timer_head) - (uint32_t)tsc);
+    for (uint32_t c = 0; c < timer_heap_size; c++) {
+        timer = timer_heap[c];
 
-    while (timer) {
         int32_t offset_from_current_tsc = (int32_t)(timer_get_ts_int(timer) - (uint32_t)tsc);
         timer->ts.ts32.integer = new_tsc + offset_from_current_tsc;
-
-        timer = timer->next;
     }
 
+    /* Rebasing keeps the relative order, but rebuild the heap anyway in case
+       a timer's 32-bit offset wrapped. */
+    for (uint32_t c = timer_heap_size >> 1; c-- > 0;)
+        timer_heap_sift_down(c);
+
+    timer_update_target();
+
     tsc = new_tsc;
 }
@@ -0,0 +1,596 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Standalone benchmark for the timer queue.
+ *
+ *          Replays a trace of timer operations, as recorded by a build
+ *          with TIMER_TRACE enabled, against the timer heap in timer.c
+ *          and against a copy of the sorted list it replaced, and checks
+ *          that both expire the timers exactly as recorded. Without a
+ *          trace, a synthetic one with a mix of periodic and one-shot
+ *          timers is generated. Exits with 1 if either queue diverges
+ *          from the trace.
+ *
+ *          Usage: timer_bench [trace|- [runs]]
+ *
+ *
+ *
+ * Authors: agent, <agent@local>
+ *
+ *          Copyright 2026 agent.
+ */
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+#include <86box/86box.h>
+#include <86box/timer.h>
+
+#define BENCH_RUNS       20
+#define BENCH_RECORDS    2000000
+#define BENCH_MAX_TIMERS 4096
+#define BENCH_HASH_SIZE  (BENCH_MAX_TIMERS * 2)
+
+typedef struct bench_rec_t {
+    char     type;
+    uint32_t id;
+    uint64_t a;
+    uint64_t b;
+} bench_rec_t;
+
+/* The sorted list the heap replaced, kept here as the reference. */
+typedef struct list_timer_t {
+    ts_t ts;
+    int  flags;
+
+    struct list_timer_t *prev;
+    struct list_timer_t *next;
+} list_timer_t;
+
+typedef struct bench_queue_t {
+    const char *name;
+    void (*reset)(void);
+    void (*enable)(uint32_t id, uint64_t ts);
+    void (*disable)(uint32_t id);
+    void (*process)(void);
+    void (*set_new_tsc)(uint64_t new_tsc);
+} bench_queue_t;
+
+/* Synthetic devices, with periods in CPU cycles at 100 MHz. */
+static const struct {
+    const char *name;
+    double      period;
+    int         count;
+} periodic[] = {
+    { "PIT",       83.8,    1 },
+    { "RTC",       97656.3, 1 },
+    { "sound",     2267.6,  4 },
+    { "MIDI",      3200.0,  1 },
+    { "video",     3177.7,  2 },
+    { "keyboard",  100000.0, 1 },
+    { "serial",    8680.6,  2 },
+    { "CD-ROM",    13333.3, 1 }
+};
+#define BENCH_ONESHOTS 24 /* IDE, NIC, floppy, DMA and the like */
+
+uint64_t tsc;
+int      cpu_use_dynarec = 0;
+
+static bench_rec_t *recs;
+static size_t       n_recs;
+static size_t       max_recs;
+static size_t       cursor;
+static int          replay_error;
+
+static uintptr_t timer_addr[BENCH_MAX_TIMERS];
+static uint32_t  timer_hash[BENCH_HASH_SIZE];
+static uint32_t  n_timers;
+
+static pc_timer_t   heap_timers[BENCH_MAX_TIMERS];
+static list_timer_t list_timers[BENCH_MAX_TIMERS];
+static list_timer_t *list_head;
+
+static const struct bench_queue_t *bench_queue;
+static void (*bench_fire)(uint32_t id);
+
+static uint32_t gen_seed = 0x7131e8;
+static double   gen_period[BENCH_MAX_TIMERS];
+static uint32_t gen_periodic;
+
+void
+update_tsc(void)
+{
+    //
+}
+
+void
+fatal(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    exit(2);
+}
+
+static uint64_t
+bench_time_us(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ((uint64_t) ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+static bench_rec_t *
+bench_add_rec(char type)
+{
+    if (n_recs == max_recs) {
+        max_recs = max_recs ? (max_recs << 1) : 65536;
+        recs     = realloc(recs, max_recs * sizeof(bench_rec_t));
+        if (recs == NULL)
+            fatal("timer_bench: out of memory\n");
+    }
+
+    memset(&recs[n_recs], 0, sizeof(bench_rec_t));
+    recs[n_recs].type = type;
+
+    return &recs[n_recs++];
+}
+
+/* Maps a timer address from the trace to a dense timer number. */
+static uint32_t
+bench_timer_id(uintptr_t addr)
+{
+    uint32_t h = (uint32_t) ((addr >> 3) * 0x9e3779b1) % BENCH_HASH_SIZE;
+
+    while (timer_hash[h]) {
+        if (timer_addr[timer_hash[h] - 1] == addr)
+            return timer_hash[h] - 1;
+        h = (h + 1) % BENCH_HASH_SIZE;
+    }
+
+    if (n_timers == BENCH_MAX_TIMERS)
+        fatal("timer_bench: more than %i timers in the trace\n", BENCH_MAX_TIMERS);
+
+    timer_addr[n_timers] = addr;
+    timer_hash[h]        = ++n_timers;
+
+    return n_timers - 1;
+}
+
+static void
+bench_load(const char *fn)
+{
+    FILE        *fp = fopen(fn, "r");
+    bench_rec_t *rec;
+    char         line[256];
+    char         tok[32];
+    int          line_no = 0;
+    int          ok;
+
+    if (fp == NULL)
+        fatal("timer_bench: unable to open %s\n", fn);
+
+    while (fgets(line, sizeof(line), fp)) {
+        line_no++;
+
+        if ((line[0] == '\n') || (line[0] == '\0'))
+            continue;
+
+        rec = bench_add_rec(line[0]);
+        switch (line[0]) {
+            case 'P':
+                ok = (sscanf(&line[1], "%" SCNx64, &rec->a) == 1);
+                break;
+            case 'F':
+            case 'D':
+                ok = (sscanf(&line[1], "%31s", tok) == 1);
+                if (ok)
+                    rec->id = bench_timer_id((uintptr_t) strtoull(tok, NULL, 16));
+                break;
+            case 'E':
+                ok = (sscanf(&line[1], "%31s %" SCNx64, tok, &rec->a) == 2);
+                if (ok)
+                    rec->id = bench_timer_id((uintptr_t) strtoull(tok, NULL, 16));
+                break;
+            case 'T':
+                ok = (sscanf(&line[1], "%" SCNx64 " %" SCNx64, &rec->a, &rec->b) == 2);
+                break;
+            case 'C':
+            case 'R':
+                ok = 1;
+                break;
+            default:
+                ok = 0;
+                break;
+        }
+
+        if (!ok)
+            fatal("timer_bench: %s:%i: bad record\n", fn, line_no);
+    }
+
+    fclose(fp);
+}
+
+/* Called when either queue expires a timer. Checks that the trace expires
+   the same timer next, then applies what its callback did. */
+static void
+bench_fired(uint32_t id)
+{
+    bench_rec_t *rec;
+
+    if (replay_error)
+        return;
+
+    if ((cursor >= n_recs) || (recs[cursor].type != 'F') || (recs[cursor].id != id)) {
+        printf("  timer %u expired at TSC %016" PRIx64 ", record %zu expected ", id, tsc, cursor);
+        if ((cursor < n_recs) && (recs[cursor].type == 'F'))
+            printf("timer %u\n", recs[cursor].id);
+        else
+            printf("no timer\n");
+        replay_error = 1;
+        return;
+    }
+
+    for (cursor++; cursor < n_recs; cursor++) {
+        rec = &recs[cursor];
+
+        if (rec->type == 'C') {
+            cursor++;
+            return;
+        }
+
+        switch (rec->type) {
+            case 'E':
+                bench_queue->enable(rec->id, rec->a);
+                break;
+            case 'D':
+                bench_queue->disable(rec->id);
+                break;
+            default:
+                printf("  record %zu is inside a callback\n", cursor);
+                replay_error = 1;
+                return;
+        }
+    }
+}
+
+static void
+heap_callback(void *priv)
+{
+    bench_fire((uint32_t) (uintptr_t) priv);
+}
+
+static void
+heap_reset(void)
+{
+    timer_close();
+    for (uint32_t c = 0; c < n_timers; c++)
+        timer_add(&heap_timers[c], heap_callback, (void *) (uintptr_t) c, 0);
+    timer_init();
+}
+
+static void
+heap_enable(uint32_t id, uint64_t ts)
+{
+    heap_timers[id].ts.ts64 = ts;
+    timer_enable(&heap_timers[id]);
+}
+
+static void
+heap_disable(uint32_t id)
+{
+    timer_disable(&heap_timers[id]);
+}
+
+static void
+heap_process(void)
+{
+    timer_process();
+}
+
+static void
+heap_set_new_tsc(uint64_t new_tsc)
+{
+    timer_set_new_tsc(new_tsc);
+}
+
+static void
+list_reset(void)
+{
+    memset(list_timers, 0, n_timers * sizeof(list_timer_t));
+    list_head = NULL;
+}
+
+static void
+list_disable(uint32_t id)
+{
+    list_timer_t *timer = &list_timers[id];
+
+    if (!(timer->flags & TIMER_ENABLED))
+        return;
+
+    timer->flags &= ~TIMER_ENABLED;
+
+    if (timer->prev)
+        timer->prev->next = timer->next;
+    else
+        list_head = timer->next;
+    if (timer->next)
+        timer->next->prev = timer->prev;
+    timer->prev = timer->next = NULL;
+}
+
+static void
+list_enable(uint32_t id, uint64_t ts)
+{
+    list_timer_t *timer = &list_timers[id];
+    list_timer_t *prev  = NULL;
+    list_timer_t *node  = list_head;
+
+    list_disable(id);
+    timer->ts.ts64 = ts;
+
+    /*Add in front of the first timer that expires at the same time or later,
+      so that the most recently enabled of equal timers runs first*/
+    while (node && !TIMER_LESS_THAN(timer, node)) {
+        prev = node;
+        node = node->next;
+    }
+
+    timer->prev = prev;
+    timer->next = node;
+    if (node)
+        node->prev = timer;
+    if (prev)
+        prev->next = timer;
+    else
+        list_head = timer;
+
+    timer->flags |= TIMER_ENABLED;
+}
+
+static void
+list_process(void)
+{
+    list_timer_t *timer;
+
+    while (list_head && TIMER_LESS_THAN_VAL(list_head, (uint32_t) tsc)) {
+        timer     = list_head;
+        list_head = timer->next;
+        if (list_head)
+            list_head->prev = NULL;
+
+        timer->next = timer->prev = NULL;
+        timer->flags &= ~TIMER_ENABLED;
+
+        bench_fire((uint32_t) (timer - list_timers));
+    }
+}
+
+static void
+list_set_new_tsc(uint64_t new_tsc)
+{
+    for (list_timer_t *timer = list_head; timer; timer = timer->next) {
+        int32_t offset_from_current_tsc = (int32_t) (timer->ts.ts32.integer - (uint32_t) tsc);
+
+        timer->ts.ts32.integer = new_tsc + offset_from_current_tsc;
+    }
+
+    tsc = new_tsc;
+}
+
+static const bench_queue_t queues[] = {
+    { "list", list_reset, list_enable, list_disable, list_process, list_set_new_tsc },
+    { "heap", heap_reset, heap_enable, heap_disable, heap_process, heap_set_new_tsc }
+};
+
+/* Replays the whole trace once and returns the time taken in microseconds. */
+static uint64_t
+bench_replay(const bench_queue_t *queue)
+{
+    bench_rec_t *rec;
+    uint64_t     start = bench_time_us();
+
+    bench_queue  = queue;
+    bench_fire   = bench_fired;
+    replay_error = 0;
+    cursor       = 0;
+
+    queue->reset();
+
+    while ((cursor < n_recs) && !replay_error) {
+        rec = &recs[cursor++];
+
+        switch (rec->type) {
+            case 'P':
+                tsc = rec->a;
+                queue->process();
+                if (!replay_error && (cursor < n_recs) && (recs[cursor].type == 'F')) {
+                    printf("  timer %u did not expire at TSC %016" PRIx64 "\n", recs[cursor].id, tsc);
+                    replay_error = 1;
+                }
+                break;
+            case 'E':
+                queue->enable(rec->id, rec->a);
+                break;
+            case 'D':
+                queue->disable(rec->id);
+                break;
+            case 'T':
+                tsc = rec->a;
+                queue->set_new_tsc(rec->b);
+                break;
+            case 'R':
+                queue->reset();
+                break;
+            default:
+                printf("  record %zu is outside a callback\n", cursor - 1);
+                replay_error = 1;
+                break;
+        }
+    }
+
+    return bench_time_us() - start;
+}
+
+static uint32_t
+gen_rand(void)
+{
+    gen_seed ^= gen_seed << 13;
+    gen_seed ^= gen_seed >> 17;
+    gen_seed ^= gen_seed << 5;
+
+    return gen_seed;
+}
+
+static uint64_t
+gen_delay(double period)
+{
+    return (uint64_t) (period * 4294967296.0);
+}
+
+static void
+gen_enable(uint32_t id, uint64_t ts)
+{
+    bench_rec_t *rec = bench_add_rec('E');
+
+    rec->id = id;
+    rec->a  = ts;
+
+    list_enable(id, ts);
+}
+
+static void
+gen_disable(uint32_t id)
+{
+    if (!(list_timers[id].flags & TIMER_ENABLED))
+        return;
+
+    bench_add_rec('D')->id = id;
+
+    list_disable(id);
+}
+
+/* Periodic timers rearm themselves, and some of the one-shot ones start
+   another transfer on a random channel when they complete. */
+static void
+gen_fired(uint32_t id)
+{
+    bench_add_rec('F')->id = id;
+
+    if (id < gen_periodic)
+        gen_enable(id, list_timers[id].ts.ts64 + gen_delay(gen_period[id]));
+    else if (!(gen_rand() & 3))
+        gen_enable(gen_periodic + (gen_rand() % BENCH_ONESHOTS), (tsc << 32) + gen_delay(500 + (gen_rand() % 20000)));
+
+    bench_add_rec('C');
+}
+
+/* Generates a trace by running the devices above on the list, with the CPU
+   starting and cancelling one-shot timers between timer_process() calls as
+   it would do from port writes. Halfway through, the TSC is rebased as on a
+   CPU speed change. */
+static void
+bench_generate(size_t count)
+{
+    uint32_t r;
+    uint32_t id;
+    int      rebased = 0;
+
+    gen_periodic = 0;
+    for (int i = 0; i < (int) (sizeof(periodic) / sizeof(periodic[0])); i++) {
+        for (int c = 0; c < periodic[i].count; c++)
+            gen_period[gen_periodic++] = periodic[i].period;
+    }
+    n_timers = gen_periodic + BENCH_ONESHOTS;
+
+    bench_fire = gen_fired;
+    tsc        = 0;
+    list_reset();
+
+    for (id = 0; id < gen_periodic; id++)
+        gen_enable(id, gen_delay(gen_period[id] * (gen_rand() % 1000) / 1000.0));
+
+    while (n_recs < count) {
+        tsc += 1 + (gen_rand() % 256);
+
+        r = gen_rand();
+        if (!(r & 0x3f)) {
+            id = gen_periodic + ((r >> 8) % BENCH_ONESHOTS);
+            if (r & 0x40)
+                gen_enable(id, (tsc << 32) + gen_delay(200 + (gen_rand() % 50000)));
+            else
+                gen_disable(id);
+        }
+
+        if (list_head && TIMER_VAL_LESS_THAN_VAL(list_head->ts.ts32.integer, (uint32_t) tsc)) {
+            bench_add_rec('P')->a = tsc;
+            list_process();
+        }
+
+        if (!rebased && (n_recs >= (count / 2))) {
+            bench_rec_t *rec = bench_add_rec('T');
+
+            rec->a = tsc;
+            rec->b = tsc * 2;
+            list_set_new_tsc(rec->b);
+            rebased = 1;
+        }
+    }
+
+    bench_add_rec('R');
+}
+
+int
+main(int argc, char *argv[])
+{
+    uint64_t us[2] = { 0, 0 };
+    int      runs  = BENCH_RUNS;
+    int      errors = 0;
+
+    if (argc > 2)
+        runs = atoi(argv[2]);
+    if (runs <= 0)
+        runs = 1;
+
+    if ((argc > 1) && strcmp(argv[1], "-"))
+        bench_load(argv[1]);
+    else
+        bench_generate(BENCH_RECORDS);
+
+    printf("%zu records, %u timers, %i runs, times in ms\n\n", n_recs, n_timers, runs);
+
+    for (int q = 0; q < 2; q++) {
+        for (int run = 0; run < runs; run++) {
+            us[q] += bench_replay(&queues[q]);
+            if (replay_error) {
+                printf("%s diverges from the trace\n", queues[q].name);
+                errors++;
+                break;
+            }
+        }
+
+        printf("%-8s %10.1f\n", queues[q].name, us[q] / 1000.0);
+    }
+
+    printf("%-8s %9.2fx\n", "speedup", us[1] ? ((double) us[0] / us[1]) : 0.0);
+
+    timer_close();
+    free(recs);
+
+    return errors ? 1 : 0;
+}
@@ -27,6 +27,9 @@
 
 #include <86box/86box.h>
 #include <86box/mem.h>
+#ifdef USE_DYNAREC
+#    include "codegen_public.h"
+#endif
 #include <86box/rom.h>
 #include <86box/keyboard.h>
 #include <86box/mouse.h>
@@ -42,6 +45,7 @@
 #include <86box/nvr.h>
 #include <86box/version.h>
 #include <86box/video.h>
+#include <86box/vid_pacing.h>
 #include <86box/ui.h>
 #include <86box/gdbstub.h>
 
@@ -421,6 +425,32 @@ plat_munmap(void *ptr, size_t size)
     munmap(ptr, size);
 }
 
+void *
+plat_mmap_file(FILE *fp, uint64_t size, int writable)
+{
+    void *ret;
+
+    if ((size == 0) || (size != (uint64_t) (size_t) size))
+        return NULL;
+
+    fflush(fp);
+    ret = mmap(0, (size_t) size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fileno(fp), 0);
+
+    return (ret == MAP_FAILED) ? NULL : ret;
+}
+
+void
+plat_munmap_file(void *ptr, uint64_t size)
+{
+    munmap(ptr, (size_t) size);
+}
+
+void
+plat_msync_file(void *ptr, uint64_t size, int wait)
+{
+    msync(ptr, (size_t) size, wait ? MS_SYNC : MS_ASYNC);
+}
+
 uint64_t
 plat_timer_read(void)
 {
@@ -450,6 +480,12 @@ plat_get_ticks(void)
     return (uint32_t) (plat_get_ticks_common() / 1000);
 }
 
+uint64_t
+plat_get_micro_ticks(void)
+{
+    return plat_get_ticks_common();
+}
+
 void
 plat_remove(char *path)
 {
@@ -973,6 +1009,8 @@ monitor_thread(void *param)
                         "hardreset - hard reset the emulated system.\n"
                         "pause - pause the the emulated system.\n"
                         "fullscreen - toggle fullscreen.\n"
+                        "pacing - print frame pacing statistics of the last second as JSON.\n"
+                        "stats - print emulator statistics of the last second.\n"
                         "version - print version and license information.\n"
                         "exit - exit 86Box.\n");
                 } else if (strncasecmp(xargv[0], "exit", 4) == 0) {
@@ -1016,6 +1054,29 @@ monitor_thread(void *param)
                 } else if (strncasecmp(xargv[0], "fullscreen", 10) == 0) {
                     video_fullscreen   = video_fullscreen ? 0 : 1;
                     fullscreen_pending = 1;
+                } else if (strncasecmp(xargv[0], "pacing", 6) == 0) {
+                    char buf[8192];
+
+                    if (video_pacing) {
+                        video_pacing_format_json(buf, sizeof(buf));
+                        printf("%s", buf);
+                    } else
+                        printf("Frame pacing is disabled, set frame_pacing = 1 in the [Video] section.\n");
+                } else if (strncasecmp(xargv[0], "stats", 5) == 0) {
+                    printf("TLB: %u flushes, %u refills, %u global entries kept\n",
+                           mmu_flushes_sec, mmu_refills_sec, mmu_global_kept_sec);
+#    if defined(USE_DYNAREC) && defined(USE_NEW_DYNAREC)
+                    if (cpu_use_dynarec)
+                        printf("Dynarec: %" PRIu64 " block lookup hits, %" PRIu64 " misses, %" PRIu64 " tag collisions, "
+                               "%" PRIu64 " hash set evictions, %" PRIu64 " blocks evicted, %" PRIu64 " chained block entries, "
+                               "%" PRIu64 " evicted blocks recompiled, %" PRIu64 " background compiles failed\n",
+                               codegen_stats_sec.hash_hits, codegen_stats_sec.hash_misses,
+                               codegen_stats_sec.hash_collisions, codegen_stats_sec.hash_evictions,
+                               codegen_stats_sec.block_evictions, codegen_stats_sec.chain_hits,
+                               codegen_stats_sec.evict_recompiles, codegen_stats_sec.async_failures);
+                    else
+                        printf("Dynarec: disabled\n");
+#    endif
                 } else if (strncasecmp(xargv[0], "pause", 5) == 0) {
                     plat_pause(dopause ^ 1);
                     printf("%s", dopause ? "Paused.\n" : "Unpaused.\n");
@@ -14,6 +14,7 @@
 #include <86box/plat.h>
 #include <86box/plat_dynld.h>
 #include <86box/video.h>
+#include <86box/vid_pacing.h>
 #include <86box/ui.h>
 #include <86box/version.h>
 #include <86box/unix_sdl.h>
@@ -190,6 +191,7 @@ sdl_real_blit(SDL_Rect *r_src)
         fprintf(stderr, "SDL: unable to copy texture to renderer (%s)\n", SDL_GetError());
 
     SDL_RenderPresent(sdl_render);
+    video_pacing_present(0);
 }
 
 void
@@ -4363,6 +4363,36 @@ mach64_writel_linear(uint32_t addr, uint32_t val, void *priv)
     *(uint32_t *) &svga->vram[addr] = val;
 }
 
+static void
+mach64_read_block_linear(uint32_t addr, uint8_t *buf, uint32_t len, int size, void *priv)
+{
+    svga_t *svga = (svga_t *) priv;
+
+    if (size == 4)
+        cycles -= svga->monitor->mon_video_timing_read_l * (int) (len >> 2);
+    else if (size == 2)
+        cycles -= svga->monitor->mon_video_timing_read_w * (int) (len >> 1);
+    else
+        cycles -= svga->monitor->mon_video_timing_read_b * (int) len;
+
+    svga_vram_read_block(svga, addr, buf, len);
+}
+
+static void
+mach64_write_block_linear(uint32_t addr, const uint8_t *buf, uint32_t len, int size, void *priv)
+{
+    svga_t *svga = (svga_t *) priv;
+
+    if (size == 4)
+        cycles -= svga->monitor->mon_video_timing_write_l * (int) (len >> 2);
+    else if (size == 2)
+        cycles -= svga->monitor->mon_video_timing_write_w * (int) (len >> 1);
+    else
+        cycles -= svga->monitor->mon_video_timing_write_b * (int) len;
+
+    svga_vram_write_block(svga, addr, buf, len);
+}
+
 uint8_t
 mach64_pci_read(UNUSED(int func), int addr, void *priv)
 {
@@ -4554,6 +4584,7 @@ mach64_common_init(const device_t *info)
     svga->dac_hwcursor.cur_ysize = 64;
 
     mem_mapping_add(&mach64->linear_mapping, 0, 0, mach64_read_linear, mach64_readw_linear, mach64_readl_linear, mach64_write_linear, mach64_writew_linear, mach64_writel_linear, NULL, MEM_MAPPING_EXTERNAL, svga);
+    mem_mapping_set_block_handler(&mach64->linear_mapping, mach64_read_block_linear, mach64_write_block_linear);
     mem_mapping_add(&mach64->mmio_linear_mapping, 0, 0, mach64_ext_readb, mach64_ext_readw, mach64_ext_readl, mach64_ext_writeb, mach64_ext_writew, mach64_ext_writel, NULL, MEM_MAPPING_EXTERNAL, mach64);
     mem_mapping_add(&mach64->mmio_linear_mapping_2, 0, 0, mach64_ext_readb, mach64_ext_readw, mach64_ext_readl, mach64_ext_writeb, mach64_ext_writew, mach64_ext_writel, NULL, MEM_MAPPING_EXTERNAL, mach64);
     mem_mapping_add(&mach64->mmio_mapping, 0xbc000, 0x04000, mach64_ext_readb, mach64_ext_readw, mach64_ext_readl, mach64_ext_writeb, mach64_ext_writew, mach64_ext_writel, NULL, MEM_MAPPING_EXTERNAL, mach64);
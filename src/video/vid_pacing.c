@@ -0,0 +1,433 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Display frame pacing monitor.
+ *
+ *          With video_pacing set, every frame of a monitor is timestamped
+ *          at the guest vsync, when the video card hands it to the blit
+ *          thread, when the blit thread is done with it and when the
+ *          renderer presents it. The frame a present shows is taken to be
+ *          the last one the blit thread finished; frames that finished
+ *          before it without being presented count as dropped, presents
+ *          without a new frame count as duplicated. Video cards that do
+ *          not report their vsync get a vsync to blit time of zero.
+ *
+ *          Once a second the percentiles of the frames presented in that
+ *          second are worked out and kept for the on-screen overlay, and a
+ *          writer thread of its own rewrites frame_pacing.json in the user
+ *          directory with them, so the file I/O is kept off the thread
+ *          doing the update.
+ *
+ *          The per-frame cost is a timestamp at each stage and, on
+ *          present, a few stores under a mutex that only the once a
+ *          second update contends for.
+ *
+ *
+ *
+ * Authors: agent, <agent@local>
+ *
+ *          Copyright 2026 agent.
+ */
+#include <stdatomic.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include <86box/path.h>
+#include <86box/plat.h>
+#include <86box/thread.h>
+#include <86box/video.h>
+#include <86box/vid_pacing.h>
+
+#define PACING_FILE    "frame_pacing.json"
+#define PACING_FRAMES  64  /* frames in flight, must be a power of 2 */
+#define PACING_SAMPLES 256 /* presented frames kept per second */
+
+typedef struct pacing_frame_t {
+    uint64_t vsync;
+    uint64_t blit;
+    uint64_t done;
+} pacing_frame_t;
+
+typedef struct pacing_monitor_t {
+    /* Emulation thread. */
+    uint64_t       vsync;
+    atomic_uint    blit_seq;
+    /* Blit thread, frames[] is also written by the emulation thread but
+       never for a frame the blit thread is still working on. */
+    atomic_uint    done_seq;
+    pacing_frame_t frames[PACING_FRAMES];
+
+    /* Renderer, protected by mutex. */
+    mutex_t *mutex;
+    uint32_t present_seq;
+    uint64_t last_present;
+    uint32_t samples[VIDEO_PACING_STAGES][PACING_SAMPLES];
+    int      sample_pos[VIDEO_PACING_STAGES];
+    int      sample_count[VIDEO_PACING_STAGES];
+    uint32_t presented;
+    uint32_t dropped;
+    uint32_t duplicated;
+
+    /* Last second, also protected by mutex. */
+    uint32_t             last_blit_seq;
+    video_pacing_stats_t stats;
+} pacing_monitor_t;
+
+static pacing_monitor_t pacing[MONITORS_NUM];
+
+static thread_t  *pacing_thread;
+static event_t   *pacing_write_event;
+static atomic_int pacing_thread_stop;
+
+#ifdef ENABLE_VIDEO_PACING_LOG
+int video_pacing_do_log = ENABLE_VIDEO_PACING_LOG;
+
+static void
+video_pacing_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (video_pacing_do_log) {
+        va_start(ap, fmt);
+        pclog_ex(fmt, ap);
+        va_end(ap);
+    }
+}
+#else
+#    define video_pacing_log(fmt, ...)
+#endif
+
+static __inline pacing_monitor_t *
+pacing_get(int monitor_index)
+{
+    if (!video_pacing || (monitor_index < 0) || (monitor_index >= MONITORS_NUM) || (pacing[monitor_index].mutex == NULL))
+        return NULL;
+
+    return &pacing[monitor_index];
+}
+
+static void
+pacing_sample(pacing_monitor_t *m, int stage, uint64_t us)
+{
+    m->samples[stage][m->sample_pos[stage]] = (us > 0xffffffff) ? 0xffffffff : (uint32_t) us;
+    m->sample_pos[stage]                    = (m->sample_pos[stage] + 1) & (PACING_SAMPLES - 1);
+    if (m->sample_count[stage] < PACING_SAMPLES)
+        m->sample_count[stage]++;
+}
+
+static int
+pacing_compare(const void *a, const void *b)
+{
+    uint32_t va = *(const uint32_t *) a;
+    uint32_t vb = *(const uint32_t *) b;
+
+    return (va > vb) - (va < vb);
+}
+
+/* Nearest rank percentiles of n samples, which get sorted in place. */
+static void
+pacing_percentiles(video_pacing_latency_t *lat, uint32_t *samples, int n)
+{
+    memset(lat, 0, sizeof(video_pacing_latency_t));
+    if (n == 0)
+        return;
+
+    qsort(samples, n, sizeof(uint32_t), pacing_compare);
+
+    lat->p50 = samples[((n * 50) + 99) / 100 - 1];
+    lat->p95 = samples[((n * 95) + 99) / 100 - 1];
+    lat->p99 = samples[((n * 99) + 99) / 100 - 1];
+    lat->max = samples[n - 1];
+}
+
+void
+video_pacing_init(void)
+{
+    for (int i = 0; i < MONITORS_NUM; i++) {
+        memset(&pacing[i], 0, sizeof(pacing_monitor_t));
+        pacing[i].mutex = thread_create_mutex();
+    }
+}
+
+void
+video_pacing_close(void)
+{
+    if (pacing_thread != NULL) {
+        atomic_store(&pacing_thread_stop, 1);
+        thread_set_event(pacing_write_event);
+        thread_wait(pacing_thread);
+        thread_destroy_event(pacing_write_event);
+        pacing_thread = NULL;
+    }
+
+    for (int i = 0; i < MONITORS_NUM; i++) {
+        if (pacing[i].mutex != NULL)
+            thread_close_mutex(pacing[i].mutex);
+        pacing[i].mutex = NULL;
+    }
+}
+
+/* Called by the video card at the start of its vertical sync. */
+void
+video_pacing_vsync(int monitor_index)
+{
+    pacing_monitor_t *m = pacing_get(monitor_index);
+
+    if (m != NULL)
+        m->vsync = plat_get_micro_ticks();
+}
+
+/* Called when a frame is handed to the blit thread. */
+void
+video_pacing_blit(int monitor_index)
+{
+    pacing_monitor_t *m = pacing_get(monitor_index);
+    pacing_frame_t   *f;
+    uint32_t          seq;
+
+    if (m == NULL)
+        return;
+
+    seq      = atomic_load_explicit(&m->blit_seq, memory_order_relaxed) + 1;
+    f        = &m->frames[seq & (PACING_FRAMES - 1)];
+    f->blit  = plat_get_micro_ticks();
+    f->vsync = m->vsync ? m->vsync : f->blit;
+    f->done  = 0;
+    m->vsync = 0;
+
+    atomic_store_explicit(&m->blit_seq, seq, memory_order_release);
+}
+
+/* Called by the blit thread once it has finished the frame. */
+void
+video_pacing_blit_done(int monitor_index)
+{
+    pacing_monitor_t *m = pacing_get(monitor_index);
+    uint32_t          seq;
+
+    if (m == NULL)
+        return;
+
+    seq = atomic_load_explicit(&m->blit_seq, memory_order_acquire);
+    if (seq == 0)
+        return;
+
+    m->frames[seq & (PACING_FRAMES - 1)].done = plat_get_micro_ticks();
+    atomic_store_explicit(&m->done_seq, seq, memory_order_release);
+}
+
+/* Called by the renderer right after it presented. */
+void
+video_pacing_present(int monitor_index)
+{
+    pacing_monitor_t     *m = pacing_get(monitor_index);
+    const pacing_frame_t *f;
+    uint64_t              now;
+    uint32_t              seq;
+
+    if (m == NULL)
+        return;
+
+    seq = atomic_load_explicit(&m->done_seq, memory_order_acquire);
+    if (seq == 0)
+        return;
+
+    now = plat_get_micro_ticks();
+    f   = &m->frames[seq & (PACING_FRAMES - 1)];
+
+    thread_wait_mutex(m->mutex);
+
+    if (seq == m->present_seq)
+        m->duplicated++;
+    else {
+        if (m->present_seq != 0)
+            m->dropped += seq - m->present_seq - 1;
+
+        pacing_sample(m, VIDEO_PACING_VSYNC_BLIT, f->blit - f->vsync);
+        pacing_sample(m, VIDEO_PACING_BLIT_DONE, f->done - f->blit);
+        pacing_sample(m, VIDEO_PACING_DONE_PRESENT, now - f->done);
+        pacing_sample(m, VIDEO_PACING_TOTAL, now - f->vsync);
+        if (m->last_present != 0)
+            pacing_sample(m, VIDEO_PACING_INTERVAL, now - m->last_present);
+
+        m->presented++;
+        m->present_seq  = seq;
+        m->last_present = now;
+    }
+
+    thread_release_mutex(m->mutex);
+}
+
+static void
+pacing_write_file(void)
+{
+    char  fn[1024];
+    char *buf;
+    FILE *fp;
+    int   len;
+
+    buf = malloc(8192);
+    len = video_pacing_format_json(buf, 8192);
+
+    path_append_filename(fn, usr_path, PACING_FILE);
+    fp = plat_fopen(fn, "wb");
+    if (fp != NULL) {
+        fwrite(buf, 1, len, fp);
+        fclose(fp);
+    } else
+        video_pacing_log("Pacing: unable to write %s\n", fn);
+
+    free(buf);
+}
+
+/* Rewrites the file each time video_pacing_update() has new statistics. */
+static void
+pacing_write_thread(UNUSED(void *priv))
+{
+    while (1) {
+        thread_wait_event(pacing_write_event, -1);
+        thread_reset_event(pacing_write_event);
+
+        if (atomic_load(&pacing_thread_stop))
+            break;
+
+        pacing_write_file();
+    }
+}
+
+/* Called once per second to work out the statistics of that second. */
+void
+video_pacing_update(void)
+{
+    static uint32_t      samples[VIDEO_PACING_STAGES][PACING_SAMPLES];
+    int                  counts[VIDEO_PACING_STAGES];
+    video_pacing_stats_t stats;
+    pacing_monitor_t    *m;
+    uint32_t             seq;
+
+    if (!video_pacing)
+        return;
+
+    for (int i = 0; i < MONITORS_NUM; i++) {
+        m = pacing_get(i);
+        if (m == NULL)
+            continue;
+
+        memset(&stats, 0, sizeof(video_pacing_stats_t));
+        seq = atomic_load_explicit(&m->blit_seq, memory_order_relaxed);
+
+        thread_wait_mutex(m->mutex);
+        stats.blits      = seq - m->last_blit_seq;
+        stats.presented  = m->presented;
+        stats.dropped    = m->dropped;
+        stats.duplicated = m->duplicated;
+        memcpy(samples, m->samples, sizeof(samples));
+        memcpy(counts, m->sample_count, sizeof(counts));
+        memset(m->sample_pos, 0, sizeof(m->sample_pos));
+        memset(m->sample_count, 0, sizeof(m->sample_count));
+        m->last_blit_seq = seq;
+        m->presented     = 0;
+        m->dropped       = 0;
+        m->duplicated    = 0;
+        thread_release_mutex(m->mutex);
+
+        for (int s = 0; s < VIDEO_PACING_STAGES; s++)
+            pacing_percentiles(&stats.latency[s], samples[s], counts[s]);
+
+        thread_wait_mutex(m->mutex);
+        m->stats = stats;
+        thread_release_mutex(m->mutex);
+
+        if (stats.blits)
+            video_pacing_log("Pacing %i: %u blits, %u presented, %u dropped, %u duplicated, p99 %u us\n", i,
+                             stats.blits, stats.presented, stats.dropped, stats.duplicated,
+                             stats.latency[VIDEO_PACING_TOTAL].p99);
+    }
+
+    if (pacing_thread == NULL) {
+        atomic_init(&pacing_thread_stop, 0);
+        pacing_write_event = thread_create_event();
+        pacing_thread      = thread_create(pacing_write_thread, NULL);
+    }
+    thread_set_event(pacing_write_event);
+}
+
+void
+video_pacing_get_stats(int monitor_index, video_pacing_stats_t *stats)
+{
+    pacing_monitor_t *m = pacing_get(monitor_index);
+
+    if (m == NULL) {
+        memset(stats, 0, sizeof(video_pacing_stats_t));
+        return;
+    }
+
+    thread_wait_mutex(m->mutex);
+    *stats = m->stats;
+    thread_release_mutex(m->mutex);
+}
+
+/* The statistics of the last second of all monitors that blitted a frame,
+   as a JSON object. Returns the length, truncated to fit the buffer. */
+int
+video_pacing_format_json(char *buf, size_t size)
+{
+    static const char *const stage_names[VIDEO_PACING_STAGES] = {
+        "vsync_blit", "blit_done", "done_present", "total", "interval"
+    };
+    video_pacing_stats_t stats;
+    size_t               len   = 0;
+    int                  first = 1;
+
+#define PACING_PRINT(...)                                                  \
+    do {                                                                   \
+        if (len < size)                                                    \
+            len += snprintf(buf + len, size - len, __VA_ARGS__);           \
+    } while (0)
+
+    PACING_PRINT("{\"enabled\":%i,\"monitors\":[", !!video_pacing);
+    for (int i = 0; i < MONITORS_NUM; i++) {
+        if ((pacing[i].mutex == NULL) || (atomic_load_explicit(&pacing[i].blit_seq, memory_order_relaxed) == 0))
+            continue;
+
+        video_pacing_get_stats(i, &stats);
+        PACING_PRINT("%s{\"monitor\":%i,\"blits\":%u,\"presented\":%u,\"dropped\":%u,\"duplicated\":%u,\"latency_us\":{",
+                     first ? "" : ",", i, stats.blits, stats.presented, stats.dropped, stats.duplicated);
+        for (int s = 0; s < VIDEO_PACING_STAGES; s++) {
+            PACING_PRINT("%s\"%s\":{\"p50\":%u,\"p95\":%u,\"p99\":%u,\"max\":%u}", s ? "," : "", stage_names[s],
+                         stats.latency[s].p50, stats.latency[s].p95, stats.latency[s].p99, stats.latency[s].max);
+        }
+        PACING_PRINT("}}");
+        first = 0;
+    }
+    PACING_PRINT("]}\n");
+
+#undef PACING_PRINT
+
+    return (len < size) ? (int) len : (int) (size - 1);
+}
+
+/* One line summary of the last second for the on-screen overlay. */
+int
+video_pacing_format_overlay(int monitor_index, char *buf, size_t size)
+{
+    video_pacing_stats_t stats;
+
+    video_pacing_get_stats(monitor_index, &stats);
+
+    return snprintf(buf, size, "%u/%u fps  drop %u  dup %u  latency %u.%u / %u.%u ms  interval p99 %u.%u ms",
+                    stats.presented, stats.blits, stats.dropped, stats.duplicated,
+                    stats.latency[VIDEO_PACING_TOTAL].p50 / 1000, (stats.latency[VIDEO_PACING_TOTAL].p50 / 100) % 10,
+                    stats.latency[VIDEO_PACING_TOTAL].p99 / 1000, (stats.latency[VIDEO_PACING_TOTAL].p99 / 100) % 10,
+                    stats.latency[VIDEO_PACING_INTERVAL].p99 / 1000, (stats.latency[VIDEO_PACING_INTERVAL].p99 / 100) % 10);
+}
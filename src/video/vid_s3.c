@@ -9763,6 +9763,8 @@ s3_init(const device_t *info)
                     svga_read_linear, svga_readw_linear, svga_readl_linear,
                     svga_write_linear, svga_writew_linear, svga_writel_linear,
                     NULL, MEM_MAPPING_EXTERNAL, &s3->svga);
+    mem_mapping_set_block_handler(&s3->linear_mapping,
+                                  svga_read_block_linear, svga_write_block_linear);
     /*It's hardcoded to 0xa0000 before the Trio64V+ and expects so*/
     if (chip >= S3_TRIO64V)
         mem_mapping_add(&s3->mmio_mapping, 0, 0,
@@ -41,6 +41,7 @@
 #include <86box/video.h>
 #include <86box/vid_8514a.h>
 #include <86box/vid_xga.h>
+#include <86box/vid_pacing.h>
 #include <86box/vid_svga.h>
 #include <86box/vid_svga_render.h>
 #include <86box/vid_xga_device.h>
@@ -978,18 +979,45 @@ svga_recalctimings(svga_t *svga)
     }
 }
 
+/* Widen the range of target buffer rows that changed in this frame. */
+static __inline void
+svga_mark_dirty(svga_t *svga, int row)
+{
+    if (row < 0)
+        return;
+
+    if (row < svga->dirty_top)
+        svga->dirty_top = row;
+    if (row >= svga->dirty_bottom)
+        svga->dirty_bottom = row + 1;
+}
+
 static void
 svga_do_render(svga_t *svga)
 {
     /* Always render a blank screen and nothing else while in DPMS mode. */
     if (svga->dpms) {
         svga_render_blank(svga);
+        svga_mark_dirty(svga, svga->displine + svga->y_add);
         return;
     }
 
+    /* Cursors and overlays are drawn over the rendered line, and a cursor
+       with a negative latch over lines before it, so those lines are done
+       inline once the worker has caught up. */
+    if (svga->span_worker != NULL) {
+        svga->span_defer = !svga->hwcursor_on && !svga->dac_hwcursor_on && !svga->overlay_on;
+        if (!svga->span_defer)
+            svga_span_worker_sync(svga);
+    }
+
     if (!svga->override) {
         svga->render(svga);
 
+        /* The renderers skip lines whose VRAM did not change. */
+        if ((svga->firstline_draw != 2000) && (svga->lastline_draw == svga->displine))
+            svga_mark_dirty(svga, svga->displine + svga->y_add);
+
         svga->x_add = (svga->monitor->mon_overscan_x >> 1);
         svga_render_overscan_left(svga);
         svga_render_overscan_right(svga);
@@ -997,28 +1025,36 @@ svga_do_render(svga_t *svga)
     }
 
     if (svga->overlay_on) {
-        if (!svga->override && svga->overlay_draw)
+        if (!svga->override && svga->overlay_draw) {
             svga->overlay_draw(svga, svga->displine + svga->y_add);
+            svga_mark_dirty(svga, svga->displine + svga->y_add);
+        }
         svga->overlay_on--;
         if (svga->overlay_on && svga->interlace)
             svga->overlay_on--;
     }
 
     if (svga->dac_hwcursor_on) {
-        if (!svga->override && svga->dac_hwcursor_draw)
+        if (!svga->override && svga->dac_hwcursor_draw) {
             svga->dac_hwcursor_draw(svga, (svga->displine + svga->y_add + ((svga->dac_hwcursor_latch.y >= 0) ? 0 : svga->dac_hwcursor_latch.y)) & 2047);
+            svga_mark_dirty(svga, (svga->displine + svga->y_add + ((svga->dac_hwcursor_latch.y >= 0) ? 0 : svga->dac_hwcursor_latch.y)) & 2047);
+        }
         svga->dac_hwcursor_on--;
         if (svga->dac_hwcursor_on && svga->interlace)
             svga->dac_hwcursor_on--;
     }
 
     if (svga->hwcursor_on) {
-        if (!svga->override && svga->hwcursor_draw)
+        if (!svga->override && svga->hwcursor_draw) {
             svga->hwcursor_draw(svga, (svga->displine + svga->y_add + ((svga->hwcursor_latch.y >= 0) ? 0 : svga->hwcursor_latch.y)) & 2047);
+            svga_mark_dirty(svga, (svga->displine + svga->y_add + ((svga->hwcursor_latch.y >= 0) ? 0 : svga->hwcursor_latch.y)) & 2047);
+        }
         svga->hwcursor_on--;
         if (svga->hwcursor_on && svga->interlace)
             svga->hwcursor_on--;
     }
+
+    svga->span_defer = 0;
 }
 
 void
@@ -1210,6 +1246,8 @@ svga_poll(void *priv)
                 svga->fullchange--;
         }
         if (svga->vc == svga->vsyncstart) {
+            video_pacing_vsync(svga->monitor_index);
+
             svga->dispon = 0;
             svga->cgastat |= 8;
             x = svga->hdisp;
@@ -1222,6 +1260,7 @@ svga_poll(void *priv)
             wx = x;
 
             if (!svga->override) {
+                svga->dirty_valid = 1;
                 if (svga->vertical_linedbl) {
                     wy = (svga->lastline - svga->firstline) << 1;
                     svga->vdisp = wy + 1;
@@ -1319,6 +1358,9 @@ svga_init(const device_t *info, svga_t *svga, void *priv, int memsize,
 {
     int e;
 
+    if (svga_span_pal8 == NULL)
+        svga_span_init();
+
     svga->priv          = priv;
     svga->monitor_index = monitor_index_global;
     svga->monitor       = &monitors[svga->monitor_index];
@@ -1392,12 +1434,19 @@ svga_init(const device_t *info, svga_t *svga, void *priv, int memsize,
 
     svga->map8            = svga->pallook;
 
+    svga->dirty_top = 2048;
+
+    if (video_render_worker)
+        svga_span_worker_start(svga);
+
     return 0;
 }
 
 void
 svga_close(svga_t *svga)
 {
+    svga_span_worker_stop(svga);
+
     free(svga->changedvram);
     free(svga->vram);
 
@@ -1834,6 +1883,9 @@ svga_doblit(int wx, int wy, svga_t *svga)
     int       xs_temp;
     int       ys_temp;
 
+    /* The frame has to be complete before it is blitted. */
+    svga_span_worker_sync(svga);
+
     y_add   = enable_overscan ? svga->monitor->mon_overscan_y : 0;
     x_add   = enable_overscan ? svga->monitor->mon_overscan_x : 0;
     y_start = enable_overscan ? 0 : (svga->monitor->mon_overscan_y >> 1);
@@ -1862,6 +1914,8 @@ svga_doblit(int wx, int wy, svga_t *svga)
         ys_temp = 200;
 
     if ((svga->crtc[0x17] & 0x80) && ((xs_temp != svga->monitor->mon_xsize) || (ys_temp != svga->monitor->mon_ysize) || video_force_resize_get_monitor(svga->monitor_index))) {
+        svga->dirty_valid = 0;
+
         /* Screen res has changed.. fix up, and let them know. */
         svga->monitor->mon_xsize = xs_temp;
         svga->monitor->mon_ysize = ys_temp;
@@ -1901,7 +1955,19 @@ svga_doblit(int wx, int wy, svga_t *svga)
         }
     }
 
-    video_blit_memtoscreen_monitor(x_start, y_start, svga->monitor->mon_xsize + x_add, svga->monitor->mon_ysize + y_add, svga->monitor_index);
+    /* Frames from svga_poll() only changed the rows that were drawn, unless
+       the overscan color changed, which is drawn around every line. */
+    if (svga->dirty_valid && !svga->dpms && (svga->overscan_color == svga->dirty_overscan_color))
+        video_blit_memtoscreen_dirty_monitor(x_start, y_start, svga->monitor->mon_xsize + x_add, svga->monitor->mon_ysize + y_add,
+                                             svga->dirty_top, svga->dirty_bottom - svga->dirty_top, svga->monitor_index);
+    else
+        video_blit_memtoscreen_monitor(x_start, y_start, svga->monitor->mon_xsize + x_add, svga->monitor->mon_ysize + y_add, svga->monitor_index);
+
+    /* Coming out of DPMS mode always blits the whole frame. */
+    svga->dirty_overscan_color = svga->dpms ? 0xffffffff : svga->overscan_color;
+    svga->dirty_valid          = 0;
+    svga->dirty_top            = 2048;
+    svga->dirty_bottom         = 0;
 
     if (svga->vertical_linedbl)
         svga->vertical_linedbl >>= 1;
@@ -2161,3 +2227,74 @@ svga_readl_linear(uint32_t addr, void *priv)
 {
     return svga_readl_common(addr, 1, priv);
 }
+
+/* Straight VRAM copies for the block handlers, addr and len must not cross a
+   4k page. */
+void
+svga_vram_read_block(svga_t *svga, uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    addr &= svga->decode_mask;
+    if (addr >= svga->vram_max) {
+        memset(buf, 0xff, len);
+        return;
+    }
+
+    memcpy(buf, &svga->vram[addr & svga->vram_mask], len);
+}
+
+void
+svga_vram_write_block(svga_t *svga, uint32_t addr, const uint8_t *buf, uint32_t len)
+{
+    addr &= svga->decode_mask;
+    if (addr >= svga->vram_max)
+        return;
+    addr &= svga->vram_mask;
+
+    svga->changedvram[addr >> 12] = svga->monitor->mon_changeframecount;
+    memcpy(&svga->vram[addr], buf, len);
+}
+
+/* Block handlers for linear apertures using svga_read_linear() and
+   svga_write_linear() for bytes. Only word and dword runs in fast mode are
+   done as one copy, everything else goes through the single access handlers. */
+void
+svga_read_block_linear(uint32_t addr, uint8_t *buf, uint32_t len, int size, void *priv)
+{
+    svga_t *svga = (svga_t *) priv;
+
+    if ((size == 1) || !svga->fast || svga->translate_address) {
+        for (uint32_t c = 0; c < len; c += size) {
+            if (size == 4)
+                *(uint32_t *) &buf[c] = svga_readl_linear(addr + c, priv);
+            else if (size == 2)
+                *(uint16_t *) &buf[c] = svga_readw_linear(addr + c, priv);
+            else
+                buf[c] = svga_read_linear(addr + c, priv);
+        }
+        return;
+    }
+
+    cycles -= ((size == 4) ? svga->monitor->mon_video_timing_read_l : svga->monitor->mon_video_timing_read_w) * (int) (len / size);
+    svga_vram_read_block(svga, addr, buf, len);
+}
+
+void
+svga_write_block_linear(uint32_t addr, const uint8_t *buf, uint32_t len, int size, void *priv)
+{
+    svga_t *svga = (svga_t *) priv;
+
+    if ((size == 1) || !svga->fast || svga->translate_address) {
+        for (uint32_t c = 0; c < len; c += size) {
+            if (size == 4)
+                svga_writel_linear(addr + c, *(const uint32_t *) &buf[c], priv);
+            else if (size == 2)
+                svga_writew_linear(addr + c, *(const uint16_t *) &buf[c], priv);
+            else
+                svga_write_linear(addr + c, buf[c], priv);
+        }
+        return;
+    }
+
+    cycles -= ((size == 4) ? svga->monitor->mon_video_timing_write_l : svga->monitor->mon_video_timing_write_w) * (int) (len / size);
+    svga_vram_write_block(svga, addr, buf, len);
+}
@@ -0,0 +1,602 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          SVGA scanline span converters.
+ *
+ *          Convert a run of packed pixels from VRAM to 32bpp in one go,
+ *          for the common renderer cases that have no per-pixel address
+ *          remapping. Vectorized versions are picked at startup based on
+ *          what the host CPU supports, the plain C versions are the
+ *          reference and match the per-pixel renderers exactly.
+ *
+ *          Channel expansion matches calc_15to32()/calc_16to32(), which
+ *          are floor(c * 255 / 31) and floor(c * 255 / 63); the vector
+ *          versions compute those as ((c * 255) * 8457) >> 18 and
+ *          ((c * 255) * 8323) >> 19, which are exact over the channel
+ *          ranges.
+ *
+ *          With video_render_worker set, the spans of a line are handed
+ *          to a worker thread instead of being converted inline. The
+ *          line's state is captured when the span is queued: its source
+ *          pixels are copied out of VRAM into a ring buffer and
+ *          palettized spans carry a snapshot of the palette, so writes to
+ *          VRAM, the palette or the registers later in the frame do not
+ *          affect lines already queued, and the worker never reads VRAM
+ *          itself. Everything queued is finished before the frame is
+ *          blitted.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <86box/86box.h>
+#include <86box/device.h>
+#include <86box/mem.h>
+#include <86box/timer.h>
+#include <86box/thread.h>
+#include <86box/video.h>
+#include <86box/vid_svga.h>
+#include <86box/vid_svga_render.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#    define SPAN_X86
+#    ifdef _MSC_VER
+#        include <intrin.h>
+#        define SPAN_TARGET(t)
+#    else
+#        define SPAN_TARGET(t) __attribute__((target(t)))
+#    endif
+#    include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#    define SPAN_NEON
+#    include <arm_neon.h>
+#endif
+
+void (*svga_span_pal8)(uint32_t *p, const uint8_t *src, int count, const uint32_t *map, uint8_t mask);
+void (*svga_span_15to32)(uint32_t *p, const uint8_t *src, int count);
+void (*svga_span_16to32)(uint32_t *p, const uint8_t *src, int count);
+void (*svga_span_24to32)(uint32_t *p, const uint8_t *src, int count);
+
+/* Enough for every line of a frame, so the CPU thread only ever waits for
+   the worker when it falls a whole frame behind. */
+#define SPAN_JOBS      2048
+#define SPAN_JOBS_MASK (SPAN_JOBS - 1)
+#define SPAN_PALS      64
+/* Room for the source pixels of the queued spans, which is a whole frame at
+   1600x1200 in 24bpp. */
+#define SPAN_SRC_SIZE (8 << 20)
+
+typedef struct span_job_t {
+    uint32_t      *p;
+    const uint8_t *src;
+    uint32_t       src_pos;
+    int            count;
+    uint8_t        type;
+    uint8_t        mask;
+    uint8_t        pal;
+} span_job_t;
+
+typedef struct span_worker_t {
+    thread_t  *thread;
+    event_t   *wake_event;
+    event_t   *idle_event;
+    atomic_int run;
+
+    atomic_uint read_idx;
+    atomic_uint write_idx;
+    span_job_t  jobs[SPAN_JOBS];
+
+    /* Where the next span's source pixels go in src_buf, counting up from 0
+       without wrapping to the buffer size. */
+    uint32_t src_pos;
+    uint8_t *src_buf;
+
+    /* Palette snapshots, and the last job that uses each of them. */
+    int      pal_cur;
+    uint32_t pal_last_job[SPAN_PALS];
+    uint32_t pal[SPAN_PALS][256];
+} span_worker_t;
+
+static void
+span_pal8_c(uint32_t *p, const uint8_t *src, int count, const uint32_t *map, uint8_t mask)
+{
+    for (int x = 0; x < count; x++)
+        p[x] = map[src[x] & mask];
+}
+
+static void
+span_15to32_c(uint32_t *p, const uint8_t *src, int count)
+{
+    const uint16_t *s = (const uint16_t *) src;
+
+    for (int x = 0; x < count; x++)
+        p[x] = video_15to32[s[x]];
+}
+
+static void
+span_16to32_c(uint32_t *p, const uint8_t *src, int count)
+{
+    const uint16_t *s = (const uint16_t *) src;
+
+    for (int x = 0; x < count; x++)
+        p[x] = video_16to32[s[x]];
+}
+
+static void
+span_24to32_c(uint32_t *p, const uint8_t *src, int count)
+{
+    for (int x = 0; x < count; x++, src += 3)
+        p[x] = src[0] | (src[1] << 8) | (src[2] << 16);
+}
+
+#ifdef SPAN_X86
+SPAN_TARGET("sse2")
+static __inline __m128i
+span_expand5_sse2(__m128i c)
+{
+    return _mm_srli_epi16(_mm_mulhi_epu16(_mm_mullo_epi16(c, _mm_set1_epi16(255)), _mm_set1_epi16(8457)), 2);
+}
+
+SPAN_TARGET("sse2")
+static __inline __m128i
+span_expand6_sse2(__m128i c)
+{
+    return _mm_srli_epi16(_mm_mulhi_epu16(_mm_mullo_epi16(c, _mm_set1_epi16(255)), _mm_set1_epi16(8323)), 3);
+}
+
+/* Eight pixels of 8-bit b, g and r channels in 16-bit lanes to 32bpp. */
+SPAN_TARGET("sse2")
+static __inline void
+span_store_bgr_sse2(uint32_t *p, __m128i b, __m128i g, __m128i r)
+{
+    __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+
+    _mm_storeu_si128((__m128i *) p, _mm_unpacklo_epi16(bg, r));
+    _mm_storeu_si128((__m128i *) (p + 4), _mm_unpackhi_epi16(bg, r));
+}
+
+SPAN_TARGET("sse2")
+static void
+span_15to32_sse2(uint32_t *p, const uint8_t *src, int count)
+{
+    const __m128i m5 = _mm_set1_epi16(31);
+    int           x;
+
+    for (x = 0; x <= (count - 8); x += 8) {
+        __m128i c = _mm_loadu_si128((const __m128i *) (src + (x << 1)));
+
+        span_store_bgr_sse2(p + x,
+                            span_expand5_sse2(_mm_and_si128(c, m5)),
+                            span_expand5_sse2(_mm_and_si128(_mm_srli_epi16(c, 5), m5)),
+                            span_expand5_sse2(_mm_and_si128(_mm_srli_epi16(c, 10), m5)));
+    }
+
+    span_15to32_c(p + x, src + (x << 1), count - x);
+}
+
+SPAN_TARGET("sse2")
+static void
+span_16to32_sse2(uint32_t *p, const uint8_t *src, int count)
+{
+    const __m128i m5 = _mm_set1_epi16(31);
+    const __m128i m6 = _mm_set1_epi16(63);
+    int           x;
+
+    for (x = 0; x <= (count - 8); x += 8) {
+        __m128i c = _mm_loadu_si128((const __m128i *) (src + (x << 1)));
+
+        span_store_bgr_sse2(p + x,
+                            span_expand5_sse2(_mm_and_si128(c, m5)),
+                            span_expand6_sse2(_mm_and_si128(_mm_srli_epi16(c, 5), m6)),
+                            span_expand5_sse2(_mm_srli_epi16(c, 11)));
+    }
+
+    span_16to32_c(p + x, src + (x << 1), count - x);
+}
+
+SPAN_TARGET("ssse3")
+static void
+span_24to32_ssse3(uint32_t *p, const uint8_t *src, int count)
+{
+    const __m128i shuf = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    int           x;
+
+    /* Each load reads 16 bytes for 4 pixels, so the last few pixels are left
+       to the C version rather than reading past the end of the span. */
+    for (x = 0; x <= (count - 6); x += 4)
+        _mm_storeu_si128((__m128i *) (p + x), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (src + x * 3)), shuf));
+
+    span_24to32_c(p + x, src + x * 3, count - x);
+}
+
+SPAN_TARGET("avx2")
+static void
+span_pal8_avx2(uint32_t *p, const uint8_t *src, int count, const uint32_t *map, uint8_t mask)
+{
+    const __m256i m = _mm256_set1_epi32(mask);
+    int           x;
+
+    for (x = 0; x <= (count - 8); x += 8) {
+        __m256i idx = _mm256_and_si256(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (src + x))), m);
+
+        _mm256_storeu_si256((__m256i *) (p + x), _mm256_i32gather_epi32((const int *) map, idx, 4));
+    }
+
+    span_pal8_c(p + x, src + x, count - x, map, mask);
+}
+
+static void
+span_cpu_features(int *sse2, int *ssse3, int *avx2)
+{
+#    ifdef _MSC_VER
+    int regs[4];
+
+    __cpuid(regs, 0);
+    if (regs[0] < 1) {
+        *sse2 = *ssse3 = *avx2 = 0;
+        return;
+    }
+    __cpuid(regs, 1);
+    *sse2  = !!(regs[3] & (1 << 26));
+    *ssse3 = !!(regs[2] & (1 << 9));
+    *avx2  = 0;
+    /* AVX2 also needs the OS to save the YMM state. */
+    if ((regs[2] & (1 << 27)) && ((_xgetbv(0) & 6) == 6)) {
+        __cpuid(regs, 0);
+        if (regs[0] >= 7) {
+            __cpuidex(regs, 7, 0);
+            *avx2 = !!(regs[1] & (1 << 5));
+        }
+    }
+#    else
+    __builtin_cpu_init();
+    *sse2  = __builtin_cpu_supports("sse2");
+    *ssse3 = __builtin_cpu_supports("ssse3");
+    *avx2  = __builtin_cpu_supports("avx2");
+#    endif
+}
+#endif
+
+#ifdef SPAN_NEON
+static __inline uint16x8_t
+span_expand_neon(uint16x8_t c, uint16_t mul, int shift)
+{
+    uint16x8_t v  = vmulq_n_u16(c, 255);
+    uint16x8_t hi = vcombine_u16(vshrn_n_u32(vmull_n_u16(vget_low_u16(v), mul), 16),
+                                 vshrn_n_u32(vmull_n_u16(vget_high_u16(v), mul), 16));
+
+    return vshlq_u16(hi, vdupq_n_s16(-shift));
+}
+
+static __inline void
+span_store_bgr_neon(uint32_t *p, uint16x8_t b, uint16x8_t g, uint16x8_t r)
+{
+    uint16x8x2_t z = vzipq_u16(vorrq_u16(b, vshlq_n_u16(g, 8)), r);
+
+    vst1q_u32(p, vreinterpretq_u32_u16(z.val[0]));
+    vst1q_u32(p + 4, vreinterpretq_u32_u16(z.val[1]));
+}
+
+static void
+span_15to32_neon(uint32_t *p, const uint8_t *src, int count)
+{
+    const uint16x8_t m5 = vdupq_n_u16(31);
+    int              x;
+
+    for (x = 0; x <= (count - 8); x += 8) {
+        uint16x8_t c = vld1q_u16((const uint16_t *) (src + (x << 1)));
+
+        span_store_bgr_neon(p + x,
+                            span_expand_neon(vandq_u16(c, m5), 8457, 2),
+                            span_expand_neon(vandq_u16(vshrq_n_u16(c, 5), m5), 8457, 2),
+                            span_expand_neon(vandq_u16(vshrq_n_u16(c, 10), m5), 8457, 2));
+    }
+
+    span_15to32_c(p + x, src + (x << 1), count - x);
+}
+
+static void
+span_16to32_neon(uint32_t *p, const uint8_t *src, int count)
+{
+    const uint16x8_t m5 = vdupq_n_u16(31);
+    const uint16x8_t m6 = vdupq_n_u16(63);
+    int              x;
+
+    for (x = 0; x <= (count - 8); x += 8) {
+        uint16x8_t c = vld1q_u16((const uint16_t *) (src + (x << 1)));
+
+        span_store_bgr_neon(p + x,
+                            span_expand_neon(vandq_u16(c, m5), 8457, 2),
+                            span_expand_neon(vandq_u16(vshrq_n_u16(c, 5), m6), 8323, 3),
+                            span_expand_neon(vshrq_n_u16(c, 11), 8457, 2));
+    }
+
+    span_16to32_c(p + x, src + (x << 1), count - x);
+}
+
+static void
+span_24to32_neon(uint32_t *p, const uint8_t *src, int count)
+{
+    int x;
+
+    for (x = 0; x <= (count - 8); x += 8) {
+        uint8x8x3_t s = vld3_u8(src + x * 3);
+        uint8x8x4_t d;
+
+        d.val[0] = s.val[0];
+        d.val[1] = s.val[1];
+        d.val[2] = s.val[2];
+        d.val[3] = vdup_n_u8(0);
+        vst4_u8((uint8_t *) (p + x), d);
+    }
+
+    span_24to32_c(p + x, src + x * 3, count - x);
+}
+#endif
+
+static void
+span_convert(span_worker_t *w, const span_job_t *job)
+{
+    switch (job->type) {
+        case SVGA_SPAN_PAL8:
+            svga_span_pal8(job->p, job->src, job->count, w->pal[job->pal], job->mask);
+            break;
+        case SVGA_SPAN_15TO32:
+            svga_span_15to32(job->p, job->src, job->count);
+            break;
+        case SVGA_SPAN_16TO32:
+            svga_span_16to32(job->p, job->src, job->count);
+            break;
+        case SVGA_SPAN_24TO32:
+            svga_span_24to32(job->p, job->src, job->count);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void
+span_worker_thread(void *priv)
+{
+    span_worker_t *w = (span_worker_t *) priv;
+
+    while (w->run) {
+        thread_wait_event(w->wake_event, -1);
+        thread_reset_event(w->wake_event);
+
+        while (w->read_idx != w->write_idx) {
+            span_convert(w, &w->jobs[w->read_idx & SPAN_JOBS_MASK]);
+            w->read_idx++;
+        }
+
+        thread_set_event(w->idle_event);
+    }
+}
+
+/* Wait until at most left jobs are still queued. */
+static void
+span_worker_wait(span_worker_t *w, uint32_t left)
+{
+    while ((w->write_idx - w->read_idx) > left) {
+        thread_reset_event(w->idle_event);
+        if ((w->write_idx - w->read_idx) > left)
+            thread_wait_event(w->idle_event, 1);
+    }
+}
+
+/* Copy the source pixels of a span into the ring buffer, first waiting for
+   the worker to be done with the oldest spans if there is no room. Returns
+   NULL if the span does not fit at all. */
+static const uint8_t *
+span_worker_src(span_worker_t *w, const uint8_t *src, uint32_t size, uint32_t *pos)
+{
+    uint32_t start = w->src_pos;
+    uint32_t pending;
+
+    if (size > SPAN_SRC_SIZE)
+        return NULL;
+
+    /* Spans do not wrap around the end of the buffer. */
+    if (((start % SPAN_SRC_SIZE) + size) > SPAN_SRC_SIZE)
+        start += SPAN_SRC_SIZE - (start % SPAN_SRC_SIZE);
+
+    while ((pending = w->write_idx - w->read_idx) > 0) {
+        if ((start + size - w->jobs[w->read_idx & SPAN_JOBS_MASK].src_pos) <= SPAN_SRC_SIZE)
+            break;
+        span_worker_wait(w, pending - 1);
+    }
+
+    memcpy(&w->src_buf[start % SPAN_SRC_SIZE], src, size);
+    w->src_pos = start + size;
+    *pos       = start;
+
+    return &w->src_buf[start % SPAN_SRC_SIZE];
+}
+
+/* The palette slot for the current palette, taking a new snapshot if it
+   changed since the last palettized span. */
+static int
+span_worker_pal(span_worker_t *w, const uint32_t *map)
+{
+    uint32_t pending;
+
+    if ((w->pal_cur >= 0) && !memcmp(w->pal[w->pal_cur], map, sizeof(w->pal[0])))
+        return w->pal_cur;
+
+    w->pal_cur = (w->pal_cur + 1) % SPAN_PALS;
+
+    /* Wait for the worker to be done with the slot's previous snapshot. */
+    pending = w->write_idx - w->read_idx;
+    if ((w->pal_last_job[w->pal_cur] - w->read_idx) < pending)
+        span_worker_wait(w, w->write_idx - w->pal_last_job[w->pal_cur] - 1);
+
+    memcpy(w->pal[w->pal_cur], map, sizeof(w->pal[0]));
+    return w->pal_cur;
+}
+
+static void
+span_draw_now(svga_t *svga, int type, uint32_t *p, const uint8_t *src, int count)
+{
+    if (type == SVGA_SPAN_PAL8)
+        svga_span_pal8(p, src, count, svga->map8, svga->dac_mask);
+    else if (type == SVGA_SPAN_15TO32)
+        svga_span_15to32(p, src, count);
+    else if (type == SVGA_SPAN_16TO32)
+        svga_span_16to32(p, src, count);
+    else
+        svga_span_24to32(p, src, count);
+}
+
+void
+svga_span_draw(svga_t *svga, int type, uint32_t *p, const uint8_t *src, int count)
+{
+    span_worker_t *w = (span_worker_t *) svga->span_worker;
+    span_job_t    *job;
+    uint32_t       idx;
+    uint32_t       src_pos;
+    int            bytes = (type == SVGA_SPAN_PAL8) ? 1 : ((type == SVGA_SPAN_24TO32) ? 3 : 2);
+    int            left;
+    int            right;
+    const uint8_t *copy;
+
+    if (!svga->span_defer || (w == NULL)) {
+        span_draw_now(svga, type, p, src, count);
+        return;
+    }
+
+    /* The overscan is drawn over both ends of the span right after the line
+       is rendered, so only convert what it leaves visible, or the worker
+       would overwrite the overscan afterwards. */
+    if (!svga->scrblank && (svga->hdisp > 0)) {
+        left  = (svga->monitor->mon_overscan_x >> 1) - svga->x_add;
+        right = left + svga->hdisp;
+        if (right < count)
+            count = right;
+        if (left > 0) {
+            p += left;
+            src += left * bytes;
+            count -= left;
+        }
+        if (count <= 0)
+            return;
+    }
+
+    span_worker_wait(w, SPAN_JOBS - 1);
+
+    copy = span_worker_src(w, src, count * bytes, &src_pos);
+    if (copy == NULL) {
+        span_draw_now(svga, type, p, src, count);
+        return;
+    }
+
+    idx          = w->write_idx;
+    job          = &w->jobs[idx & SPAN_JOBS_MASK];
+    job->p       = p;
+    job->src     = copy;
+    job->src_pos = src_pos;
+    job->count   = count;
+    job->type    = type;
+    if (type == SVGA_SPAN_PAL8) {
+        job->pal                  = span_worker_pal(w, svga->map8);
+        job->mask                 = svga->dac_mask;
+        w->pal_last_job[job->pal] = idx;
+    }
+
+    w->write_idx = idx + 1;
+    /* Only wake the worker if it may have gone idle. */
+    if (w->read_idx == idx)
+        thread_set_event(w->wake_event);
+}
+
+void
+svga_span_worker_start(svga_t *svga)
+{
+    span_worker_t *w = calloc(1, sizeof(span_worker_t));
+
+    w->pal_cur = -1;
+    for (int c = 0; c < SPAN_PALS; c++)
+        w->pal_last_job[c] = (uint32_t) -1;
+    w->src_buf    = malloc(SPAN_SRC_SIZE);
+    w->wake_event = thread_create_event();
+    w->idle_event = thread_create_event();
+    w->run        = 1;
+    w->thread     = thread_create(span_worker_thread, w);
+
+    svga->span_worker = w;
+}
+
+void
+svga_span_worker_sync(svga_t *svga)
+{
+    span_worker_t *w = (span_worker_t *) svga->span_worker;
+
+    if (w != NULL)
+        span_worker_wait(w, 0);
+}
+
+void
+svga_span_worker_stop(svga_t *svga)
+{
+    span_worker_t *w = (span_worker_t *) svga->span_worker;
+
+    if (w == NULL)
+        return;
+
+    span_worker_wait(w, 0);
+    w->run = 0;
+    thread_set_event(w->wake_event);
+    thread_wait(w->thread);
+    thread_destroy_event(w->wake_event);
+    thread_destroy_event(w->idle_event);
+    free(w->src_buf);
+    free(w);
+
+    svga->span_worker = NULL;
+}
+
+/* Use the plain C versions only, the reference the benchmark checks the
+   vectorized versions against. */
+void
+svga_span_init_generic(void)
+{
+    svga_span_pal8   = span_pal8_c;
+    svga_span_15to32 = span_15to32_c;
+    svga_span_16to32 = span_16to32_c;
+    svga_span_24to32 = span_24to32_c;
+}
+
+void
+svga_span_init(void)
+{
+#ifdef SPAN_X86
+    int sse2;
+    int ssse3;
+    int avx2;
+#endif
+
+    svga_span_init_generic();
+
+#if defined(SPAN_X86)
+    span_cpu_features(&sse2, &ssse3, &avx2);
+    if (sse2) {
+        svga_span_15to32 = span_15to32_sse2;
+        svga_span_16to32 = span_16to32_sse2;
+    }
+    if (ssse3)
+        svga_span_24to32 = span_24to32_ssse3;
+    if (avx2)
+        svga_span_pal8 = span_pal8_avx2;
+#elif defined(SPAN_NEON)
+    /* NEON has no gather, the palette lookup stays scalar. */
+    svga_span_15to32 = span_15to32_neon;
+    svga_span_16to32 = span_16to32_neon;
+    svga_span_24to32 = span_24to32_neon;
+#endif
+}
@@ -0,0 +1,282 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Standalone benchmark for the SVGA scanline span converters.
+ *
+ *          Renders frames of synthetic VRAM at common modes through the
+ *          plain C span converters and the ones svga_span_init() picks
+ *          for the host CPU, and checks that both give the same output,
+ *          including for odd span lengths and unaligned sources. Exits
+ *          with 1 if any output differs.
+ *
+ *          Usage: span_bench [frames]
+ *
+ *
+ *
+ * Authors: agent, <agent@local>
+ *
+ *          Copyright 2026 agent.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+#include <86box/86box.h>
+#include <86box/device.h>
+#include <86box/mem.h>
+#include <86box/plat.h>
+#include <86box/timer.h>
+#include <86box/thread.h>
+#include <86box/video.h>
+#include <86box/vid_svga.h>
+#include <86box/vid_svga_render.h>
+
+#define BENCH_FRAMES 200
+#define BENCH_MAX_W  1600
+#define BENCH_MAX_H  1200
+#define BENCH_TAIL   67 /* longest span of the odd length check */
+
+typedef struct span_kernels_t {
+    void (*pal8)(uint32_t *p, const uint8_t *src, int count, const uint32_t *map, uint8_t mask);
+    void (*to32[3])(uint32_t *p, const uint8_t *src, int count);
+} span_kernels_t;
+
+static const struct {
+    int w;
+    int h;
+} modes[] = {
+    {  640,  480 },
+    {  800,  600 },
+    { 1024,  768 },
+    { 1280, 1024 },
+    { 1600, 1200 }
+};
+
+static const char *const type_names[] = { "8bpp", "15bpp", "16bpp", "24bpp" };
+static const int         type_bytes[] = { 1, 2, 2, 3 };
+
+uint32_t *video_15to32;
+uint32_t *video_16to32;
+
+/* The span worker is never started here, but vid_svga_span.c still needs
+   the thread functions to link. */
+thread_t *
+thread_create_named(UNUSED(void (*thread_func)(void *param)), UNUSED(void *param), UNUSED(const char *name))
+{
+    return NULL;
+}
+
+int
+thread_wait(UNUSED(thread_t *arg))
+{
+    return 0;
+}
+
+event_t *
+thread_create_event(void)
+{
+    return NULL;
+}
+
+void
+thread_set_event(UNUSED(event_t *arg))
+{
+    //
+}
+
+void
+thread_reset_event(UNUSED(event_t *arg))
+{
+    //
+}
+
+int
+thread_wait_event(UNUSED(event_t *arg), UNUSED(int timeout))
+{
+    return 0;
+}
+
+void
+thread_destroy_event(UNUSED(event_t *arg))
+{
+    //
+}
+
+static uint64_t
+bench_time_us(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ((uint64_t) ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+static void
+bench_get_kernels(span_kernels_t *k)
+{
+    k->pal8    = svga_span_pal8;
+    k->to32[0] = svga_span_15to32;
+    k->to32[1] = svga_span_16to32;
+    k->to32[2] = svga_span_24to32;
+}
+
+static void
+bench_span(const span_kernels_t *k, int type, uint32_t *p, const uint8_t *src, int count, const uint32_t *map, uint8_t mask)
+{
+    if (type == SVGA_SPAN_PAL8)
+        k->pal8(p, src, count, map, mask);
+    else
+        k->to32[type - 1](p, src, count);
+}
+
+/* Renders the given number of frames line by line and returns the time
+   taken in microseconds. */
+static uint64_t
+bench_render(const span_kernels_t *k, int type, int w, int h, int frames, uint32_t *buf, const uint8_t *vram, const uint32_t *map)
+{
+    int      pitch = w * type_bytes[type];
+    uint64_t start = bench_time_us();
+
+    for (int f = 0; f < frames; f++) {
+        for (int y = 0; y < h; y++)
+            bench_span(k, type, &buf[y * w], &vram[y * pitch], w, map, 0xff);
+    }
+
+    return bench_time_us() - start;
+}
+
+/* Every span length up to BENCH_TAIL from every source alignment, so the
+   vector tails and unaligned loads are covered, plus the whole frame of
+   every mode. Returns the number of mismatches. */
+static int
+bench_check(const span_kernels_t *ref, const span_kernels_t *vec, int type, uint32_t *ref_buf, uint32_t *vec_buf, const uint8_t *vram, const uint32_t *map)
+{
+    static const uint8_t masks[] = { 0xff, 0x0f };
+    int                  errors  = 0;
+    int                  count;
+
+    for (int m = 0; m < (int) (sizeof(masks) / sizeof(masks[0])); m++) {
+        if ((type != SVGA_SPAN_PAL8) && (m > 0))
+            break;
+
+        for (count = 0; count <= BENCH_TAIL; count++) {
+            for (int align = 0; align < 16; align++) {
+                memset(ref_buf, 0xaa, (BENCH_TAIL + 1) * sizeof(uint32_t));
+                memset(vec_buf, 0xaa, (BENCH_TAIL + 1) * sizeof(uint32_t));
+                bench_span(ref, type, ref_buf, &vram[align], count, map, masks[m]);
+                bench_span(vec, type, vec_buf, &vram[align], count, map, masks[m]);
+                if (memcmp(ref_buf, vec_buf, (BENCH_TAIL + 1) * sizeof(uint32_t))) {
+                    printf("  %s: mismatch with %i pixels from offset %i, mask %02X\n",
+                           type_names[type], count, align, masks[m]);
+                    errors++;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < (int) (sizeof(modes) / sizeof(modes[0])); i++) {
+        count = modes[i].w * modes[i].h;
+        bench_span(ref, type, ref_buf, vram, count, map, 0xff);
+        bench_span(vec, type, vec_buf, vram, count, map, 0xff);
+        if (memcmp(ref_buf, vec_buf, count * sizeof(uint32_t))) {
+            printf("  %s: mismatch at %ix%i\n", type_names[type], modes[i].w, modes[i].h);
+            errors++;
+        }
+    }
+
+    return errors;
+}
+
+int
+main(int argc, char *argv[])
+{
+    span_kernels_t ref;
+    span_kernels_t vec;
+    uint32_t       map[256];
+    uint32_t      *ref_buf;
+    uint32_t      *vec_buf;
+    uint8_t       *vram;
+    uint32_t       seed   = 0x86b0c5;
+    int            frames = BENCH_FRAMES;
+    int            errors = 0;
+    int            w;
+    int            h;
+    uint64_t       ref_us;
+    uint64_t       vec_us;
+
+    if (argc > 1)
+        frames = atoi(argv[1]);
+    if (frames <= 0)
+        frames = 1;
+
+    video_15to32 = malloc(4 * 65536);
+    video_16to32 = malloc(4 * 65536);
+    for (uint32_t c = 0; c < 65536; c++) {
+        video_15to32[c] = (((c & 0x1f) * 255 / 31) | ((((c >> 5) & 0x1f) * 255 / 31) << 8) |
+                           ((((c >> 10) & 0x1f) * 255 / 31) << 16));
+        video_16to32[c] = (((c & 0x1f) * 255 / 31) | ((((c >> 5) & 0x3f) * 255 / 63) << 8) |
+                           ((((c >> 11) & 0x1f) * 255 / 31) << 16));
+    }
+
+    /* Random VRAM and palette, with room for the check to read past the
+       end of the largest frame from an unaligned offset. */
+    vram    = malloc(BENCH_MAX_W * BENCH_MAX_H * 3 + 16);
+    ref_buf = malloc(BENCH_MAX_W * BENCH_MAX_H * sizeof(uint32_t));
+    vec_buf = malloc(BENCH_MAX_W * BENCH_MAX_H * sizeof(uint32_t));
+    for (int c = 0; c < (BENCH_MAX_W * BENCH_MAX_H * 3 + 16); c++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        vram[c] = seed >> 24;
+    }
+    for (int c = 0; c < 256; c++)
+        map[c] = ((c * 0x9e3779b9) >> 8) & 0xffffff;
+
+    svga_span_init_generic();
+    bench_get_kernels(&ref);
+    svga_span_init();
+    bench_get_kernels(&vec);
+
+    printf("%i frames per mode, times in ms\n\n", frames);
+    printf("%-6s %-10s %10s %10s %8s\n", "type", "mode", "C", "vector", "speedup");
+
+    for (int type = SVGA_SPAN_PAL8; type <= SVGA_SPAN_24TO32; type++) {
+        if ((type == SVGA_SPAN_PAL8) ? (vec.pal8 == ref.pal8) : (vec.to32[type - 1] == ref.to32[type - 1])) {
+            printf("%-6s no vectorized version on this host\n", type_names[type]);
+            continue;
+        }
+
+        errors += bench_check(&ref, &vec, type, ref_buf, vec_buf, vram, map);
+
+        for (int i = 0; i < (int) (sizeof(modes) / sizeof(modes[0])); i++) {
+            w      = modes[i].w;
+            h      = modes[i].h;
+            ref_us = bench_render(&ref, type, w, h, frames, ref_buf, vram, map);
+            vec_us = bench_render(&vec, type, w, h, frames, vec_buf, vram, map);
+
+            printf("%-6s %4ix%-5i %10.1f %10.1f %7.2fx\n", type_names[type], w, h,
+                   ref_us / 1000.0, vec_us / 1000.0, vec_us ? ((double) ref_us / vec_us) : 0.0);
+        }
+    }
+
+    free(vec_buf);
+    free(ref_buf);
+    free(vram);
+    free(video_16to32);
+    free(video_15to32);
+
+    if (errors) {
+        printf("\n%i mismatches between the C and the vectorized converters\n", errors);
+        return 1;
+    }
+
+    return 0;
+}
@@ -18,6 +18,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stddef.h>
@@ -684,6 +685,40 @@ voodoo_writel(uint32_t addr, uint32_t val, void *priv)
         }
 }
 
+/*Runs of accesses from string instructions and bus master DMA. These still
+  go through the FIFO one access at a time, but skip the memory mapping
+  lookup for each of them. There are no byte handlers, so byte runs read as
+  0xff and are dropped, as they would be otherwise.*/
+static void
+voodoo_read_block(uint32_t addr, uint8_t *buf, uint32_t len, int size, void *priv)
+{
+    if (size == 1) {
+        memset(buf, 0xff, len);
+        return;
+    }
+
+    for (uint32_t c = 0; c < len; c += size) {
+        if (size == 4)
+            *(uint32_t *) &buf[c] = voodoo_readl(addr + c, priv);
+        else
+            *(uint16_t *) &buf[c] = voodoo_readw(addr + c, priv);
+    }
+}
+
+static void
+voodoo_write_block(uint32_t addr, const uint8_t *buf, uint32_t len, int size, void *priv)
+{
+    if (size == 1)
+        return;
+
+    for (uint32_t c = 0; c < len; c += size) {
+        if (size == 4)
+            voodoo_writel(addr + c, *(const uint32_t *) &buf[c], priv);
+        else
+            voodoo_writew(addr + c, *(const uint16_t *) &buf[c], priv);
+    }
+}
+
 static uint16_t
 voodoo_snoop_readw(uint32_t addr, void *priv)
 {
@@ -922,9 +957,9 @@ voodoo_card_init(void)
     voodoo->fb_size           = device_get_config_int("framebuffer_memory");
     voodoo->fb_mask           = (voodoo->fb_size << 20) - 1;
     voodoo->render_threads    = device_get_config_int("render_threads");
-    voodoo->odd_even_mask     = voodoo->render_threads - 1;
 #ifndef NO_CODEGEN
     voodoo->use_recompiler = device_get_config_int("recompiler");
+    voodoo->jit_warm_start = device_get_config_int("jit_warm_start");
 #endif
     voodoo->type = device_get_config_int("type");
     switch (voodoo->type) {
@@ -950,6 +985,7 @@ voodoo_card_init(void)
     pci_add_card(PCI_ADD_NORMAL, voodoo_pci_read, voodoo_pci_write, voodoo, &voodoo->pci_slot);
 
     mem_mapping_add(&voodoo->mapping, 0, 0, NULL, voodoo_readw, voodoo_readl, NULL, voodoo_writew, voodoo_writel, NULL, MEM_MAPPING_EXTERNAL, voodoo);
+    mem_mapping_set_block_handler(&voodoo->mapping, voodoo_read_block, voodoo_write_block);
 
     voodoo->fb_mem     = malloc(4 * 1024 * 1024);
     voodoo->tex_mem[0] = malloc(voodoo->texture_size * 1024 * 1024);
@@ -958,16 +994,7 @@ voodoo_card_init(void)
     voodoo->tex_mem_w[0] = (uint16_t *) voodoo->tex_mem[0];
     voodoo->tex_mem_w[1] = (uint16_t *) voodoo->tex_mem[1];
 
-    for (c = 0; c < TEX_CACHE_MAX; c++) {
-        voodoo->texture_cache[0][c].data     = malloc((256 * 256 + 256 * 256 + 128 * 128 + 64 * 64 + 32 * 32 + 16 * 16 + 8 * 8 + 4 * 4 + 2 * 2) * 4);
-        voodoo->texture_cache[0][c].base     = -1; /*invalid*/
-        voodoo->texture_cache[0][c].refcount = 0;
-        if (voodoo->dual_tmus) {
-            voodoo->texture_cache[1][c].data     = malloc((256 * 256 + 256 * 256 + 128 * 128 + 64 * 64 + 32 * 32 + 16 * 16 + 8 * 8 + 4 * 4 + 2 * 2) * 4);
-            voodoo->texture_cache[1][c].base     = -1; /*invalid*/
-            voodoo->texture_cache[1][c].refcount = 0;
-        }
-    }
+    voodoo_texture_cache_init(voodoo, device_get_config_int("texture_cache"));
 
     timer_add(&voodoo->timer, voodoo_callback, voodoo, 1);
 
@@ -975,30 +1002,11 @@ voodoo_card_init(void)
     voodoo->fbiInit0 = 0;
 
     voodoo->wake_fifo_thread         = thread_create_event();
-    voodoo->wake_render_thread[0]    = thread_create_event();
-    voodoo->wake_render_thread[1]    = thread_create_event();
-    voodoo->wake_render_thread[2]    = thread_create_event();
-    voodoo->wake_render_thread[3]    = thread_create_event();
     voodoo->wake_main_thread         = thread_create_event();
     voodoo->fifo_not_full_event      = thread_create_event();
-    voodoo->render_not_full_event[0] = thread_create_event();
-    voodoo->render_not_full_event[1] = thread_create_event();
-    voodoo->render_not_full_event[2] = thread_create_event();
-    voodoo->render_not_full_event[3] = thread_create_event();
     voodoo->fifo_thread_run          = 1;
     voodoo->fifo_thread              = thread_create(voodoo_fifo_thread, voodoo);
-    voodoo->render_thread_run[0]     = 1;
-    voodoo->render_thread[0]         = thread_create(voodoo_render_thread_1, voodoo);
-    if (voodoo->render_threads >= 2) {
-        voodoo->render_thread_run[1] = 1;
-        voodoo->render_thread[1]     = thread_create(voodoo_render_thread_2, voodoo);
-    }
-    if (voodoo->render_threads == 4) {
-        voodoo->render_thread_run[2] = 1;
-        voodoo->render_thread[2]     = thread_create(voodoo_render_thread_3, voodoo);
-        voodoo->render_thread_run[3] = 1;
-        voodoo->render_thread[3]     = thread_create(voodoo_render_thread_4, voodoo);
-    }
+    voodoo_render_threads_start(voodoo);
     voodoo->swap_mutex = thread_create_mutex();
     timer_add(&voodoo->wake_timer, voodoo_wake_timer, (void *) voodoo, 0);
 
@@ -1073,9 +1081,9 @@ voodoo_2d3d_card_init(int type)
     voodoo->dithersub_enabled = device_get_config_int("dithersub");
     voodoo->scrfilter         = device_get_config_int("dacfilter");
     voodoo->render_threads    = device_get_config_int("render_threads");
-    voodoo->odd_even_mask     = voodoo->render_threads - 1;
 #ifndef NO_CODEGEN
     voodoo->use_recompiler = device_get_config_int("recompiler");
+    voodoo->jit_warm_start = device_get_config_int("jit_warm_start");
 #endif
     voodoo->type      = type;
     voodoo->dual_tmus = (type == VOODOO_3) ? 1 : 0;
@@ -1083,46 +1091,18 @@ voodoo_2d3d_card_init(int type)
     /*generate filter lookup tables*/
     voodoo_generate_filter_v2(voodoo);
 
-    for (c = 0; c < TEX_CACHE_MAX; c++) {
-        voodoo->texture_cache[0][c].data     = malloc((256 * 256 + 256 * 256 + 128 * 128 + 64 * 64 + 32 * 32 + 16 * 16 + 8 * 8 + 4 * 4 + 2 * 2) * 4);
-        voodoo->texture_cache[0][c].base     = -1; /*invalid*/
-        voodoo->texture_cache[0][c].refcount = 0;
-        if (voodoo->dual_tmus) {
-            voodoo->texture_cache[1][c].data     = malloc((256 * 256 + 256 * 256 + 128 * 128 + 64 * 64 + 32 * 32 + 16 * 16 + 8 * 8 + 4 * 4 + 2 * 2) * 4);
-            voodoo->texture_cache[1][c].base     = -1; /*invalid*/
-            voodoo->texture_cache[1][c].refcount = 0;
-        }
-    }
+    voodoo_texture_cache_init(voodoo, device_get_config_int("texture_cache"));
 
     timer_add(&voodoo->timer, voodoo_callback, voodoo, 1);
 
     voodoo->fbiInit0 = 0;
 
     voodoo->wake_fifo_thread         = thread_create_event();
-    voodoo->wake_render_thread[0]    = thread_create_event();
-    voodoo->wake_render_thread[1]    = thread_create_event();
-    voodoo->wake_render_thread[2]    = thread_create_event();
-    voodoo->wake_render_thread[3]    = thread_create_event();
     voodoo->wake_main_thread         = thread_create_event();
     voodoo->fifo_not_full_event      = thread_create_event();
-    voodoo->render_not_full_event[0] = thread_create_event();
-    voodoo->render_not_full_event[1] = thread_create_event();
-    voodoo->render_not_full_event[2] = thread_create_event();
-    voodoo->render_not_full_event[3] = thread_create_event();
     voodoo->fifo_thread_run          = 1;
     voodoo->fifo_thread              = thread_create(voodoo_fifo_thread, voodoo);
-    voodoo->render_thread_run[0]     = 1;
-    voodoo->render_thread[0]         = thread_create(voodoo_render_thread_1, voodoo);
-    if (voodoo->render_threads >= 2) {
-        voodoo->render_thread_run[1] = 1;
-        voodoo->render_thread[1]     = thread_create(voodoo_render_thread_2, voodoo);
-    }
-    if (voodoo->render_threads == 4) {
-        voodoo->render_thread_run[2] = 1;
-        voodoo->render_thread[2]     = thread_create(voodoo_render_thread_3, voodoo);
-        voodoo->render_thread_run[3] = 1;
-        voodoo->render_thread[3]     = thread_create(voodoo_render_thread_4, voodoo);
-    }
+    voodoo_render_threads_start(voodoo);
     voodoo->swap_mutex = thread_create_mutex();
     timer_add(&voodoo->wake_timer, voodoo_wake_timer, (void *) voodoo, 0);
 
@@ -1249,37 +1229,18 @@ voodoo_card_close(voodoo_t *voodoo)
     voodoo->fifo_thread_run = 0;
     thread_set_event(voodoo->wake_fifo_thread);
     thread_wait(voodoo->fifo_thread);
-    voodoo->render_thread_run[0] = 0;
-    thread_set_event(voodoo->wake_render_thread[0]);
-    thread_wait(voodoo->render_thread[0]);
-    if (voodoo->render_threads >= 2) {
-        voodoo->render_thread_run[1] = 0;
-        thread_set_event(voodoo->wake_render_thread[1]);
-        thread_wait(voodoo->render_thread[1]);
-    }
-    if (voodoo->render_threads == 4) {
-        voodoo->render_thread_run[2] = 0;
-        thread_set_event(voodoo->wake_render_thread[2]);
-        thread_wait(voodoo->render_thread[2]);
-        voodoo->render_thread_run[3] = 0;
-        thread_set_event(voodoo->wake_render_thread[3]);
-        thread_wait(voodoo->render_thread[3]);
-    }
+    voodoo_render_threads_stop(voodoo);
     thread_destroy_event(voodoo->fifo_not_full_event);
     thread_destroy_event(voodoo->wake_main_thread);
     thread_destroy_event(voodoo->wake_fifo_thread);
-    thread_destroy_event(voodoo->wake_render_thread[0]);
-    thread_destroy_event(voodoo->wake_render_thread[1]);
-    thread_destroy_event(voodoo->render_not_full_event[0]);
-    thread_destroy_event(voodoo->render_not_full_event[1]);
 
-    for (uint8_t c = 0; c < TEX_CACHE_MAX; c++) {
-        if (voodoo->dual_tmus)
-            free(voodoo->texture_cache[1][c].data);
-        free(voodoo->texture_cache[0][c].data);
-    }
+    voodoo_log("Texture cache: %" PRIu64 " evicted by writes, %" PRIu64 " replaced, %" PRIu64 " render thread waits\n",
+               voodoo->tex_evict_count, voodoo->tex_replace_count, voodoo->tex_wait_count);
+    voodoo_texture_cache_close(voodoo);
 #ifndef NO_CODEGEN
     voodoo_codegen_close(voodoo);
+    voodoo_log("Recompiler: %" PRIu64 " block cache hits, %" PRIu64 " misses\n",
+               voodoo->jit_hit_count, voodoo->jit_miss_count);
 #endif
     if (voodoo->type < VOODOO_BANSHEE && voodoo->fb_mem) {
         free(voodoo->fb_mem);
@@ -1403,12 +1364,59 @@ static const device_config_t voodoo_config[] = {
                 .description = "4",
                 .value = 4
             },
+            {
+                .description = "6",
+                .value = 6
+            },
+            {
+                .description = "8",
+                .value = 8
+            },
+            {
+                .description = "12",
+                .value = 12
+            },
+            {
+                .description = "16",
+                .value = 16
+            },
             {
                 .description = ""
             }
         },
         .default_int = 2
     },
+    {
+        .name = "texture_cache",
+        .description = "Texture cache entries",
+        .type = CONFIG_SELECTION,
+        .selection = {
+            {
+                .description = "64",
+                .value = 64
+            },
+            {
+                .description = "128",
+                .value = 128
+            },
+            {
+                .description = "256",
+                .value = 256
+            },
+            {
+                .description = "512",
+                .value = 512
+            },
+            {
+                .description = "1024",
+                .value = 1024
+            },
+            {
+                .description = ""
+            }
+        },
+        .default_int = TEX_CACHE_DEF
+    },
     {
         .name = "sli",
         .description = "SLI",
@@ -1422,6 +1430,12 @@ static const device_config_t voodoo_config[] = {
         .type = CONFIG_BINARY,
         .default_int = 1
     },
+    {
+        .name = "jit_warm_start",
+        .description = "Recompiler warm start",
+        .type = CONFIG_BINARY,
+        .default_int = 0
+    },
 #endif
     {
         .type = CONFIG_END
@@ -1161,12 +1161,12 @@ voodoo_reg_writel(uint32_t addr, uint32_t val, void *priv)
             if (val & (1 << 31)) {
                 int p = (val >> 23) & 0xfe;
                 if (chip & CHIP_TREX0) {
-                    voodoo->palette[0][p].u  = val | 0xff000000;
-                    voodoo->palette_dirty[0] = 1;
+                    voodoo->palette_checksum[0] ^= voodoo->palette[0][p].u ^ (val | 0xff000000);
+                    voodoo->palette[0][p].u = val | 0xff000000;
                 }
                 if (chip & CHIP_TREX1) {
-                    voodoo->palette[1][p].u  = val | 0xff000000;
-                    voodoo->palette_dirty[1] = 1;
+                    voodoo->palette_checksum[1] ^= voodoo->palette[1][p].u ^ (val | 0xff000000);
+                    voodoo->palette[1][p].u = val | 0xff000000;
                 }
             }
             break;
@@ -1222,12 +1222,12 @@ voodoo_reg_writel(uint32_t addr, uint32_t val, void *priv)
             if (val & (1 << 31)) {
                 int p = ((val >> 23) & 0xfe) | 0x01;
                 if (chip & CHIP_TREX0) {
-                    voodoo->palette[0][p].u  = val | 0xff000000;
-                    voodoo->palette_dirty[0] = 1;
+                    voodoo->palette_checksum[0] ^= voodoo->palette[0][p].u ^ (val | 0xff000000);
+                    voodoo->palette[0][p].u = val | 0xff000000;
                 }
                 if (chip & CHIP_TREX1) {
-                    voodoo->palette[1][p].u  = val | 0xff000000;
-                    voodoo->palette_dirty[1] = 1;
+                    voodoo->palette_checksum[1] ^= voodoo->palette[1][p].u ^ (val | 0xff000000);
+                    voodoo->palette[1][p].u = val | 0xff000000;
                 }
             }
             break;
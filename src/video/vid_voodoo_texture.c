@@ -239,6 +239,374 @@ voodoo_recalc_tex3(voodoo_t *voodoo, int tmu)
 
 #define makergba(r, g, b, a) ((b) | ((g) << 8) | ((r) << 16) | ((a) << 24))
 
+#define TEX_DATA_SIZE ((256 * 256 + 256 * 256 + 128 * 128 + 64 * 64 + 32 * 32 + 16 * 16 + 8 * 8 + 4 * 4 + 2 * 2) * 4)
+
+static __inline int
+voodoo_texture_hash(uint32_t base, uint32_t tLOD, uint32_t palette_checksum)
+{
+    uint32_t h = base ^ (tLOD * 0x9e3779b1) ^ (palette_checksum * 0x85ebca6b);
+
+    h ^= h >> 15;
+    h *= 0x2c1b3c6d;
+    h ^= h >> 12;
+
+    return h & (TEX_HASH_SIZE - 1);
+}
+
+/*A texture entry can only be replaced once every render thread has finished
+  with all the triangles that were queued using it.*/
+static __inline int
+voodoo_texture_idle(voodoo_t *voodoo, texture_t *tex)
+{
+    for (int c = 0; c < voodoo->render_threads; c++) {
+        if (tex->refcount != tex->refcount_r[c])
+            return 0;
+    }
+
+    return 1;
+}
+
+static void
+voodoo_texture_lru_unlink(voodoo_t *voodoo, int tmu, int c)
+{
+    texture_t *tex = &voodoo->texture_cache[tmu][c];
+
+    if (tex->lru_prev != -1)
+        voodoo->texture_cache[tmu][tex->lru_prev].lru_next = tex->lru_next;
+    else
+        voodoo->texture_lru_head[tmu] = tex->lru_next;
+    if (tex->lru_next != -1)
+        voodoo->texture_cache[tmu][tex->lru_next].lru_prev = tex->lru_prev;
+    else
+        voodoo->texture_lru_tail[tmu] = tex->lru_prev;
+
+    tex->lru_prev = tex->lru_next = -1;
+}
+
+static void
+voodoo_texture_lru_push_head(voodoo_t *voodoo, int tmu, int c)
+{
+    texture_t *tex = &voodoo->texture_cache[tmu][c];
+
+    tex->lru_prev = -1;
+    tex->lru_next = voodoo->texture_lru_head[tmu];
+    if (tex->lru_next != -1)
+        voodoo->texture_cache[tmu][tex->lru_next].lru_prev = c;
+    else
+        voodoo->texture_lru_tail[tmu] = c;
+    voodoo->texture_lru_head[tmu] = c;
+}
+
+static void
+voodoo_texture_lru_push_tail(voodoo_t *voodoo, int tmu, int c)
+{
+    texture_t *tex = &voodoo->texture_cache[tmu][c];
+
+    tex->lru_next = -1;
+    tex->lru_prev = voodoo->texture_lru_tail[tmu];
+    if (tex->lru_prev != -1)
+        voodoo->texture_cache[tmu][tex->lru_prev].lru_next = c;
+    else
+        voodoo->texture_lru_head[tmu] = c;
+    voodoo->texture_lru_tail[tmu] = c;
+}
+
+static void
+voodoo_texture_hash_insert(voodoo_t *voodoo, int tmu, int c)
+{
+    texture_t *tex  = &voodoo->texture_cache[tmu][c];
+    int        hash = voodoo_texture_hash(tex->base, tex->tLOD, tex->palette_checksum);
+
+    tex->hash_next                   = voodoo->texture_hash[tmu][hash];
+    voodoo->texture_hash[tmu][hash] = c;
+}
+
+static void
+voodoo_texture_hash_remove(voodoo_t *voodoo, int tmu, int c)
+{
+    texture_t *tex  = &voodoo->texture_cache[tmu][c];
+    int       *link = &voodoo->texture_hash[tmu][voodoo_texture_hash(tex->base, tex->tLOD, tex->palette_checksum)];
+
+    while (*link != -1) {
+        if (*link == c) {
+            *link = tex->hash_next;
+            break;
+        }
+        link = &voodoo->texture_cache[tmu][*link].hash_next;
+    }
+
+    tex->hash_next = -1;
+}
+
+/*Texture address ranges are kept in a treap keyed on start address, where
+  each node also records the highest end address in its subtree. This lets a
+  write to texture memory find just the textures that overlap it.*/
+static __inline void
+voodoo_texture_range_update(texture_range_t *ranges, int n)
+{
+    uint32_t max_end = ranges[n].end;
+
+    if ((ranges[n].left != -1) && (ranges[ranges[n].left].max_end > max_end))
+        max_end = ranges[ranges[n].left].max_end;
+    if ((ranges[n].right != -1) && (ranges[ranges[n].right].max_end > max_end))
+        max_end = ranges[ranges[n].right].max_end;
+
+    ranges[n].max_end = max_end;
+}
+
+/*Nodes are ordered on start address, then node number, so that every key is unique.*/
+static __inline int
+voodoo_texture_range_before(const texture_range_t *ranges, int a, int b)
+{
+    return (ranges[a].start < ranges[b].start) || ((ranges[a].start == ranges[b].start) && (a < b));
+}
+
+static int
+voodoo_texture_range_insert(texture_range_t *ranges, int root, int n)
+{
+    int t;
+
+    if (root == -1) {
+        voodoo_texture_range_update(ranges, n);
+        return n;
+    }
+
+    if (voodoo_texture_range_before(ranges, n, root)) {
+        ranges[root].left = voodoo_texture_range_insert(ranges, ranges[root].left, n);
+        if (ranges[ranges[root].left].prio > ranges[root].prio) {
+            t                 = ranges[root].left;
+            ranges[root].left = ranges[t].right;
+            ranges[t].right   = root;
+            voodoo_texture_range_update(ranges, root);
+            root = t;
+        }
+    } else {
+        ranges[root].right = voodoo_texture_range_insert(ranges, ranges[root].right, n);
+        if (ranges[ranges[root].right].prio > ranges[root].prio) {
+            t                  = ranges[root].right;
+            ranges[root].right = ranges[t].left;
+            ranges[t].left     = root;
+            voodoo_texture_range_update(ranges, root);
+            root = t;
+        }
+    }
+
+    voodoo_texture_range_update(ranges, root);
+    return root;
+}
+
+static int
+voodoo_texture_range_join(texture_range_t *ranges, int a, int b)
+{
+    if (a == -1)
+        return b;
+    if (b == -1)
+        return a;
+
+    if (ranges[a].prio > ranges[b].prio) {
+        ranges[a].right = voodoo_texture_range_join(ranges, ranges[a].right, b);
+        voodoo_texture_range_update(ranges, a);
+        return a;
+    }
+
+    ranges[b].left = voodoo_texture_range_join(ranges, a, ranges[b].left);
+    voodoo_texture_range_update(ranges, b);
+    return b;
+}
+
+static int
+voodoo_texture_range_delete(texture_range_t *ranges, int root, int n)
+{
+    if (root == -1)
+        return -1;
+
+    if (root == n)
+        return voodoo_texture_range_join(ranges, ranges[n].left, ranges[n].right);
+
+    if (voodoo_texture_range_before(ranges, n, root))
+        ranges[root].left = voodoo_texture_range_delete(ranges, ranges[root].left, n);
+    else
+        ranges[root].right = voodoo_texture_range_delete(ranges, ranges[root].right, n);
+
+    voodoo_texture_range_update(ranges, root);
+    return root;
+}
+
+/*Collect the entries with a range containing addr. An entry may be listed more than once.*/
+static void
+voodoo_texture_range_query(texture_range_t *ranges, int root, uint32_t addr, int *list, int *count)
+{
+    while ((root != -1) && (ranges[root].max_end > addr)) {
+        voodoo_texture_range_query(ranges, ranges[root].left, addr, list, count);
+
+        if (ranges[root].start > addr)
+            return;
+
+        if (addr < ranges[root].end)
+            list[(*count)++] = root / TEX_RANGES_PER_ENTRY;
+
+        root = ranges[root].right;
+    }
+}
+
+static void
+voodoo_texture_range_add(voodoo_t *voodoo, int tmu, int c, int *slot, uint32_t start, uint32_t end)
+{
+    texture_range_t *range = &voodoo->texture_ranges[tmu][c * TEX_RANGES_PER_ENTRY + *slot];
+
+    range->start   = start;
+    range->end     = end;
+    range->left    = -1;
+    range->right   = -1;
+    range->in_tree = 1;
+    /*xorshift priorities keep the treap balanced*/
+    voodoo->texture_range_seed ^= voodoo->texture_range_seed << 13;
+    voodoo->texture_range_seed ^= voodoo->texture_range_seed >> 17;
+    voodoo->texture_range_seed ^= voodoo->texture_range_seed << 5;
+    range->prio = voodoo->texture_range_seed;
+
+    voodoo->texture_range_root[tmu] = voodoo_texture_range_insert(voodoo->texture_ranges[tmu], voodoo->texture_range_root[tmu], c * TEX_RANGES_PER_ENTRY + *slot);
+
+    for (uint32_t addr = start; addr < end; addr += (1 << TEX_DIRTY_SHIFT))
+        voodoo->texture_present[tmu][addr >> TEX_DIRTY_SHIFT]++;
+
+    (*slot)++;
+}
+
+/*Register the texture memory used by an entry, rounded out to TEX_DIRTY_SHIFT pages.*/
+static void
+voodoo_texture_ranges_add(voodoo_t *voodoo, int tmu, int c)
+{
+    const texture_t *tex  = &voodoo->texture_cache[tmu][c];
+    int              slot = 0;
+
+    for (uint8_t d = 0; d < 4; d++) {
+        if (tex->addr_end[d] != 0) {
+            uint32_t start = tex->addr_start[d] & voodoo->texture_mask & ~((1 << TEX_DIRTY_SHIFT) - 1);
+            uint32_t end   = (((tex->addr_end[d] & voodoo->texture_mask) >> TEX_DIRTY_SHIFT) + 1) << TEX_DIRTY_SHIFT;
+
+            if (end <= start) {
+                /*Wraps around the end of texture memory*/
+                voodoo_texture_range_add(voodoo, tmu, c, &slot, start, voodoo->texture_mask + 1);
+                voodoo_texture_range_add(voodoo, tmu, c, &slot, 0, end);
+            } else
+                voodoo_texture_range_add(voodoo, tmu, c, &slot, start, end);
+        }
+    }
+}
+
+static void
+voodoo_texture_ranges_remove(voodoo_t *voodoo, int tmu, int c)
+{
+    for (int slot = 0; slot < TEX_RANGES_PER_ENTRY; slot++) {
+        int              n     = c * TEX_RANGES_PER_ENTRY + slot;
+        texture_range_t *range = &voodoo->texture_ranges[tmu][n];
+
+        if (!range->in_tree)
+            continue;
+
+        voodoo->texture_range_root[tmu] = voodoo_texture_range_delete(voodoo->texture_ranges[tmu], voodoo->texture_range_root[tmu], n);
+        range->in_tree                  = 0;
+
+        for (uint32_t addr = range->start; addr < range->end; addr += (1 << TEX_DIRTY_SHIFT))
+            voodoo->texture_present[tmu][addr >> TEX_DIRTY_SHIFT]--;
+    }
+}
+
+/*Drop an entry from the lookup hash and the range index, and make it the
+  first candidate for reuse.*/
+static void
+voodoo_texture_invalidate(voodoo_t *voodoo, int tmu, int c)
+{
+    voodoo_texture_hash_remove(voodoo, tmu, c);
+    voodoo_texture_ranges_remove(voodoo, tmu, c);
+    voodoo->texture_cache[tmu][c].base = -1;
+
+    voodoo_texture_lru_unlink(voodoo, tmu, c);
+    voodoo_texture_lru_push_tail(voodoo, tmu, c);
+}
+
+void
+voodoo_texture_cache_init(voodoo_t *voodoo, int entries)
+{
+    if (entries <= 0)
+        entries = TEX_CACHE_DEF;
+    else if (entries > TEX_CACHE_MAX)
+        entries = TEX_CACHE_MAX;
+
+    voodoo->texture_cache_size = entries;
+    voodoo->texture_range_seed = 0x2545f491;
+    voodoo->texture_evict_list = malloc(entries * TEX_RANGES_PER_ENTRY * sizeof(int));
+
+    for (uint8_t tmu = 0; tmu < 2; tmu++) {
+        /*Texture data is allocated the first time an entry is used, so that a
+          large cache costs nothing until a game actually fills it.*/
+        voodoo->texture_cache[tmu] = calloc(entries, sizeof(texture_t));
+
+        for (int c = 0; c < TEX_HASH_SIZE; c++)
+            voodoo->texture_hash[tmu][c] = -1;
+
+        voodoo->texture_ranges[tmu]     = calloc(entries * TEX_RANGES_PER_ENTRY, sizeof(texture_range_t));
+        voodoo->texture_range_root[tmu] = -1;
+
+        voodoo->texture_lru_head[tmu] = voodoo->texture_lru_tail[tmu] = -1;
+        for (int c = 0; c < entries; c++) {
+            voodoo->texture_cache[tmu][c].base      = -1; /*invalid*/
+            voodoo->texture_cache[tmu][c].refcount  = 0;
+            voodoo->texture_cache[tmu][c].hash_next = -1;
+            voodoo_texture_lru_push_tail(voodoo, tmu, c);
+        }
+    }
+}
+
+void
+voodoo_texture_cache_close(voodoo_t *voodoo)
+{
+    for (uint8_t tmu = 0; tmu < 2; tmu++) {
+        if (voodoo->texture_cache[tmu] == NULL)
+            continue;
+
+        for (int c = 0; c < voodoo->texture_cache_size; c++)
+            free(voodoo->texture_cache[tmu][c].data);
+        free(voodoo->texture_cache[tmu]);
+        voodoo->texture_cache[tmu] = NULL;
+
+        free(voodoo->texture_ranges[tmu]);
+        voodoo->texture_ranges[tmu] = NULL;
+    }
+
+    free(voodoo->texture_evict_list);
+    voodoo->texture_evict_list = NULL;
+}
+
+/*Find the least recently used entry that the render threads are no longer
+  using. If every entry is still in flight, only wait until the oldest one
+  has been retired, rather than for the render threads to go idle.*/
+static int
+voodoo_texture_find_victim(voodoo_t *voodoo, int tmu)
+{
+    texture_t *tex;
+    int        c;
+
+    for (c = voodoo->texture_lru_tail[tmu]; c != -1; c = voodoo->texture_cache[tmu][c].lru_prev) {
+        if (voodoo_texture_idle(voodoo, &voodoo->texture_cache[tmu][c]))
+            return c;
+    }
+
+    c   = voodoo->texture_lru_tail[tmu];
+    tex = &voodoo->texture_cache[tmu][c];
+    voodoo->tex_wait_count++;
+    while (!voodoo_texture_idle(voodoo, tex)) {
+        voodoo_wake_render_thread(voodoo);
+        for (int t = 0; t < voodoo->render_threads; t++) {
+            if (tex->refcount != tex->refcount_r[t])
+                thread_wait_event(voodoo->render_not_full_event[t], 1);
+        }
+    }
+
+    return c;
+}
+
 void
 voodoo_use_texture(voodoo_t *voodoo, voodoo_params_t *params, int tmu)
 {
@@ -246,24 +614,15 @@ voodoo_use_texture(voodoo_t *voodoo, voodoo_params_t *params, int tmu)
     int      lod_min;
     int      lod_max;
     uint32_t addr = 0;
-    uint32_t addr_end;
     uint32_t palette_checksum;
 
     lod_min = (params->tLOD[tmu] >> 2) & 15;
     lod_max = (params->tLOD[tmu] >> 8) & 15;
 
-    if (params->tformat[tmu] == TEX_PAL8 || params->tformat[tmu] == TEX_APAL8 || params->tformat[tmu] == TEX_APAL88) {
-        if (voodoo->palette_dirty[tmu]) {
-            palette_checksum = 0;
-
-            for (c = 0; c < 256; c++)
-                palette_checksum ^= voodoo->palette[tmu][c].u;
-
-            voodoo->palette_checksum[tmu] = palette_checksum;
-            voodoo->palette_dirty[tmu]    = 0;
-        } else
-            palette_checksum = voodoo->palette_checksum[tmu];
-    } else
+    /*The palette checksum is kept up to date as palette entries are written*/
+    if (params->tformat[tmu] == TEX_PAL8 || params->tformat[tmu] == TEX_APAL8 || params->tformat[tmu] == TEX_APAL88)
+        palette_checksum = voodoo->palette_checksum[tmu];
+    else
         palette_checksum = 0;
 
     if ((voodoo->params.tLOD[tmu] & LOD_SPLIT) && (voodoo->params.tLOD[tmu] & LOD_ODD) && (voodoo->params.tLOD[tmu] & LOD_TMULTIBASEADDR))
@@ -272,29 +631,31 @@ voodoo_use_texture(voodoo_t *voodoo, voodoo_params_t *params, int tmu)
         addr = params->texBaseAddr[tmu];
 
     /*Try to find texture in cache*/
-    for (c = 0; c < TEX_CACHE_MAX; c++) {
+    for (c = voodoo->texture_hash[tmu][voodoo_texture_hash(addr, params->tLOD[tmu] & 0xf00fff, palette_checksum)]; c != -1; c = voodoo->texture_cache[tmu][c].hash_next) {
         if (voodoo->texture_cache[tmu][c].base == addr && voodoo->texture_cache[tmu][c].tLOD == (params->tLOD[tmu] & 0xf00fff) && voodoo->texture_cache[tmu][c].palette_checksum == palette_checksum) {
             params->tex_entry[tmu] = c;
             voodoo->texture_cache[tmu][c].refcount++;
+            if (voodoo->texture_lru_head[tmu] != c) {
+                voodoo_texture_lru_unlink(voodoo, tmu, c);
+                voodoo_texture_lru_push_head(voodoo, tmu, c);
+            }
             return;
         }
     }
 
-    /*Texture not found, search for unused texture*/
-    do {
-        for (c = 0; c < TEX_CACHE_MAX; c++) {
-            voodoo->texture_last_removed++;
-            voodoo->texture_last_removed &= (TEX_CACHE_MAX - 1);
-            if (voodoo->texture_cache[tmu][voodoo->texture_last_removed].refcount == voodoo->texture_cache[tmu][voodoo->texture_last_removed].refcount_r[0] && (voodoo->render_threads == 1 || voodoo->texture_cache[tmu][voodoo->texture_last_removed].refcount == voodoo->texture_cache[tmu][voodoo->texture_last_removed].refcount_r[1]))
-                break;
-        }
-        if (c == TEX_CACHE_MAX)
-            voodoo_wait_for_render_thread_idle(voodoo);
-    } while (c == TEX_CACHE_MAX);
-    if (c == TEX_CACHE_MAX)
-        fatal("Texture cache full!\n");
+    /*Texture not found, replace the least recently used texture*/
+    c = voodoo_texture_find_victim(voodoo, tmu);
+
+    if (voodoo->texture_cache[tmu][c].base != -1) {
+        voodoo_texture_hash_remove(voodoo, tmu, c);
+        voodoo_texture_ranges_remove(voodoo, tmu, c);
+        voodoo->tex_replace_count++;
+    }
+    voodoo_texture_lru_unlink(voodoo, tmu, c);
+    voodoo_texture_lru_push_head(voodoo, tmu, c);
 
-    c = voodoo->texture_last_removed;
+    if (voodoo->texture_cache[tmu][c].data == NULL)
+        voodoo->texture_cache[tmu][c].data = malloc(TEX_DATA_SIZE);
 
     if ((voodoo->params.tLOD[tmu] & LOD_SPLIT) && (voodoo->params.tLOD[tmu] & LOD_ODD) && (voodoo->params.tLOD[tmu] & LOD_TMULTIBASEADDR))
         voodoo->texture_cache[tmu][c].base = params->texBaseAddr1[tmu];
@@ -536,60 +897,39 @@ voodoo_use_texture(voodoo_t *voodoo, voodoo_params_t *params, int tmu)
     } else
         voodoo->texture_cache[tmu][c].addr_start[3] = voodoo->texture_cache[tmu][c].addr_end[3] = 0;
 
-    for (uint8_t d = 0; d < 4; d++) {
-        addr     = voodoo->texture_cache[tmu][c].addr_start[d];
-        addr_end = voodoo->texture_cache[tmu][c].addr_end[d];
-
-        if (addr_end != 0) {
-            for (; addr <= addr_end; addr += (1 << TEX_DIRTY_SHIFT))
-                voodoo->texture_present[tmu][(addr & voodoo->texture_mask) >> TEX_DIRTY_SHIFT] = 1;
-        }
-    }
+    voodoo_texture_ranges_add(voodoo, tmu, c);
+    voodoo_texture_hash_insert(voodoo, tmu, c);
 
     params->tex_entry[tmu] = c;
     voodoo->texture_cache[tmu][c].refcount++;
 }
 
+/*Evict the textures overlapping a write to texture memory. Render threads
+  read decoded texture data from the cache entries, which are not reused until
+  the render threads have finished with them, so there is no need to wait for
+  them here.*/
 void
 flush_texture_cache(voodoo_t *voodoo, uint32_t dirty_addr, int tmu)
 {
-    int wait_for_idle = 0;
+    int count = 0;
 
-    memset(voodoo->texture_present[tmu], 0, sizeof(voodoo->texture_present[0]));
 #if 0
-    voodoo_texture_log("Evict %08x %i\n", dirty_addr, sizeof(voodoo->texture_present));
+    voodoo_texture_log("Evict %08x\n", dirty_addr);
 #endif
-    for (uint8_t c = 0; c < TEX_CACHE_MAX; c++) {
-        if (voodoo->texture_cache[tmu][c].base != -1) {
-            for (uint8_t d = 0; d < 4; d++) {
-                int addr_start = voodoo->texture_cache[tmu][c].addr_start[d];
-                int addr_end   = voodoo->texture_cache[tmu][c].addr_end[d];
+    dirty_addr &= ~((1 << TEX_DIRTY_SHIFT) - 1);
+    voodoo_texture_range_query(voodoo->texture_ranges[tmu], voodoo->texture_range_root[tmu], dirty_addr, voodoo->texture_evict_list, &count);
 
-                if (addr_end != 0) {
-                    int addr_start_masked = addr_start & voodoo->texture_mask & ~0x3ff;
-                    int addr_end_masked   = ((addr_end & voodoo->texture_mask) + 0x3ff) & ~0x3ff;
+    for (int i = 0; i < count; i++) {
+        int c = voodoo->texture_evict_list[i];
 
-                    if (addr_end_masked < addr_start_masked)
-                        addr_end_masked = voodoo->texture_mask + 1;
-                    if (dirty_addr >= addr_start_masked && dirty_addr < addr_end_masked) {
+        if (voodoo->texture_cache[tmu][c].base != -1) {
 #if 0
-                        voodoo_texture_log("  Evict texture %i %08x\n", c, voodoo->texture_cache[tmu][c].base);
+            voodoo_texture_log("  Evict texture %i %08x\n", c, voodoo->texture_cache[tmu][c].base);
 #endif
-
-                        if (voodoo->texture_cache[tmu][c].refcount != voodoo->texture_cache[tmu][c].refcount_r[0] || (voodoo->render_threads == 2 && voodoo->texture_cache[tmu][c].refcount != voodoo->texture_cache[tmu][c].refcount_r[1]))
-                            wait_for_idle = 1;
-
-                        voodoo->texture_cache[tmu][c].base = -1;
-                    } else {
-                        for (; addr_start <= addr_end; addr_start += (1 << TEX_DIRTY_SHIFT))
-                            voodoo->texture_present[tmu][(addr_start & voodoo->texture_mask) >> TEX_DIRTY_SHIFT] = 1;
-                    }
-                }
-            }
+            voodoo_texture_invalidate(voodoo, tmu, c);
+            voodoo->tex_evict_count++;
         }
     }
-    if (wait_for_idle)
-        voodoo_wait_for_render_thread_idle(voodoo);
 }
 
 void
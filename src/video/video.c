@@ -72,6 +72,7 @@
 #include <86box/ui.h>
 #include <86box/thread.h>
 #include <86box/video.h>
+#include <86box/vid_pacing.h>
 #include <86box/vid_svga.h>
 
 #include <minitrace/minitrace.h>
@@ -236,6 +237,7 @@ const uint32_t shade[5][256] = {
 
 typedef struct blit_data_struct {
     int x, y, w, h;
+    int dirty_y, dirty_h;
     int busy;
     int buffer_in_use;
     int thread_run;
@@ -453,6 +455,7 @@ blit_thread(void *param)
         if (blit_func)
             blit_func(data->x, data->y, data->w, data->h, data->monitor_index);
 
+        video_pacing_blit_done(data->monitor_index);
         data->busy = 0;
 
         MTR_END("video", "blit_thread");
@@ -460,8 +463,10 @@ blit_thread(void *param)
     }
 }
 
+/* Blit a frame of which only rows dirty_y to dirty_y + dirty_h - 1 of the
+   target buffer changed since the previous blit. */
 void
-video_blit_memtoscreen_monitor(int x, int y, int w, int h, int monitor_index)
+video_blit_memtoscreen_dirty_monitor(int x, int y, int w, int h, int dirty_y, int dirty_h, int monitor_index)
 {
     MTR_BEGIN("video", "video_blit_memtoscreen");
 
@@ -476,11 +481,30 @@ video_blit_memtoscreen_monitor(int x, int y, int w, int h, int monitor_index)
     monitors[monitor_index].mon_blit_data_ptr->y             = y;
     monitors[monitor_index].mon_blit_data_ptr->w             = w;
     monitors[monitor_index].mon_blit_data_ptr->h             = h;
+    monitors[monitor_index].mon_blit_data_ptr->dirty_y       = dirty_y;
+    monitors[monitor_index].mon_blit_data_ptr->dirty_h       = (dirty_h > 0) ? dirty_h : 0;
 
+    video_pacing_blit(monitor_index);
     thread_set_event(monitors[monitor_index].mon_blit_data_ptr->wake_blit_thread);
     MTR_END("video", "video_blit_memtoscreen");
 }
 
+void
+video_blit_memtoscreen_monitor(int x, int y, int w, int h, int monitor_index)
+{
+    video_blit_memtoscreen_dirty_monitor(x, y, w, h, y, h, monitor_index);
+}
+
+/* The dirty rows of the blit in progress, for the blit function. */
+void
+video_blit_get_dirty_monitor(int monitor_index, int *dirty_y, int *dirty_h)
+{
+    const blit_data_t *blit_data_ptr = monitors[monitor_index].mon_blit_data_ptr;
+
+    *dirty_y = blit_data_ptr->dirty_y;
+    *dirty_h = blit_data_ptr->dirty_h;
+}
+
 uint8_t
 pixels8(uint32_t *pixels)
 {
@@ -969,6 +993,8 @@ video_init(void)
 
     memset(monitors, 0, sizeof(monitors));
     video_monitor_init(0);
+
+    video_pacing_init();
 }
 
 void
@@ -976,6 +1002,8 @@ video_close(void)
 {
     video_monitor_close(0);
 
+    video_pacing_close();
+
     free(video_16to32);
     free(video_15to32);
     free(video_8to32);